@@ -0,0 +1,772 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+
+#include <uwifi/log.h>
+#include <uwifi/util.h>
+#include <uwifi/wlan_util.h>
+
+#include "main.h"
+#include "hutil.h"
+#include "pcap_reader.h"
+#include "analyze.h"
+
+/*
+ * Offline analysis (-A): the files are handed out to worker threads, which
+ * read them with their own pcap reader into their own statistics, node, ESSID
+ * and channel tables, so nothing is shared while packets are processed. When
+ * all files are done, the tables of all workers are merged into the first
+ * one: counters are added, minimums, maximums and first/last times combined
+ * and node properties are taken from the worker which saw them last. The
+ * result does not depend on how the files were distributed.
+ */
+
+#define MAX_ANALYZE_THREADS	64
+#define TABLE_MIN_SIZE		256
+
+/* open addressing hash table of fixed size entries: each entry starts with a
+ * bool 'used' and contains its key at 'koff' */
+struct table {
+	unsigned char*	slots;
+	unsigned int	size;		/* power of two */
+	unsigned int	used;
+	size_t		esize;
+	size_t		koff;
+	size_t		klen;
+};
+
+struct anode {
+	bool		used;
+	unsigned char	mac[WLAN_MAC_LEN];
+	unsigned char	bssid[WLAN_MAC_LEN];
+	char		essid[WLAN_MAX_SSID_LEN];
+	unsigned int	wlan_mode;
+	unsigned int	pkt_types;
+	unsigned int	channel;
+	unsigned int	freq;
+	unsigned int	ip_src;
+	unsigned int	wep:1,
+			wpa:1,
+			rsn:1;
+	unsigned long	packets;
+	unsigned long	bytes;
+	unsigned long	retries;
+	unsigned long	duration;
+	int		sig_min;
+	int		sig_max;
+	long		sig_sum;
+	unsigned long	sig_count;
+	int64_t		first;		/* usec */
+	int64_t		last;
+	int64_t		last_beacon;	/* time of essid, channel, encryption */
+};
+
+struct aessid {
+	bool		used;
+	char		essid[WLAN_MAX_SSID_LEN];
+	unsigned long	beacons;	/* beacons and probe responses */
+	int64_t		first;
+	int64_t		last;
+};
+
+struct achan {
+	bool		used;
+	unsigned int	freq;
+	unsigned long	packets;
+	unsigned long	bytes;
+	unsigned long	duration;
+};
+
+struct analysis {
+	pthread_t		thread;
+	struct statistics	stats;
+	struct table		nodes;
+	struct table		essids;
+	struct table		chans;
+	unsigned long		frames;
+	unsigned int		files;
+	unsigned int		errors;
+	int64_t			first;
+	int64_t			last;
+};
+
+static char** files;
+static unsigned int num_files;
+static unsigned int next_file;
+
+bool analyze_add_file(const char* name)
+{
+	char** n = realloc(files, (num_files + 1) * sizeof(char*));
+
+	if (n == NULL)
+		return false;
+	files = n;
+	files[num_files] = strdup(name);
+	if (files[num_files] == NULL)
+		return false;
+	num_files++;
+	return true;
+}
+
+/*** hash table ***/
+
+static void table_init(struct table* t, size_t esize, size_t koff, size_t klen)
+{
+	t->size = TABLE_MIN_SIZE;
+	t->used = 0;
+	t->esize = esize;
+	t->koff = koff;
+	t->klen = klen;
+	t->slots = calloc(t->size, esize);
+	if (t->slots == NULL)
+		err(1, "Could not allocate analysis table");
+}
+
+static void table_free(struct table* t)
+{
+	free(t->slots);
+	t->slots = NULL;
+}
+
+static void* table_entry(const struct table* t, unsigned int i)
+{
+	return t->slots + (size_t)i * t->esize;
+}
+
+/* FNV-1a */
+static unsigned int table_hash(const unsigned char* key, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h ^= *key++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static unsigned char* table_slot(const struct table* t, const void* key)
+{
+	unsigned int i = table_hash(key, t->klen) & (t->size - 1);
+	unsigned char* e;
+
+	for (;; i = (i + 1) & (t->size - 1)) {
+		e = table_entry(t, i);
+		if (!*(bool*)e || memcmp(e + t->koff, key, t->klen) == 0)
+			return e;
+	}
+}
+
+static void table_grow(struct table* t)
+{
+	struct table old = *t;
+	unsigned char* e;
+	unsigned int i;
+
+	t->size *= 2;
+	t->slots = calloc(t->size, t->esize);
+	if (t->slots == NULL)
+		err(1, "Could not allocate analysis table");
+
+	for (i = 0; i < old.size; i++) {
+		e = table_entry(&old, i);
+		if (*(bool*)e)
+			memcpy(table_slot(t, e + t->koff), e, t->esize);
+	}
+	free(old.slots);
+}
+
+/* return the entry for 'key', a new one is zeroed except for the key */
+static void* table_get(struct table* t, const void* key, bool* added)
+{
+	unsigned char* e = table_slot(t, key);
+
+	*added = !*(bool*)e;
+	if (!*added)
+		return e;
+
+	/* keep at least half of the slots free */
+	if (t->used + 1 > t->size / 2) {
+		table_grow(t);
+		e = table_slot(t, key);
+	}
+	*(bool*)e = true;
+	memcpy(e + t->koff, key, t->klen);
+	t->used++;
+	return e;
+}
+
+/* return all used entries as an array of pointers, sorted by 'cmp' */
+static void** table_sorted(const struct table* t,
+			   int (*cmp)(const void*, const void*))
+{
+	void** arr = malloc((t->used + 1) * sizeof(void*));
+	unsigned int i, n = 0;
+
+	if (arr == NULL)
+		err(1, "Could not allocate analysis table");
+
+	for (i = 0; i < t->size; i++) {
+		if (*(bool*)table_entry(t, i))
+			arr[n++] = table_entry(t, i);
+	}
+	qsort(arr, n, sizeof(void*), cmp);
+	return arr;
+}
+
+/*** workers ***/
+
+static void node_add(struct anode* n, struct uwifi_packet* p, int64_t t,
+		     bool added)
+{
+	if (added) {
+		n->first = t;
+		n->sig_min = INT32_MAX;
+		n->sig_max = INT32_MIN;
+	}
+
+	if (t < n->first)
+		n->first = t;
+	if (t >= n->last) {
+		n->last = t;
+		if (p->phy_freq)
+			n->freq = p->phy_freq;
+		if (MAC_NOT_EMPTY(p->wlan_bssid))
+			memcpy(n->bssid, p->wlan_bssid, WLAN_MAC_LEN);
+		if (p->ip_src)
+			n->ip_src = p->ip_src;
+	}
+
+	n->packets++;
+	n->bytes += p->wlan_len;
+	n->duration += p->pkt_duration;
+	if (p->wlan_retry)
+		n->retries++;
+	n->wlan_mode |= p->wlan_mode;
+	n->pkt_types |= p->pkt_types;
+
+	if (p->phy_signal != 0) {
+		if (p->phy_signal < n->sig_min)
+			n->sig_min = p->phy_signal;
+		if (p->phy_signal > n->sig_max)
+			n->sig_max = p->phy_signal;
+		n->sig_sum += p->phy_signal;
+		n->sig_count++;
+	}
+
+	if ((p->wlan_type == WLAN_FRAME_BEACON ||
+	     p->wlan_type == WLAN_FRAME_PROBE_RESP) && t >= n->last_beacon) {
+		n->last_beacon = t;
+		memcpy(n->essid, p->wlan_essid, WLAN_MAX_SSID_LEN);
+		n->channel = p->wlan_channel;
+		n->wep = p->wlan_wep;
+		n->wpa = p->wlan_wpa;
+		n->rsn = p->wlan_rsn;
+	}
+}
+
+static void analysis_add(struct analysis* a, struct uwifi_packet* p,
+			 const struct timespec* ts)
+{
+	int64_t t = ts->tv_sec * 1000000LL + ts->tv_nsec / 1000;
+	char essid[WLAN_MAX_SSID_LEN];
+	struct anode* n;
+	struct aessid* e;
+	struct achan* c;
+	bool added;
+	size_t len;
+
+	if (a->first == 0 || t < a->first)
+		a->first = t;
+	if (t > a->last)
+		a->last = t;
+
+	update_statistics(&a->stats, p);
+
+	if (p->phy_freq) {
+		c = table_get(&a->chans, &p->phy_freq, &added);
+		c->packets++;
+		c->bytes += p->wlan_len;
+		c->duration += p->pkt_duration;
+	}
+
+	/* we can't trust any fields except phy_* of packets with bad FCS */
+	if ((p->phy_flags & PHY_FLAG_BADFCS) || MAC_EMPTY(p->wlan_src))
+		return;
+
+	n = table_get(&a->nodes, p->wlan_src, &added);
+	node_add(n, p, t, added);
+
+	if ((p->wlan_type == WLAN_FRAME_BEACON ||
+	     p->wlan_type == WLAN_FRAME_PROBE_RESP) && p->wlan_essid[0] != '\0') {
+		/* the key has to be padded */
+		len = strnlen(p->wlan_essid, WLAN_MAX_SSID_LEN - 1);
+		memset(essid, 0, sizeof(essid));
+		memcpy(essid, p->wlan_essid, len);
+		essid[len] = '\0';
+		e = table_get(&a->essids, essid, &added);
+		if (added || t < e->first)
+			e->first = t;
+		if (t > e->last)
+			e->last = t;
+		e->beacons++;
+	}
+}
+
+static void* worker_run(void* arg)
+{
+	struct analysis* a = arg;
+	struct pcap_reader* r;
+	struct uwifi_packet p;
+	struct pcap_frame f;
+	unsigned int i;
+	int ret;
+
+	while ((i = __atomic_fetch_add(&next_file, 1, __ATOMIC_RELAXED)) < num_files) {
+		r = pcap_reader_open(files[i]);
+		if (r == NULL) {
+			a->errors++;
+			continue;
+		}
+
+		while ((ret = pcap_reader_next(r, &f)) > 0) {
+			a->frames++;
+			if (frame_to_packet(f.buf, f.len, f.orig_len, f.arphdr, &f.ts, &p))
+				analysis_add(a, &p, &f.ts);
+		}
+		if (ret < 0)
+			a->errors++;
+
+		pcap_reader_close(r);
+		a->files++;
+	}
+	return NULL;
+}
+
+/*** merging ***/
+
+static void statistics_merge(struct statistics* d, const struct statistics* s)
+{
+	int i;
+
+	d->packets += s->packets;
+	d->retries += s->retries;
+	d->bytes += s->bytes;
+	d->duration += s->duration;
+
+	for (i = 0; i < MAX_RATES; i++) {
+		d->packets_per_rate[i] += s->packets_per_rate[i];
+		d->bytes_per_rate[i] += s->bytes_per_rate[i];
+		d->duration_per_rate[i] += s->duration_per_rate[i];
+	}
+
+	for (i = 0; i < MAX_FSTYPE; i++) {
+		d->packets_per_type[i] += s->packets_per_type[i];
+		d->bytes_per_type[i] += s->bytes_per_type[i];
+		d->duration_per_type[i] += s->duration_per_type[i];
+	}
+}
+
+static void node_merge(void* dst, const void* src)
+{
+	struct anode* d = dst;
+	const struct anode* s = src;
+
+	if (s->first < d->first)
+		d->first = s->first;
+	if (s->last > d->last) {
+		d->last = s->last;
+		if (s->freq)
+			d->freq = s->freq;
+		if (MAC_NOT_EMPTY(s->bssid))
+			memcpy(d->bssid, s->bssid, WLAN_MAC_LEN);
+		if (s->ip_src)
+			d->ip_src = s->ip_src;
+	}
+	if (d->ip_src == 0)
+		d->ip_src = s->ip_src;
+
+	d->packets += s->packets;
+	d->bytes += s->bytes;
+	d->duration += s->duration;
+	d->retries += s->retries;
+	d->wlan_mode |= s->wlan_mode;
+	d->pkt_types |= s->pkt_types;
+
+	if (s->sig_min < d->sig_min)
+		d->sig_min = s->sig_min;
+	if (s->sig_max > d->sig_max)
+		d->sig_max = s->sig_max;
+	d->sig_sum += s->sig_sum;
+	d->sig_count += s->sig_count;
+
+	if (s->last_beacon > d->last_beacon) {
+		d->last_beacon = s->last_beacon;
+		memcpy(d->essid, s->essid, WLAN_MAX_SSID_LEN);
+		d->channel = s->channel;
+		d->wep = s->wep;
+		d->wpa = s->wpa;
+		d->rsn = s->rsn;
+	}
+}
+
+static void essid_merge(void* dst, const void* src)
+{
+	struct aessid* d = dst;
+	const struct aessid* s = src;
+
+	if (s->first < d->first)
+		d->first = s->first;
+	if (s->last > d->last)
+		d->last = s->last;
+	d->beacons += s->beacons;
+}
+
+static void chan_merge(void* dst, const void* src)
+{
+	struct achan* d = dst;
+	const struct achan* s = src;
+
+	d->packets += s->packets;
+	d->bytes += s->bytes;
+	d->duration += s->duration;
+}
+
+static void table_merge(struct table* d, const struct table* s,
+			void (*merge)(void*, const void*))
+{
+	unsigned char* e;
+	unsigned char* n;
+	unsigned int i;
+	bool added;
+
+	for (i = 0; i < s->size; i++) {
+		e = table_entry(s, i);
+		if (!*(bool*)e)
+			continue;
+		n = table_get(d, e + s->koff, &added);
+		if (added)
+			memcpy(n, e, s->esize);
+		else
+			merge(n, e);
+	}
+}
+
+static void analysis_merge(struct analysis* d, const struct analysis* s)
+{
+	statistics_merge(&d->stats, &s->stats);
+	table_merge(&d->nodes, &s->nodes, node_merge);
+	table_merge(&d->essids, &s->essids, essid_merge);
+	table_merge(&d->chans, &s->chans, chan_merge);
+
+	d->frames += s->frames;
+	d->files += s->files;
+	d->errors += s->errors;
+	if (s->first != 0 && (d->first == 0 || s->first < d->first))
+		d->first = s->first;
+	if (s->last > d->last)
+		d->last = s->last;
+}
+
+/*** report ***/
+
+static int node_cmp(const void* a, const void* b)
+{
+	const struct anode* na = *(const struct anode**)a;
+	const struct anode* nb = *(const struct anode**)b;
+
+	if (na->packets != nb->packets)
+		return na->packets < nb->packets ? 1 : -1;
+	return memcmp(na->mac, nb->mac, WLAN_MAC_LEN);
+}
+
+static int essid_cmp(const void* a, const void* b)
+{
+	const struct aessid* ea = *(const struct aessid**)a;
+	const struct aessid* eb = *(const struct aessid**)b;
+
+	if (ea->beacons != eb->beacons)
+		return ea->beacons < eb->beacons ? 1 : -1;
+	return strcmp(ea->essid, eb->essid);
+}
+
+static int chan_cmp(const void* a, const void* b)
+{
+	const struct achan* ca = *(const struct achan**)a;
+	const struct achan* cb = *(const struct achan**)b;
+
+	return (ca->freq > cb->freq) - (ca->freq < cb->freq);
+}
+
+/* number of access points which announced 'essid' last */
+static unsigned int essid_aps(const struct table* nodes, const char* essid)
+{
+	const struct anode* n;
+	unsigned int i, aps = 0;
+
+	for (i = 0; i < nodes->size; i++) {
+		n = table_entry(nodes, i);
+		if (n->used && (n->wlan_mode & WLAN_MODE_AP) &&
+		    strcmp(n->essid, essid) == 0)
+			aps++;
+	}
+	return aps;
+}
+
+static const char* time_str(int64_t usec)
+{
+	static char buf[32];
+	time_t t = usec / 1000000;
+
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+	return buf;
+}
+
+static int sig_avg(const struct anode* n)
+{
+	return n->sig_count ? n->sig_sum / (long)n->sig_count : 0;
+}
+
+static void print_table(const struct analysis* a)
+{
+	const struct statistics* s = &a->stats;
+	struct anode** nodes = (struct anode**)table_sorted(&a->nodes, node_cmp);
+	struct aessid** essids = (struct aessid**)table_sorted(&a->essids, essid_cmp);
+	struct achan** chans = (struct achan**)table_sorted(&a->chans, chan_cmp);
+	struct anode* n;
+	unsigned int i;
+
+	printf("Files:    %u (%u errors)\n", a->files, a->errors);
+	printf("Frames:   %lu (%lu filtered)\n", a->frames, stats.filtered_packets);
+	printf("Packets:  %lu, %lu bytes, %lu retries, %lu usec airtime\n",
+	       s->packets, s->bytes, s->retries, s->duration);
+	if (a->first != 0) {
+		printf("First:    %s\n", time_str(a->first));
+		printf("Last:     %s\n", time_str(a->last));
+	}
+
+	printf("\n%-6s %10s %12s %12s\n", "FREQ", "PACKETS", "BYTES", "AIRTIME");
+	for (i = 0; i < a->chans.used; i++)
+		printf("%-6u %10lu %12lu %12lu\n", chans[i]->freq,
+		       chans[i]->packets, chans[i]->bytes, chans[i]->duration);
+
+	printf("\n%-6s %10s %12s %12s\n", "TYPE", "PACKETS", "BYTES", "AIRTIME");
+	for (i = 0; i < MAX_FSTYPE; i++) {
+		if (s->packets_per_type[i] > 0)
+			printf("%-6s %10lu %12lu %12lu\n",
+			       wlan_get_packet_type_name(i), s->packets_per_type[i],
+			       s->bytes_per_type[i], s->duration_per_type[i]);
+	}
+
+	printf("\n%-17s %-4s %-17s %4s %4s %4s %4s %10s %12s %6s %s\n",
+	       "MAC", "MODE", "BSSID", "CHAN", "SIG", "MIN", "MAX",
+	       "PACKETS", "BYTES", "RETRY%", "ESSID");
+	for (i = 0; i < a->nodes.used; i++) {
+		n = nodes[i];
+		printf(MAC_FMT " %-4s " MAC_FMT " %4u %4d %4d %4d %10lu %12lu %6.1f %s\n",
+		       MAC_PAR(n->mac), wlan_mode_string(n->wlan_mode),
+		       MAC_PAR(n->bssid), n->channel, sig_avg(n),
+		       n->sig_count ? n->sig_min : 0,
+		       n->sig_count ? n->sig_max : 0,
+		       n->packets, n->bytes, 100.0 * n->retries / n->packets,
+		       n->essid);
+	}
+
+	printf("\n%-32s %4s %10s\n", "ESSID", "APS", "BEACONS");
+	for (i = 0; i < a->essids.used; i++)
+		printf("%-32s %4u %10lu\n", essids[i]->essid,
+		       essid_aps(&a->nodes, essids[i]->essid), essids[i]->beacons);
+
+	free(nodes);
+	free(essids);
+	free(chans);
+}
+
+/* valid UTF-8 is printed as it is, see put_json_str() in outfile.c */
+static void json_str(const char* str)
+{
+	const char* s = str;
+	unsigned char c;
+	int len;
+
+	putchar('"');
+	while (*s != '\0') {
+		c = *s;
+		len = utf8_char_len(s);
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20 || c == 0x7f || len == 0)
+			printf("\\u%04x", c);
+		else {
+			fwrite(s, 1, len, stdout);
+			s += len;
+			continue;
+		}
+		s++;
+	}
+	putchar('"');
+}
+
+static void print_json(const struct analysis* a)
+{
+	const struct statistics* s = &a->stats;
+	struct anode** nodes = (struct anode**)table_sorted(&a->nodes, node_cmp);
+	struct aessid** essids = (struct aessid**)table_sorted(&a->essids, essid_cmp);
+	struct achan** chans = (struct achan**)table_sorted(&a->chans, chan_cmp);
+	struct anode* n;
+	unsigned int i;
+	bool first = true;
+
+	printf("{\"files\":%u,\"errors\":%u,\"frames\":%lu,\"filtered\":%lu,"
+	       "\"packets\":%lu,\"bytes\":%lu,\"retries\":%lu,\"airtime\":%lu,"
+	       "\"first_usec\":%lld,\"last_usec\":%lld,\n\"channels\":[",
+	       a->files, a->errors, a->frames, stats.filtered_packets,
+	       s->packets, s->bytes, s->retries, s->duration,
+	       (long long)a->first, (long long)a->last);
+
+	for (i = 0; i < a->chans.used; i++)
+		printf("%s\n{\"freq\":%u,\"packets\":%lu,\"bytes\":%lu,\"airtime\":%lu}",
+		       i ? "," : "", chans[i]->freq, chans[i]->packets,
+		       chans[i]->bytes, chans[i]->duration);
+
+	printf("],\n\"types\":[");
+	for (i = 0; i < MAX_FSTYPE; i++) {
+		if (s->packets_per_type[i] == 0)
+			continue;
+		printf("%s\n{\"type\":", first ? "" : ",");
+		json_str(wlan_get_packet_type_name(i));
+		printf(",\"packets\":%lu,\"bytes\":%lu,\"airtime\":%lu}",
+		       s->packets_per_type[i], s->bytes_per_type[i],
+		       s->duration_per_type[i]);
+		first = false;
+	}
+
+	printf("],\n\"nodes\":[");
+	for (i = 0; i < a->nodes.used; i++) {
+		n = nodes[i];
+		printf("%s\n{\"mac\":\"" MAC_FMT "\",\"mode\":\"%s\",\"bssid\":\""
+		       MAC_FMT "\",\"channel\":%u,\"freq\":%u,\"essid\":",
+		       i ? "," : "", MAC_PAR(n->mac),
+		       wlan_mode_string(n->wlan_mode), MAC_PAR(n->bssid),
+		       n->channel, n->freq);
+		json_str(n->essid);
+		printf(",\"wep\":%s,\"wpa\":%s,\"rsn\":%s,\"ip\":\"%s\","
+		       "\"pkt_types\":%u,\"packets\":%lu,\"bytes\":%lu,"
+		       "\"retries\":%lu,\"airtime\":%lu",
+		       n->wep ? "true" : "false", n->wpa ? "true" : "false",
+		       n->rsn ? "true" : "false", ip_sprintf(n->ip_src),
+		       n->pkt_types, n->packets, n->bytes, n->retries,
+		       n->duration);
+		if (n->sig_count)
+			printf(",\"signal\":%d,\"signal_min\":%d,\"signal_max\":%d",
+			       sig_avg(n), n->sig_min, n->sig_max);
+		printf(",\"first_usec\":%lld,\"last_usec\":%lld}",
+		       (long long)n->first, (long long)n->last);
+	}
+
+	printf("],\n\"essids\":[");
+	for (i = 0; i < a->essids.used; i++) {
+		printf("%s\n{\"essid\":", i ? "," : "");
+		json_str(essids[i]->essid);
+		printf(",\"aps\":%u,\"beacons\":%lu,\"first_usec\":%lld,\"last_usec\":%lld}",
+		       essid_aps(&a->nodes, essids[i]->essid), essids[i]->beacons,
+		       (long long)essids[i]->first, (long long)essids[i]->last);
+	}
+	printf("]}\n");
+
+	free(nodes);
+	free(essids);
+	free(chans);
+}
+
+static void analysis_init(struct analysis* a)
+{
+	memset(a, 0, sizeof(struct analysis));
+	table_init(&a->nodes, sizeof(struct anode), offsetof(struct anode, mac),
+		   WLAN_MAC_LEN);
+	table_init(&a->essids, sizeof(struct aessid),
+		   offsetof(struct aessid, essid), WLAN_MAX_SSID_LEN);
+	table_init(&a->chans, sizeof(struct achan), offsetof(struct achan, freq),
+		   sizeof(unsigned int));
+}
+
+static void analysis_free(struct analysis* a)
+{
+	table_free(&a->nodes);
+	table_free(&a->essids);
+	table_free(&a->chans);
+}
+
+int analyze_run(void)
+{
+	struct analysis* a;
+	struct timespec start, end;
+	double secs;
+	int threads = conf.analyze_threads;
+	int i, ret;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > (int)num_files)
+		threads = num_files;
+	threads = MAX(MIN(threads, MAX_ANALYZE_THREADS), 1);
+
+	a = calloc(threads, sizeof(struct analysis));
+	if (a == NULL)
+		err(1, "Could not allocate analysis");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < threads; i++) {
+		analysis_init(&a[i]);
+		if (pthread_create(&a[i].thread, NULL, worker_run, &a[i]) != 0)
+			err(1, "Could not create analysis thread");
+	}
+
+	pthread_join(a[0].thread, NULL);
+	for (i = 1; i < threads; i++) {
+		pthread_join(a[i].thread, NULL);
+		analysis_merge(&a[0], &a[i]);
+		analysis_free(&a[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+	LOG_INF("Analyzed %lu frames of %u files with %d threads in %.3f sec (%.0f frames/sec)",
+		a[0].frames, num_files, threads, secs, secs > 0 ? a[0].frames / secs : 0);
+
+	if (conf.analyze_format == ANALYZE_JSON)
+		print_json(&a[0]);
+	else
+		print_table(&a[0]);
+
+	ret = a[0].errors ? 1 : 0;
+	analysis_free(&a[0]);
+	free(a);
+	return ret;
+}
@@ -0,0 +1,37 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _ANALYZE_H_
+#define _ANALYZE_H_
+
+#include <stdbool.h>
+
+enum analyze_format {
+	ANALYZE_TABLE,
+	ANALYZE_JSON,
+};
+
+/* add a pcap/pcapng file to the offline analysis */
+bool analyze_add_file(const char* name);
+
+/* analyze all files with conf.analyze_threads workers, print the report and
+ * return the exit code */
+int analyze_run(void);
+
+#endif
@@ -0,0 +1,172 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "batadv.h"
+
+/*
+ * Table of batman-adv originators by MAC address. OGMs are rebroadcast
+ * through the mesh, so each one is only counted once per sequence number,
+ * but the best TQ or throughput of all copies is kept. Packets are parsed
+ * in the capture threads, so the table is locked.
+ */
+
+#define BATADV_ORIG_HASH	256
+
+static struct list_head orig_hash[BATADV_ORIG_HASH];
+static pthread_mutex_t orig_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void batadv_orig_init(void)
+{
+	for (int i = 0; i < BATADV_ORIG_HASH; i++)
+		list_head_init(&orig_hash[i]);
+}
+
+/* call with orig_lock held */
+static struct batadv_orig* orig_find(const unsigned char* mac, bool add)
+{
+	/* the last bytes differ most */
+	struct list_head* head = &orig_hash[(mac[4] ^ mac[5]) % BATADV_ORIG_HASH];
+	struct batadv_orig* o;
+
+	list_for_each(head, o, list) {
+		if (memcmp(o->mac, mac, sizeof(o->mac)) == 0)
+			return o;
+	}
+
+	if (!add)
+		return NULL;
+
+	o = calloc(1, sizeof(struct batadv_orig));
+	if (o == NULL)
+		return NULL;
+	memcpy(o->mac, mac, sizeof(o->mac));
+	o->tq = -1;
+	list_add_tail(head, &o->list);
+	return o;
+}
+
+/* packets of several interfaces can arrive slightly out of order */
+static unsigned int ms_between(const struct timespec* a, const struct timespec* b)
+{
+	if (b->tv_sec < a->tv_sec ||
+	    (b->tv_sec == a->tv_sec && b->tv_nsec < a->tv_nsec))
+		return 0;
+	return (b->tv_sec - a->tv_sec) * 1000 +
+	       (b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+void batadv_orig_ogm(const unsigned char* mac, uint32_t seqno, int tq,
+		     uint32_t throughput, const struct timespec* ts)
+{
+	struct batadv_orig* o;
+
+	pthread_mutex_lock(&orig_lock);
+	o = orig_find(mac, true);
+	if (o == NULL)
+		goto out;
+
+	o->last_seen = ts->tv_sec;
+
+	if (o->ogms > 0 && seqno == o->seqno) {
+		/* another copy of the newest OGM */
+		if (tq > o->tq)
+			o->tq = tq;
+		if (throughput > o->throughput)
+			o->throughput = throughput;
+		goto out;
+	}
+
+	/* old copy, arriving late */
+	if (o->ogms > 0 && (int32_t)(seqno - o->seqno) < 0)
+		goto out;
+
+	if (o->ogms == 1)
+		o->ogm_interval = ms_between(&o->last_ogm, ts);
+	else if (o->ogms > 1)
+		o->ogm_interval = (o->ogm_interval * 7 + ms_between(&o->last_ogm, ts)) / 8;
+
+	o->seqno = seqno;
+	o->tq = tq;
+	o->throughput = throughput;
+	o->last_ogm = *ts;
+	o->ogms++;
+out:
+	pthread_mutex_unlock(&orig_lock);
+}
+
+void batadv_orig_gw(const unsigned char* mac, uint32_t down, uint32_t up,
+		    const struct timespec* ts)
+{
+	struct batadv_orig* o;
+
+	pthread_mutex_lock(&orig_lock);
+	o = orig_find(mac, true);
+	if (o != NULL) {
+		o->gw_down = down;
+		o->gw_up = up;
+		o->last_seen = ts->tv_sec;
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
+
+bool batadv_orig_get(const unsigned char* mac, struct batadv_orig* o)
+{
+	struct batadv_orig* f;
+
+	pthread_mutex_lock(&orig_lock);
+	f = orig_find(mac, false);
+	if (f != NULL)
+		*o = *f;
+	pthread_mutex_unlock(&orig_lock);
+	return f != NULL;
+}
+
+void batadv_orig_timeout(time_t now, unsigned int timeout_sec)
+{
+	struct batadv_orig *o, *o2;
+
+	pthread_mutex_lock(&orig_lock);
+	for (int i = 0; i < BATADV_ORIG_HASH; i++) {
+		list_for_each_safe(&orig_hash[i], o, o2, list) {
+			if (o->last_seen < now - (time_t)timeout_sec) {
+				list_del(&o->list);
+				free(o);
+			}
+		}
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
+
+void batadv_orig_free(void)
+{
+	struct batadv_orig *o, *o2;
+
+	pthread_mutex_lock(&orig_lock);
+	for (int i = 0; i < BATADV_ORIG_HASH; i++) {
+		list_for_each_safe(&orig_hash[i], o, o2, list) {
+			list_del(&o->list);
+			free(o);
+		}
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
@@ -0,0 +1,59 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BATADV_H_
+#define _BATADV_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#undef LIST_HEAD
+#include <ccan/list/list.h>
+
+/* what batman-adv v15 OGMs and their TVLVs tell about their originator */
+struct batadv_orig {
+	struct list_node	list;
+	unsigned char		mac[6];
+	uint32_t		seqno;		/* newest OGM */
+	unsigned int		ogms;		/* number of different OGMs */
+	unsigned int		ogm_interval;	/* average, in ms */
+	int			tq;		/* best TQ of newest OGM, -1 for OGM2 */
+	uint32_t		throughput;	/* best of newest OGM2, in kbit/s */
+	uint32_t		gw_down;	/* gateway bandwidth, in kbit/s */
+	uint32_t		gw_up;
+	struct timespec		last_ogm;	/* receive times, CLOCK_REALTIME */
+	time_t			last_seen;
+};
+
+void batadv_orig_init(void);
+
+/* 'tq' is -1 for OGM2 which carry a 'throughput' instead */
+void batadv_orig_ogm(const unsigned char* mac, uint32_t seqno, int tq,
+		     uint32_t throughput, const struct timespec* ts);
+void batadv_orig_gw(const unsigned char* mac, uint32_t down, uint32_t up,
+		    const struct timespec* ts);
+
+/* copy originator 'mac' into 'o', returns false if unknown */
+bool batadv_orig_get(const unsigned char* mac, struct batadv_orig* o);
+
+void batadv_orig_timeout(time_t now, unsigned int timeout_sec);
+void batadv_orig_free(void);
+
+#endif
@@ -15,22 +15,33 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef _NET_BATMAN_ADV_PACKET_H_
-#define _NET_BATMAN_ADV_PACKET_H_
+#ifndef _BATMAN_ADV_PACKET_15_H_
+#define _BATMAN_ADV_PACKET_15_H_
 
 #include <stdint.h>
+#include <endian.h>
 
-#define BIT(_x) (1<_x)
+#ifndef BIT
+#define BIT(_x) (1 << (_x))
+#endif
 typedef uint16_t __be16;
 typedef uint32_t __be32;
+#ifndef ETH_ALEN
 #define ETH_ALEN 6
-#define __BIG_ENDIAN_BITFIELD /* todo */
+#endif
+#if __BYTE_ORDER == __BIG_ENDIAN
+#define __BIG_ENDIAN_BITFIELD
+#else
+#define __LITTLE_ENDIAN_BITFIELD
+#endif
 
 /**
  * enum batadv_packettype - types for batman-adv encapsulated packets
  * @BATADV_IV_OGM: originator messages for B.A.T.M.A.N. IV
  * @BATADV_BCAST: broadcast packets carrying broadcast payload
  * @BATADV_CODED: network coded packets
+ * @BATADV_ELP: echo location packets for B.A.T.M.A.N. V
+ * @BATADV_OGM2: originator messages for B.A.T.M.A.N. V
  *
  * @BATADV_UNICAST: unicast packets carrying unicast payload traffic
  * @BATADV_UNICAST_FRAG: unicast packets carrying a fragment of the original
@@ -45,6 +56,8 @@ enum batadv_packettype {
 	BATADV_IV_OGM           = 0x00,
 	BATADV_BCAST            = 0x01,
 	BATADV_CODED            = 0x02,
+	BATADV_ELP		= 0x03,
+	BATADV_OGM2		= 0x04,
 	/* 0x40 - 0x7f: unicast */
 #define BATADV_UNICAST_MIN     0x40
 	BATADV_UNICAST          = 0x40,
@@ -199,6 +212,30 @@ struct batadv_ogm_packet {
 
 #define BATADV_OGM_HLEN sizeof(struct batadv_ogm_packet)
 
+/**
+ * struct batadv_ogm2_packet - ogm2 (routing protocol) packet
+ * @packet_type: batman-adv packet type, part of the general header
+ * @version: batman-adv protocol version, part of the general header
+ * @ttl: time to live for this packet, part of the general header
+ * @flags: reseved for routing relevant flags - currently always 0
+ * @seqno: sequence number
+ * @orig: originator mac address
+ * @tvlv_len: length of the appended tvlv buffer (in bytes)
+ * @throughput: the currently flooded path throughput
+ */
+struct batadv_ogm2_packet {
+	uint8_t  packet_type;
+	uint8_t  version;
+	uint8_t  ttl;
+	uint8_t  flags;
+	__be32   seqno;
+	uint8_t  orig[ETH_ALEN];
+	__be16   tvlv_len;
+	__be32   throughput;
+} __attribute__((packed));
+
+#define BATADV_OGM2_HLEN sizeof(struct batadv_ogm2_packet)
+
 /**
  * batadv_icmp_header - common members among all the ICMP packets
  * @packet_type: batman-adv packet type, part of the general header
@@ -512,4 +549,4 @@ struct batadv_tvlv_roam_adv {
 	__be16 vid;
 };
 
-#endif /* _NET_BATMAN_ADV_PACKET_H_ */
+#endif /* _BATMAN_ADV_PACKET_15_H_ */
@@ -0,0 +1,593 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * horst-bench-parse: microbenchmark of parse_packet() on a generated corpus
+ * of typical frames. For every frame class the parser is run once for each
+ * parse depth, so the difference between two depths is the cost of one
+ * layer. Cycles are TSC cycles and only available on x86.
+ *
+ * Then compiled filter expressions are compared with the hardcoded checks
+ * of packet_is_filtered() for the equivalent filter options, on the parsed
+ * corpus. Expressions do not replace these checks but run after them, and
+ * are still slower than the inlined C.
+ *
+ * usage: horst-bench-parse [-n iterations] [-j]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdarg.h>
+#include <net/if_arp.h>
+#include <sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "protocol_parser.h"
+#include "filter_expr.h"
+
+/* what the parser modules need from main.c */
+struct config conf;
+struct timespec time_mono;
+
+/* debug output of DEBUG=1 builds would only measure printf */
+void __attribute__ ((format (printf, 2, 3)))
+log_out(enum loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level == LL_DEBUG)
+		return;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+#define CORPUS_FRAME_LEN		256
+#define NUM_DEPTHS		(PARSE_ALL + 1)
+#define BENCH_ROUNDS		5
+
+static const char* depth_names[NUM_DEPTHS] = { "wlan", "llc", "ip", "proto" };
+
+struct frame_class {
+	const char*	name;
+	unsigned char	buf[CORPUS_FRAME_LEN];
+	size_t		len;
+	double		ns[NUM_DEPTHS];		/* per frame, up to this depth */
+	double		cycles[NUM_DEPTHS];
+};
+
+static const unsigned char mac_a[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const unsigned char mac_b[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+static const unsigned char mac_bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+/* keeps the compiler from optimizing the parser away */
+static volatile unsigned int sink;
+
+/* receive time for the originator tables */
+static const struct timespec frame_ts = { 1, 0 };
+
+static unsigned char* put(unsigned char* p, const void* data, size_t len)
+{
+	memcpy(p, data, len);
+	return p + len;
+}
+
+static unsigned char* put16be(unsigned char* p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+	return p + 2;
+}
+
+static unsigned char* put32be(unsigned char* p, uint32_t v)
+{
+	p = put16be(p, v >> 16);
+	return put16be(p, v & 0xffff);
+}
+
+/* radiotap with flags, rate, channel 6 and signal */
+static unsigned char* radiotap(unsigned char* p, bool badfcs)
+{
+	static const unsigned char rt[] = {
+		0x00, 0x00, 15, 0x00,		/* version, pad, length */
+		0x2e, 0x00, 0x00, 0x00,		/* FLAGS RATE CHANNEL DBM_ANTSIGNAL */
+		0x00,				/* flags */
+		0x0c,				/* 6 Mbps */
+		0x85, 0x09, 0xc0, 0x00,		/* 2437 MHz, 2GHz OFDM */
+		0xc4,				/* -60 dBm */
+	};
+
+	memcpy(p, rt, sizeof(rt));
+	if (badfcs)
+		p[8] = 0x10 | 0x40;		/* FCS at end, bad FCS */
+	return p + sizeof(rt);
+}
+
+static unsigned char* wlan_hdr(unsigned char* p, uint8_t fc0, uint8_t fc1,
+			       const unsigned char* a1, const unsigned char* a2,
+			       const unsigned char* a3)
+{
+	*p++ = fc0;
+	*p++ = fc1;
+	p = put16be(p, 0x2c00);			/* duration */
+	p = put(p, a1, 6);
+	p = put(p, a2, 6);
+	p = put(p, a3, 6);
+	return put16be(p, 0x1000);		/* sequence */
+}
+
+static unsigned char* llc(unsigned char* p, uint16_t ethertype)
+{
+	static const unsigned char snap[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00 };
+
+	p = put(p, snap, sizeof(snap));
+	return put16be(p, ethertype);
+}
+
+static size_t make_beacon(unsigned char* b)
+{
+	static const unsigned char ies[] = {
+		0x00, 8, 'b', 'e', 'n', 'c', 'h', 'n', 'e', 't',
+		0x01, 8, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24,
+		0x03, 1, 6,
+		0x05, 4, 0x00, 0x01, 0x00, 0x00,
+		0x30, 20, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00,
+			  0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f,
+			  0xac, 0x02, 0x00, 0x00,
+	};
+	unsigned char* p = radiotap(b, false);
+
+	p = wlan_hdr(p, 0x80, 0x00, mac_bcast, mac_a, mac_a);
+	memset(p, 0, 8);			/* TSF */
+	p += 8;
+	*p++ = 100;				/* beacon interval */
+	*p++ = 0;
+	*p++ = 0x31;				/* ESS, privacy, short preamble */
+	*p++ = 0x04;
+	p = put(p, ies, sizeof(ies));
+	return p - b;
+}
+
+/* QoS data, IP/UDP to port 698 with an OLSR HELLO of two neighbours */
+static size_t make_olsr(unsigned char* b)
+{
+	unsigned char* p = radiotap(b, false);
+	unsigned char* ip;
+
+	p = wlan_hdr(p, 0x88, 0x00, mac_bcast, mac_a, mac_a);
+	*p++ = 0x00;				/* QoS control */
+	*p++ = 0x00;
+	p = llc(p, 0x0800);
+
+	ip = p;
+	memset(p, 0, 20);
+	p[0] = 0x45;
+	p[8] = 1;				/* TTL */
+	p[9] = 17;				/* UDP */
+	put32be(p + 12, 0x0a000001);		/* 10.0.0.1 */
+	put32be(p + 16, 0xffffffff);
+	p += 20;
+
+	p = put16be(p, 698);			/* UDP */
+	p = put16be(p, 698);
+	p = put16be(p, 8 + 4 + 12 + 4 + 12);
+	p = put16be(p, 0);
+
+	p = put16be(p, 4 + 12 + 4 + 12);	/* OLSR packet header */
+	p = put16be(p, 1);
+	*p++ = 1;				/* HELLO message */
+	*p++ = 0x86;
+	p = put16be(p, 12 + 4 + 12);
+	p = put32be(p, 0x0a000001);
+	*p++ = 1;
+	*p++ = 0;
+	p = put16be(p, 1);
+	p = put16be(p, 0);			/* HELLO */
+	*p++ = 0x05;
+	*p++ = 3;
+	*p++ = 0x06;				/* link block, symmetric */
+	*p++ = 0;
+	p = put16be(p, 12);
+	p = put32be(p, 0x0a000002);
+	p = put32be(p, 0x0a000003);
+
+	put16be(ip + 2, p - ip);
+	return p - b;
+}
+
+/* data, batman-adv v15 OGM with a gateway TVLV */
+static size_t make_batman(unsigned char* b)
+{
+	unsigned char* p = radiotap(b, false);
+
+	p = wlan_hdr(p, 0x08, 0x00, mac_bcast, mac_a, mac_a);
+	p = llc(p, 0x4305);
+
+	*p++ = 0x00;				/* BATADV_IV_OGM */
+	*p++ = 15;
+	*p++ = 50;				/* TTL */
+	*p++ = 0;
+	p = put32be(p, 1234);			/* seqno */
+	p = put(p, mac_a, 6);			/* orig */
+	p = put(p, mac_a, 6);			/* prev_sender */
+	*p++ = 0;
+	*p++ = 255;				/* TQ */
+	p = put16be(p, 12);			/* TVLV length */
+
+	*p++ = 0x01;				/* BATADV_TVLV_GW */
+	*p++ = 1;
+	p = put16be(p, 8);
+	p = put32be(p, 100);			/* 10 Mbit/s */
+	p = put32be(p, 20);
+	return p - b;
+}
+
+static size_t make_ctrl(unsigned char* b, uint8_t fc0)
+{
+	unsigned char* p = radiotap(b, false);
+
+	*p++ = fc0;
+	*p++ = 0x00;
+	p = put16be(p, 0);
+	p = put(p, mac_b, 6);
+	return p - b;
+}
+
+/* QoS data with a bad FCS, only the PHY info is used */
+static size_t make_badfcs(unsigned char* b)
+{
+	unsigned char* p = radiotap(b, true);
+
+	p = wlan_hdr(p, 0x88, 0x01, mac_b, mac_a, mac_b);
+	*p++ = 0x00;
+	*p++ = 0x00;
+	p = llc(p, 0x0800);
+	memset(p, 0x5a, 40);
+	p += 40;
+	memset(p, 0, 4);			/* FCS */
+	return p + 4 - b;
+}
+
+static struct frame_class classes[] = {
+	{ .name = "beacon" },
+	{ .name = "qos-olsr" },
+	{ .name = "batman-ogm" },
+	{ .name = "ack" },
+	{ .name = "cts" },
+	{ .name = "badfcs" },
+};
+
+#define NUM_CLASSES	(sizeof(classes) / sizeof(classes[0]))
+
+/* filter_packet=BEACON,QDATA */
+static bool hc_stype(const struct uwifi_packet* p)
+{
+	static const uint16_t stype[WLAN_NUM_TYPES] = {
+		BIT(WLAN_FRAME_STYPE(WLAN_FRAME_BEACON)), 0,
+		BIT(WLAN_FRAME_STYPE(WLAN_FRAME_QDATA))
+	};
+	int i = WLAN_FRAME_TYPE(p->wlan_type);
+
+	return i != 3 && (stype[i] & BIT(WLAN_FRAME_STYPE(p->wlan_type)));
+}
+
+/* filter_mode=AP,STA */
+static bool hc_mode(const struct uwifi_packet* p)
+{
+	unsigned int mode = WLAN_MODE_AP | WLAN_MODE_STA;
+
+	return !((p->wlan_mode & ~mode) || p->wlan_mode == 0);
+}
+
+/* filter_bssid */
+static bool hc_bssid(const struct uwifi_packet* p)
+{
+	return memcmp(p->wlan_bssid, mac_a, WLAN_MAC_LEN) == 0;
+}
+
+/* what the options can not express, written out in C */
+static bool hc_combined(const struct uwifi_packet* p)
+{
+	return (p->wlan_type == WLAN_FRAME_QDATA &&
+		memcmp(p->wlan_bssid, mac_a, WLAN_MAC_LEN) == 0 &&
+		p->phy_signal > -70) || p->wlan_type == WLAN_FRAME_DEAUTH;
+}
+
+struct filter_case {
+	const char*	expr;
+	bool		(*hardcoded)(const struct uwifi_packet* p);
+	double		ns;		/* per packet */
+	double		hc_ns;
+};
+
+/* modes are single bits, so "ap or sta" is the same as filter_mode */
+static struct filter_case filters[] = {
+	{ .expr = "beacon or qdata", .hardcoded = hc_stype },
+	{ .expr = "ap or sta", .hardcoded = hc_mode },
+	{ .expr = "bssid == 02:00:00:00:00:01", .hardcoded = hc_bssid },
+	{ .expr = "(qdata and bssid == 02:00:00:00:00:01 and signal > -70) or deauth",
+	  .hardcoded = hc_combined },
+};
+
+#define NUM_FILTERS	(sizeof(filters) / sizeof(filters[0]))
+
+static void corpus_init(void)
+{
+	classes[0].len = make_beacon(classes[0].buf);
+	classes[1].len = make_olsr(classes[1].buf);
+	classes[2].len = make_batman(classes[2].buf);
+	classes[3].len = make_ctrl(classes[3].buf, 0xd4);
+	classes[4].len = make_ctrl(classes[4].buf, 0xc4);
+	classes[5].len = make_badfcs(classes[5].buf);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void parse_one(unsigned char* buf, size_t len)
+{
+	struct uwifi_packet p;
+
+	memset(&p, 0, sizeof(p));
+	parse_packet(buf, len, &p, ARPHRD_IEEE80211_RADIOTAP, &frame_ts);
+	sink += p.pkt_types + p.wlan_type;
+}
+
+/* best of a few rounds, to filter out interrupts and other noise */
+static void bench_class(struct frame_class* c, unsigned long n)
+{
+	unsigned long per_round = n / BENCH_ROUNDS + 1;
+	double t, ns;
+	uint64_t cy;
+
+	for (int d = 0; d < NUM_DEPTHS; d++) {
+		parse_set_depth(d);
+
+		/* warm up caches and the branch predictor */
+		for (unsigned long i = 0; i < per_round / 10; i++)
+			parse_one(c->buf, c->len);
+
+		c->ns[d] = 0;
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			t = now_ns();
+			cy = cycles();
+			for (unsigned long i = 0; i < per_round; i++)
+				parse_one(c->buf, c->len);
+			cy = cycles() - cy;
+			ns = (now_ns() - t) / per_round;
+			if (c->ns[d] == 0 || ns < c->ns[d]) {
+				c->ns[d] = ns;
+				c->cycles[d] = (double)cy / per_round;
+			}
+		}
+	}
+}
+
+/* all classes mixed, with full parsing */
+static double bench_mix(unsigned long n)
+{
+	double t;
+
+	parse_set_depth(PARSE_ALL);
+	t = now_ns();
+	for (unsigned long i = 0; i < n; i++)
+		for (unsigned int j = 0; j < NUM_CLASSES; j++)
+			parse_one(classes[j].buf, classes[j].len);
+	return n * NUM_CLASSES / ((now_ns() - t) / 1e9);
+}
+
+/* per packet, best of a few rounds over the parsed corpus */
+static double bench_filter_run(const struct fexpr_prog* prog,
+			       bool (*check)(const struct uwifi_packet* p),
+			       const struct uwifi_packet* pkts, unsigned long n)
+{
+	unsigned long per_round = n / BENCH_ROUNDS + 1;
+	unsigned int match;
+	double t, ns, best = 0;
+
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		match = 0;
+		t = now_ns();
+		for (unsigned long i = 0; i < per_round; i++)
+			for (unsigned int j = 0; j < NUM_CLASSES; j++)
+				match += prog ? fexpr_run(prog, &pkts[j]) : check(&pkts[j]);
+		ns = (now_ns() - t) / per_round / NUM_CLASSES;
+		if (best == 0 || ns < best)
+			best = ns;
+		sink += match;
+	}
+	return best;
+}
+
+static bool bench_filters(unsigned long n)
+{
+	struct uwifi_packet pkts[NUM_CLASSES];
+	struct fexpr_prog* prog;
+	struct filter_case* f;
+
+	parse_set_depth(PARSE_ALL);
+	for (unsigned int j = 0; j < NUM_CLASSES; j++) {
+		memset(&pkts[j], 0, sizeof(struct uwifi_packet));
+		parse_packet(classes[j].buf, classes[j].len, &pkts[j],
+			     ARPHRD_IEEE80211_RADIOTAP, &frame_ts);
+	}
+
+	for (unsigned int i = 0; i < NUM_FILTERS; i++) {
+		f = &filters[i];
+		prog = fexpr_compile(f->expr);
+		if (prog == NULL)
+			return false;
+
+		/* both have to agree, or the numbers mean nothing */
+		for (unsigned int j = 0; j < NUM_CLASSES; j++) {
+			if (fexpr_run(prog, &pkts[j]) != f->hardcoded(&pkts[j])) {
+				fprintf(stderr, "'%s' differs on %s\n", f->expr,
+					classes[j].name);
+				free(prog);
+				return false;
+			}
+		}
+
+		f->ns = bench_filter_run(prog, NULL, pkts, n);
+		f->hc_ns = bench_filter_run(NULL, f->hardcoded, pkts, n);
+		free(prog);
+	}
+	return true;
+}
+
+/* cost of the layer itself, never negative because of noise */
+static double layer(const double* v, int d)
+{
+	double r = d == 0 ? v[0] : v[d] - v[d - 1];
+	return r > 0 ? r : 0;
+}
+
+static void print_table(double fps)
+{
+	struct frame_class* c;
+
+	printf("%-11s %5s %9s", "class", "bytes", "ns/frame");
+	for (int d = 0; d < NUM_DEPTHS; d++)
+		printf(" %8s", depth_names[d]);
+	printf("%s\n", HAVE_TSC ? "  (ns, cycles per layer)" : "  (ns per layer)");
+
+	for (unsigned int i = 0; i < NUM_CLASSES; i++) {
+		c = &classes[i];
+		printf("%-11s %5zu %9.1f", c->name, c->len, c->ns[PARSE_ALL]);
+		for (int d = 0; d < NUM_DEPTHS; d++)
+			printf(" %8.1f", layer(c->ns, d));
+		printf("\n");
+#if HAVE_TSC
+		printf("%-11s %5s %9.0f", "", "", c->cycles[PARSE_ALL]);
+		for (int d = 0; d < NUM_DEPTHS; d++)
+			printf(" %8.0f", layer(c->cycles, d));
+		printf("\n");
+#endif
+	}
+	printf("\nmixed: %.0f frames/s\n", fps);
+
+	printf("\n%-66s %6s %9s\n", "filter expression", "ns/pkt", "hardcoded");
+	for (unsigned int i = 0; i < NUM_FILTERS; i++)
+		printf("%-66s %6.2f %9.2f\n", filters[i].expr, filters[i].ns,
+		       filters[i].hc_ns);
+}
+
+static void print_json(double fps, unsigned long n)
+{
+	struct frame_class* c;
+	struct utsname u;
+
+	if (uname(&u) < 0)
+		strcpy(u.machine, "unknown");
+
+	printf("{\"version\":\"%s\",\"machine\":\"%s\",\"compiler\":\"%s\","
+	       "\"iterations\":%lu,\"frames_per_sec\":%.0f,\"classes\":[",
+	       VERSION, u.machine, __VERSION__, n, fps);
+
+	for (unsigned int i = 0; i < NUM_CLASSES; i++) {
+		c = &classes[i];
+		printf("%s{\"name\":\"%s\",\"bytes\":%zu,\"ns_per_frame\":%.1f,"
+		       "\"layers\":{", i ? "," : "", c->name, c->len,
+		       c->ns[PARSE_ALL]);
+		for (int d = 0; d < NUM_DEPTHS; d++) {
+			printf("%s\"%s\":{\"ns\":%.1f", d ? "," : "",
+			       depth_names[d], layer(c->ns, d));
+			if (HAVE_TSC)
+				printf(",\"cycles\":%.0f", layer(c->cycles, d));
+			else
+				printf(",\"cycles\":null");
+			printf("}");
+		}
+		printf("}}");
+	}
+
+	printf("],\"filters\":[");
+	for (unsigned int i = 0; i < NUM_FILTERS; i++)
+		printf("%s{\"expr\":\"%s\",\"ns\":%.2f,\"hardcoded_ns\":%.2f}",
+		       i ? "," : "", filters[i].expr, filters[i].ns,
+		       filters[i].hc_ns);
+	printf("]}\n");
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long n = 1000000;
+	bool json = false;
+	double fps;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:j")) != -1) {
+		switch (c) {
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			json = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-j]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (n == 0)
+		n = 1;
+
+	protocol_parser_init();
+	corpus_init();
+
+	for (unsigned int i = 0; i < NUM_CLASSES; i++)
+		bench_class(&classes[i], n);
+	fps = bench_mix(n / NUM_CLASSES + 1);
+	if (!bench_filters(n))
+		return 1;
+
+	if (json)
+		print_json(fps, n);
+	else
+		print_table(fps);
+	return 0;
+}
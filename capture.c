@@ -0,0 +1,488 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE	/* recvmmsg */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <net/if_arp.h>
+
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "capture.h"
+
+/*
+ * Memory mapped packet capture with a TPACKET_V3 PACKET_RX_RING.
+ *
+ * The kernel fills blocks of variable sized frames and hands a whole block
+ * over to us when it is full or when the block timeout expires. We then walk
+ * all frames of the block and pass them to the callback directly from the
+ * ring memory, so there is no syscall and no copy per frame.
+ *
+ * The ring memory is allocated by the kernel, so it can not be backed by
+ * hugetlbfs pages. Instead we use big blocks (the kernel allocates them as
+ * contiguous high-order pages) and prefault and lock the mapping.
+ */
+
+#define RING_BLOCK_SIZE_MAX	(1 << 20)	/* 1 MiB */
+#define RING_BLOCK_SIZE_MIN	(1 << 16)	/* 64 KiB */
+#define RING_FRAME_SIZE		2048		/* only used for accounting */
+
+struct capture_ring {
+	int			fd;
+	unsigned char*		map;
+	size_t			map_len;
+	struct iovec*		blocks;
+	unsigned int		block_nr;
+	unsigned int		block_cur;
+};
+
+static unsigned int ring_block_size(unsigned int size)
+{
+	unsigned int bs = RING_BLOCK_SIZE_MAX;
+
+	/* use smaller blocks for small rings, but have at least 4 of them */
+	while (bs > RING_BLOCK_SIZE_MIN && size / bs < 4)
+		bs >>= 1;
+	return bs;
+}
+
+static struct capture_ring* capture_ring_open(int fd, unsigned int size,
+				       unsigned int block_timeout)
+{
+	struct capture_ring* ring;
+	struct tpacket_req3 req;
+	int ver = TPACKET_V3;
+	unsigned int i;
+
+	ring = calloc(1, sizeof(struct capture_ring));
+	if (ring == NULL)
+		return NULL;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = ring_block_size(size);
+	req.tp_block_nr = size / req.tp_block_size;
+	if (req.tp_block_nr < 2)
+		req.tp_block_nr = 2;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_frame_nr = req.tp_block_size / req.tp_frame_size * req.tp_block_nr;
+	req.tp_retire_blk_tov = block_timeout;
+	req.tp_feature_req_word = 0;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0) {
+		LOG_ERR("Could not set TPACKET_V3 (%s)", strerror(errno));
+		goto err_free;
+	}
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		LOG_ERR("Could not set up RX ring (%s)", strerror(errno));
+		goto err_free;
+	}
+
+	ring->map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+	if (ring->map == MAP_FAILED) /* locking may be limited by RLIMIT_MEMLOCK */
+		ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (ring->map == MAP_FAILED) {
+		LOG_ERR("Could not mmap RX ring (%s)", strerror(errno));
+		goto err_ring;
+	}
+
+	ring->blocks = malloc(req.tp_block_nr * sizeof(struct iovec));
+	if (ring->blocks == NULL)
+		goto err_unmap;
+
+	for (i = 0; i < req.tp_block_nr; i++) {
+		ring->blocks[i].iov_base = ring->map + (i * req.tp_block_size);
+		ring->blocks[i].iov_len = req.tp_block_size;
+	}
+
+	ring->fd = fd;
+	ring->block_nr = req.tp_block_nr;
+	ring->block_cur = 0;
+
+	LOG_INF("Using RX ring of %u blocks of %u bytes (timeout %u ms)",
+		req.tp_block_nr, req.tp_block_size, block_timeout);
+	return ring;
+
+err_unmap:
+	munmap(ring->map, ring->map_len);
+err_ring:
+	/* without a ring the socket can be read normally again */
+	memset(&req, 0, sizeof(req));
+	setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+err_free:
+	free(ring);
+	return NULL;
+}
+
+/* process all blocks which are ready, returns the number of frames */
+static int capture_ring_receive(struct capture* c)
+{
+	struct capture_ring* ring = c->ring;
+	struct tpacket_block_desc* bd;
+	struct tpacket3_hdr* hdr;
+	struct timespec ts;
+	unsigned int i, num;
+	int count = 0;
+
+	for (;;) {
+		bd = ring->blocks[ring->block_cur].iov_base;
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE)
+		      & TP_STATUS_USER))
+			break;
+
+		num = bd->hdr.bh1.num_pkts;
+		hdr = (struct tpacket3_hdr*)((unsigned char*)bd +
+					     bd->hdr.bh1.offset_to_first_pkt);
+
+		for (i = 0; i < num; i++) {
+			ts.tv_sec = hdr->tp_sec;
+			ts.tv_nsec = hdr->tp_nsec;
+			c->frame_cb(c, (unsigned char*)hdr + hdr->tp_mac,
+				    hdr->tp_snaplen, hdr->tp_len, &ts);
+			hdr = (struct tpacket3_hdr*)((unsigned char*)hdr +
+						     hdr->tp_next_offset);
+		}
+		count += num;
+
+		/* give block back to the kernel */
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+				 __ATOMIC_RELEASE);
+		ring->block_cur = (ring->block_cur + 1) % ring->block_nr;
+	}
+	return count;
+}
+
+static void capture_ring_close(struct capture_ring* ring)
+{
+	if (ring == NULL)
+		return;
+
+	munmap(ring->map, ring->map_len);
+	free(ring->blocks);
+	free(ring);
+}
+
+/*
+ * Batched receive with recvmmsg(): get up to 'num' frames with one syscall
+ * into 'num' buffers of 'bufsize' each.
+ *
+ * The receive time of each frame comes from SO_TIMESTAMPNS. With snaplen the
+ * kernel only copies the start of the frame and returns the truncated length,
+ * so we ask for PACKET_AUXDATA to get the original length.
+ */
+
+#define BATCH_CMSG_LEN	(CMSG_SPACE(sizeof(struct timespec)) + \
+			 CMSG_SPACE(sizeof(struct tpacket_auxdata)))
+
+struct capture_batch {
+	unsigned int		num;
+	struct mmsghdr*		msgs;
+	struct iovec*		iovs;
+	unsigned char*		buf;
+	unsigned char*		cmsg;
+};
+
+static void capture_batch_free(struct capture_batch* b);
+
+static struct capture_batch* capture_batch_alloc(int fd, unsigned int num,
+						 size_t bufsize, bool auxdata)
+{
+	struct capture_batch* b;
+	unsigned int i;
+	int one = 1;
+
+	if (auxdata && setsockopt(fd, SOL_PACKET, PACKET_AUXDATA, &one,
+				  sizeof(one)) < 0) {
+		LOG_ERR("Could not enable PACKET_AUXDATA (%s)", strerror(errno));
+		return NULL;
+	}
+
+	/* not fatal, we use the current time then */
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0)
+		LOG_ERR("Could not enable SO_TIMESTAMPNS (%s)", strerror(errno));
+
+	b = calloc(1, sizeof(struct capture_batch));
+	if (b == NULL)
+		return NULL;
+
+	b->num = num;
+	b->msgs = calloc(num, sizeof(struct mmsghdr));
+	b->iovs = calloc(num, sizeof(struct iovec));
+	b->buf = malloc(num * bufsize);
+	b->cmsg = calloc(num, BATCH_CMSG_LEN);
+	if (b->msgs == NULL || b->iovs == NULL || b->buf == NULL ||
+	    b->cmsg == NULL) {
+		capture_batch_free(b);
+		return NULL;
+	}
+
+	for (i = 0; i < num; i++) {
+		b->iovs[i].iov_base = b->buf + i * bufsize;
+		b->iovs[i].iov_len = bufsize;
+		b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	return b;
+}
+
+/* get the original frame length and receive time from the control messages,
+ * returns the timestamp or NULL */
+static struct timespec* capture_batch_cmsg(struct msghdr* msg, size_t* len)
+{
+	struct cmsghdr* cmsg;
+	struct tpacket_auxdata* aux;
+	struct timespec* ts = NULL;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_PACKET &&
+		    cmsg->cmsg_type == PACKET_AUXDATA) {
+			aux = (struct tpacket_auxdata*)CMSG_DATA(cmsg);
+			*len = aux->tp_len;
+		} else if (cmsg->cmsg_level == SOL_SOCKET &&
+			   cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			ts = (struct timespec*)CMSG_DATA(cmsg);
+		}
+	}
+	return ts;
+}
+
+/* returns the number of frames received */
+static int capture_batch_receive(struct capture* c)
+{
+	struct capture_batch* b = c->batch;
+	struct timespec* ts;
+	unsigned int i;
+	size_t len;
+	int ret;
+
+	/* the kernel overwrites the control length */
+	for (i = 0; i < b->num; i++) {
+		b->msgs[i].msg_hdr.msg_control = b->cmsg + i * BATCH_CMSG_LEN;
+		b->msgs[i].msg_hdr.msg_controllen = BATCH_CMSG_LEN;
+	}
+
+	ret = recvmmsg(c->fd, b->msgs, b->num, MSG_DONTWAIT, NULL);
+	if (ret <= 0) {
+		LOG_DBG("recvmmsg error");
+		return 0;
+	}
+
+	for (i = 0; i < (unsigned int)ret; i++) {
+		len = b->msgs[i].msg_len;
+		ts = capture_batch_cmsg(&b->msgs[i].msg_hdr, &len);
+		c->frame_cb(c, b->iovs[i].iov_base, b->msgs[i].msg_len, len, ts);
+	}
+
+	return ret;
+}
+
+static void capture_batch_free(struct capture_batch* b)
+{
+	if (b == NULL)
+		return;
+
+	free(b->msgs);
+	free(b->iovs);
+	free(b->buf);
+	free(b->cmsg);
+	free(b);
+}
+
+/*
+ * Capture from a packet socket, using the RX ring or recvmmsg() batches,
+ * depending on configuration. A "batch" of one is used instead of plain recv()
+ * because we need the control messages.
+ */
+
+bool capture_open(struct capture* c, int fd, capture_frame_cb cb, void* priv)
+{
+	memset(c, 0, sizeof(struct capture));
+	c->fd = fd;
+	c->frame_cb = cb;
+	c->priv = priv;
+
+	if (conf.ring_size) {
+		c->ring = capture_ring_open(fd, conf.ring_size,
+					    conf.ring_block_timeout);
+		if (c->ring != NULL)
+			return true;
+		LOG_ERR("Falling back to normal packet receive");
+	}
+
+	c->batch = capture_batch_alloc(fd, conf.recv_batch, MAX_FRAME_LEN,
+				       conf.snaplen > 0);
+	return c->batch != NULL;
+}
+
+/* receive all available frames, returns the number of frames */
+int capture_receive(struct capture* c)
+{
+	if (c->ring != NULL)
+		return capture_ring_receive(c);
+
+	return capture_batch_receive(c);
+}
+
+void capture_close(struct capture* c)
+{
+	capture_thread_stop(c);
+	capture_ring_close(c->ring);
+	c->ring = NULL;
+	capture_batch_free(c->batch);
+	c->batch = NULL;
+}
+
+/*
+ * PACKET_FANOUT: several capture sockets on one interface, each served by its
+ * own capture thread. The kernel distributes the frames between them with a
+ * small BPF program which returns the last 4 bytes of the transmitter address
+ * (addr2), so all frames of one station end up in the same socket and are
+ * seen in order. Frames without addr2 (ACK, CTS) all go to the first socket.
+ */
+
+#ifndef PACKET_FANOUT_CBPF
+#define PACKET_FANOUT_CBPF	6
+#endif
+#ifndef PACKET_FANOUT_DATA
+#define PACKET_FANOUT_DATA	22
+#endif
+
+static struct sock_filter fanout_radiotap[] = {
+	/* X = radiotap header length (little endian) */
+	BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 3),
+	BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+	BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 2),
+	BPF_STMT(BPF_ALU | BPF_OR  | BPF_X, 0),
+	BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	/* A = addr2[2..5] */
+	BPF_STMT(BPF_LD  | BPF_W   | BPF_IND, 12),
+	BPF_STMT(BPF_RET | BPF_A, 0),
+};
+
+static struct sock_filter fanout_80211[] = {
+	BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, 12),
+	BPF_STMT(BPF_RET | BPF_A, 0),
+};
+
+bool capture_fanout_join(int fd, int group_id, int arphdr)
+{
+	struct sock_fprog prog;
+	int mode = PACKET_FANOUT_CBPF;
+	int val;
+
+	if (arphdr == ARPHRD_IEEE80211_RADIOTAP) {
+		prog.len = sizeof(fanout_radiotap) / sizeof(struct sock_filter);
+		prog.filter = fanout_radiotap;
+	} else if (arphdr == ARPHRD_IEEE80211) {
+		prog.len = sizeof(fanout_80211) / sizeof(struct sock_filter);
+		prog.filter = fanout_80211;
+	} else {
+		/* unknown header length, the flow hash is better than nothing */
+		mode = PACKET_FANOUT_HASH;
+	}
+
+	val = (group_id & 0xffff) | (mode << 16);
+	if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &val, sizeof(val)) < 0) {
+		LOG_ERR("Could not join fanout group (%s)", strerror(errno));
+		return false;
+	}
+
+	/* the program belongs to the group, setting it again is harmless */
+	if (mode == PACKET_FANOUT_CBPF &&
+	    setsockopt(fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog)) < 0) {
+		LOG_ERR("Could not set fanout program (%s)", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Capture thread: receives and parses frames independently of the main
+ * thread, so that a slow display or network connection does not delay reading
+ * from the socket and cause kernel drops.
+ */
+
+#define CAPTURE_POLL_TIMEOUT	100	/* ms, to check for exit */
+
+static void* capture_thread_main(void* arg)
+{
+	struct capture* c = arg;
+	struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+	int ret;
+
+	while (c->thread_running) {
+		ret = poll(&pfd, 1, CAPTURE_POLL_TIMEOUT);
+		if (ret < 0 && errno != EINTR) {
+			LOG_ERR("Capture thread poll error (%s)", strerror(errno));
+			break;
+		}
+		if (ret <= 0)
+			continue;
+
+		ret = capture_receive(c);
+		if (c->done_cb != NULL && ret > 0)
+			c->done_cb(c, ret);
+	}
+	return NULL;
+}
+
+bool capture_thread_start(struct capture* c, capture_done_cb done)
+{
+	sigset_t mask, oldmask;
+	int ret;
+
+	c->done_cb = done;
+	c->thread_running = true;
+
+	/* signals are handled by the main thread only */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+	ret = pthread_create(&c->thread, NULL, capture_thread_main, c);
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (ret != 0) {
+		LOG_ERR("Could not start capture thread (%s)", strerror(ret));
+		c->thread_running = false;
+		return false;
+	}
+	return true;
+}
+
+void capture_thread_stop(struct capture* c)
+{
+	if (!c->thread_running)
+		return;
+
+	c->thread_running = false;
+	pthread_join(c->thread, NULL);
+}
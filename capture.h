@@ -0,0 +1,66 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+
+struct capture;
+struct capture_ring;
+struct capture_batch;
+
+/* called for every received frame, with the ring buf points directly into
+ * the mapped ring memory. 'orig_len' is the length of the frame on the air,
+ * which is more than 'len' when it was truncated (snaplen). 'ts' is the
+ * receive time from the kernel (CLOCK_REALTIME) or NULL if not available */
+typedef void (*capture_frame_cb)(struct capture* c, unsigned char* buf,
+				 size_t len, size_t orig_len,
+				 const struct timespec* ts);
+
+/* called by the capture thread after each batch of frames */
+typedef void (*capture_done_cb)(struct capture* c, int count);
+
+struct capture {
+	int			fd;
+	struct capture_ring*	ring;
+	struct capture_batch*	batch;
+
+	capture_frame_cb	frame_cb;
+	capture_done_cb		done_cb;
+	void*			priv;
+
+	/* capture thread */
+	pthread_t		thread;
+	volatile bool		thread_running;
+};
+
+bool capture_open(struct capture* c, int fd, capture_frame_cb cb, void* priv);
+int capture_receive(struct capture* c);
+void capture_close(struct capture* c);
+
+bool capture_fanout_join(int fd, int group_id, int arphdr);
+
+bool capture_thread_start(struct capture* c, capture_done_cb done);
+void capture_thread_stop(struct capture* c);
+
+#endif
@@ -29,6 +29,13 @@
 #include "main.h"
 #include "hutil.h"
 #include "control.h"
+#include "pcap_writer.h"
+#include "outfile.h"
+#include "outfile_query.h"
+#include "analyze.h"
+#include "protocol_parser.h"
+#include "macfilter.h"
+#include "filter_expr.h"
 #include "conf_options.h"
 
 struct conf_option {
@@ -51,12 +58,64 @@ static bool conf_debug(__attribute__((unused)) const char* value) {
 }
 #endif
 
-static bool conf_interface(const char* value) {
-	strncpy(conf.intf.ifname, value, IF_NAMESIZE);
-	conf.intf.ifname[IF_NAMESIZE] = '\0';
+/* interfaces from a later source (config file, command line) replace the
+ * earlier ones instead of adding to them */
+static bool intf_list_reset;
+
+/* interfaces are only opened at startup, so they can not be added later */
+static bool intf_list_final;
+
+/* each setting of filter_mac_addr replaces the previous one */
+static bool mac_addr_reset = true;
+
+static bool intf_add(const char* name, size_t len) {
+	struct uwifi_interface* intf;
+
+	if (conf.num_intf >= MAX_INTERFACES) {
+		LOG_ERR("Max %d interfaces, ignoring '%.*s'", MAX_INTERFACES,
+			(int)len, name);
+		return false;
+	}
+
+	intf = get_intf(conf.num_intf++);
+	len = MIN(len, IF_NAMESIZE);
+	memcpy(intf->ifname, name, len);
+	intf->ifname[len] = '\0';
 	return true;
 }
 
+/* a list like wlan0,wlan1 adds all of them, also when the value does not
+ * come through config_handle_option() */
+static bool conf_interface(const char* value) {
+	const char* end;
+	bool ret = true;
+
+	if (value == NULL)
+		return false;
+
+	if (intf_list_final) {
+		LOG_ERR("Interfaces can not be changed at runtime");
+		return false;
+	}
+
+	if (intf_list_reset) {
+		conf.num_intf = 0;
+		intf_list_reset = false;
+	}
+
+	for (;;) {
+		end = strchr(value, ',');
+		if (end == NULL)
+			break;
+		if (end > value)
+			ret = intf_add(value, end - value) && ret;
+		value = end + 1;
+	}
+	if (*value != '\0')
+		ret = intf_add(value, strlen(value)) && ret;
+	return ret;
+}
+
 static bool conf_add_monitor(const char* value) {
 	if (value != NULL && strcmp(value, "0") == 0)
 		conf.add_monitor = 0;
@@ -67,7 +126,100 @@ static bool conf_add_monitor(const char* value) {
 }
 
 static bool conf_outfile(const char* value) {
-	dumpfile_open(value);
+	outfile_open(value);
+	return true;
+}
+
+static bool conf_outfile_format(const char* value) {
+	if (strcmp(value, "csv") == 0)
+		conf.outfile_format = OUTFILE_CSV;
+	else if (strcmp(value, "binary") == 0)
+		conf.outfile_format = OUTFILE_BINARY;
+	else if (strcmp(value, "json") == 0)
+		conf.outfile_format = OUTFILE_JSON;
+	else {
+		LOG_ERR("Unknown outfile format '%s'", value);
+		return false;
+	}
+	/* an already open outfile is re-opened in the new format */
+	if (conf.dumpfile[0] != '\0')
+		outfile_open(conf.dumpfile);
+	return true;
+}
+
+static bool conf_outfile_buffer(const char* value) {
+	conf.outfile_buffer = MAX(atoi(value), OUTFILE_BUFFER_MIN);
+	if (conf.dumpfile[0] != '\0')
+		outfile_open(conf.dumpfile);
+	return true;
+}
+
+/* one hour, the timer takes microseconds in 32 bit */
+#define OUTFILE_FLUSH_MAX	(3600 * 1000)
+
+static bool conf_outfile_flush(const char* value) {
+	conf.outfile_flush = MIN(MAX(atoi(value), 10), OUTFILE_FLUSH_MAX);
+	return true;
+}
+
+static bool conf_outfile_policy(const char* value) {
+	if (strcmp(value, "block") == 0)
+		conf.outfile_policy = OUTFILE_POLICY_BLOCK;
+	else if (strcmp(value, "drop") == 0)
+		conf.outfile_policy = OUTFILE_POLICY_DROP;
+	else if (strcmp(value, "count") == 0)
+		conf.outfile_policy = OUTFILE_POLICY_COUNT;
+	else {
+		LOG_ERR("Unknown outfile policy '%s'", value);
+		return false;
+	}
+	return true;
+}
+
+static bool conf_outfile_rotate_size(const char* value) {
+	conf.outfile_rotate_size = atoi(value);
+	return true;
+}
+
+static bool conf_outfile_rotate_time(const char* value) {
+	conf.outfile_rotate_time = atoi(value);
+	return true;
+}
+
+static bool conf_outfile_rotate_files(const char* value) {
+	conf.outfile_rotate_files = atoi(value);
+	return true;
+}
+
+static bool conf_outfile_compress(const char* value) {
+	conf.outfile_compress = MIN(MAX(atoi(value), 0), 9);
+#if !HAVE_ZLIB
+	if (conf.outfile_compress > 0) {
+		LOG_ERR("Outfile compression needs horst built with ZLIB=1");
+		conf.outfile_compress = 0;
+		return false;
+	}
+#endif
+	return true;
+}
+
+static bool conf_pcapfile(const char* value) {
+	pcap_writer_open(value);
+	return true;
+}
+
+static bool conf_pcap_rotate_size(const char* value) {
+	conf.pcap_rotate_size = atoi(value);
+	return true;
+}
+
+static bool conf_pcap_rotate_time(const char* value) {
+	conf.pcap_rotate_time = atoi(value);
+	return true;
+}
+
+static bool conf_pcap_rotate_files(const char* value) {
+	conf.pcap_rotate_files = atoi(value);
 	return true;
 }
 
@@ -76,11 +228,79 @@ static bool conf_node_timeout(const char* value) {
 	return true;
 }
 
+/* about 300 MB, and the hash table size in link_alloc() can not overflow */
+#define LINK_MAX_LIMIT	(1024 * 1024)
+
+static bool conf_link_max(const char* value) {
+	int n = atoi(value);
+
+	if (n < 0) {
+		LOG_ERR("Invalid link_max '%s'", value);
+		return false;
+	}
+	conf.link_max = MIN(n, LINK_MAX_LIMIT);
+	return true;
+}
+
 static bool conf_receive_buffer(const char* value) {
 	conf.recv_buffer_size = atoi(value);
 	return true;
 }
 
+static bool conf_ring_size(const char* value) {
+	conf.ring_size = atoi(value);
+	return true;
+}
+
+static bool conf_ring_block_timeout(const char* value) {
+	conf.ring_block_timeout = atoi(value);
+	return true;
+}
+
+/* the batch buffers are RECV_BATCH_MAX * MAX_FRAME_LEN, about 2.5 MB */
+#define RECV_BATCH_MAX	1024
+
+static bool conf_recv_batch(const char* value) {
+	conf.recv_batch = MIN(MAX(atoi(value), 1), RECV_BATCH_MAX);
+	return true;
+}
+
+/* we need at least the 802.11, LLC, IP and UDP headers and the start of
+ * OLSR and BATMAN packets */
+#define SNAPLEN_MIN	128
+
+static bool conf_snaplen(const char* value) {
+	conf.snaplen = atoi(value);
+	if (conf.snaplen > 0 && conf.snaplen < SNAPLEN_MIN)
+		conf.snaplen = SNAPLEN_MIN;
+	return true;
+}
+
+static bool conf_capture_thread(__attribute__((unused)) const char* value) {
+	conf.capture_thread = 1;
+	return true;
+}
+
+/* each entry holds a parsed packet of a few hundred bytes */
+#define QUEUE_SIZE_MAX	(256 * 1024)
+
+static bool conf_queue_size(const char* value) {
+	conf.queue_size = MIN(MAX(atoi(value), 16), QUEUE_SIZE_MAX);
+	return true;
+}
+
+static bool conf_capture_workers(const char* value) {
+	conf.capture_workers = atoi(value);
+	if (conf.capture_workers < 1)
+		conf.capture_workers = 1;
+	else if (conf.capture_workers > MAX_WORKERS)
+		conf.capture_workers = MAX_WORKERS;
+	/* workers hand packets over to the main thread with queues */
+	if (conf.capture_workers > 1)
+		conf.capture_thread = 1;
+	return true;
+}
+
 static bool conf_channel_set(const char* value) {
 	bool ht40plus = false;
 	enum uwifi_chan_width width = CHAN_WIDTH_20_NOHT;
@@ -159,6 +379,8 @@ static bool conf_display_view(const char* value) {
 		conf.display_view = 'a';
 	else if (strcasecmp(value, "spectrum") == 0 || strcasecmp(value, "spec") == 0)
 		conf.display_view = 's';
+	else if (strcasecmp(value, "links") == 0)
+		conf.display_view = 'l';
 	return true;
 }
 
@@ -176,6 +398,65 @@ static bool conf_client(const char* value) {
 	return true;
 }
 
+static bool conf_readfile(const char* value) {
+	strncpy(conf.readfile, value, MAX_CONF_VALUE_STRLEN);
+	conf.readfile[MAX_CONF_VALUE_STRLEN] = '\0';
+	return true;
+}
+
+static bool conf_query(const char* value) {
+	conf.query = 1;
+	return outfile_query_add(value);
+}
+
+static bool conf_analyze(const char* value) {
+	conf.analyze = 1;
+	return analyze_add_file(value);
+}
+
+static bool conf_analyze_threads(const char* value) {
+	conf.analyze_threads = atoi(value);
+	return true;
+}
+
+static bool conf_analyze_format(const char* value) {
+	if (strcmp(value, "table") == 0)
+		conf.analyze_format = ANALYZE_TABLE;
+	else if (strcmp(value, "json") == 0)
+		conf.analyze_format = ANALYZE_JSON;
+	else {
+		LOG_ERR("Unknown analyze format '%s'", value);
+		return false;
+	}
+	return true;
+}
+
+static bool conf_dissector_udp(const char* value) {
+	return dissector_register_custom(value, true);
+}
+
+static bool conf_dissector_ether(const char* value) {
+	return dissector_register_custom(value, false);
+}
+
+static bool conf_dissector_enable(const char* value) {
+	return dissector_enable(value, true);
+}
+
+static bool conf_dissector_disable(const char* value) {
+	return dissector_enable(value, false);
+}
+
+static bool conf_replay_speed(const char* value) {
+	if (strcmp(value, "max") == 0)
+		conf.replay_speed = 0;
+	else
+		conf.replay_speed = atof(value);
+	if (conf.replay_speed < 0)
+		conf.replay_speed = 0;
+	return true;
+}
+
 static bool conf_port(const char* value) {
 	conf.port = atoi(value);
 	return true;
@@ -206,10 +487,40 @@ static bool conf_filter_mac(const char* value) {
 		return false;
 	}
 
-	conf.do_macfilter = 1;
 	convert_string_to_mac(value, conf.filtermac[n]);
 	conf.filtermac_enabled[n] = 1;
 	n++;
+	macfilter_update();
+	return true;
+}
+
+static bool conf_filter_mac_allow(const char* value) {
+	strncpy(conf.filter_mac_allow, value, MAX_CONF_VALUE_STRLEN);
+	conf.filter_mac_allow[MAX_CONF_VALUE_STRLEN] = '\0';
+	return macfilter_load(false, conf.filter_mac_allow);
+}
+
+static bool conf_filter_mac_deny(const char* value) {
+	strncpy(conf.filter_mac_deny, value, MAX_CONF_VALUE_STRLEN);
+	conf.filter_mac_deny[MAX_CONF_VALUE_STRLEN] = '\0';
+	return macfilter_load(true, conf.filter_mac_deny);
+}
+
+static bool conf_filter_mac_addr(const char* value) {
+	if (mac_addr_reset) {
+		conf.filter_mac_addr = 0;
+		mac_addr_reset = false;
+	}
+	if (strcmp(value, "src") == 0)
+		conf.filter_mac_addr |= MACFILTER_SRC;
+	else if (strcmp(value, "dst") == 0)
+		conf.filter_mac_addr |= MACFILTER_DST;
+	else if (strcmp(value, "bssid") == 0)
+		conf.filter_mac_addr |= MACFILTER_BSSID;
+	else {
+		LOG_ERR("Unknown MAC filter address '%s'", value);
+		return false;
+	}
 	return true;
 }
 
@@ -277,6 +588,8 @@ static bool conf_filter_pkt(const char* value) {
 		conf.filter_pkt |= PKT_TYPE_BATMAN;
 	else if (strcmp(value, "MESHZ") == 0)
 		conf.filter_pkt |= PKT_TYPE_MESHZ;
+	else if (dissector_pkt_type(value) & PKT_TYPE_CUSTOM)
+		conf.filter_pkt |= dissector_pkt_type(value) & PKT_TYPE_CUSTOM;
 
 	for (t = 0; t < WLAN_NUM_TYPES; t++) {
 		for (i = 0; i < WLAN_NUM_STYPES; i++) {
@@ -289,6 +602,14 @@ static bool conf_filter_pkt(const char* value) {
 	return true;
 }
 
+static bool conf_filter_expr(const char* value) {
+	if (!filter_expr_set(value))
+		return false;
+	strncpy(conf.filter_expr, value != NULL ? value : "", MAX_CONF_VALUE_STRLEN);
+	conf.filter_expr[MAX_CONF_VALUE_STRLEN] = '\0';
+	return true;
+}
+
 static bool conf_mac_names(const char* value) {
 	if (value != NULL)
 		strncpy(conf.mac_name_file, value, MAX_CONF_VALUE_STRLEN);
@@ -310,8 +631,28 @@ static struct conf_option conf_options[] = {
 	{ 'd', "display_interval",	1, "100", 	conf_display_interval },
 	{ 'V', "display_view",		1, NULL, 	conf_display_view },
 	{ 'o', "outfile", 		1, NULL,	conf_outfile },
+	{  0 , "outfile_format",	1, "csv",	conf_outfile_format },
+	{  0 , "outfile_buffer",	1, "1048576",	conf_outfile_buffer },
+	{  0 , "outfile_flush",		1, "1000",	conf_outfile_flush },
+	{  0 , "outfile_policy",	1, "block",	conf_outfile_policy },
+	{  0 , "outfile_rotate_size",	1, "0",		conf_outfile_rotate_size },
+	{  0 , "outfile_rotate_time",	1, "0",		conf_outfile_rotate_time },
+	{  0 , "outfile_rotate_files",	1, "0",		conf_outfile_rotate_files },
+	{  0 , "outfile_compress",	1, "0",		conf_outfile_compress },
+	{ 'w', "pcapfile",		1, NULL,	conf_pcapfile },
+	{  0 , "pcap_rotate_size",	1, "0",		conf_pcap_rotate_size },
+	{  0 , "pcap_rotate_time",	1, "0",		conf_pcap_rotate_time },
+	{  0 , "pcap_rotate_files",	1, "0",		conf_pcap_rotate_files },
 	{ 't', "node_timeout", 		1, "60",	conf_node_timeout },
+	{  0 , "link_max",		1, "1024",	conf_link_max },	// NOT dynamic
 	{ 'b', "receive_buffer",	1, NULL,	conf_receive_buffer },	// NOT dynamic
+	{  0 , "ring_size",		1, NULL,	conf_ring_size },	// NOT dynamic
+	{  0 , "ring_block_timeout",	1, "10",	conf_ring_block_timeout }, // NOT dynamic
+	{  0 , "receive_batch",		1, "16",	conf_recv_batch },	// NOT dynamic
+	{  0 , "snaplen",		1, "0",		conf_snaplen },		// NOT dynamic
+	{  0 , "capture_thread",	0, NULL,	conf_capture_thread },	// NOT dynamic
+	{  0 , "queue_size",		1, "4096",	conf_queue_size },	// NOT dynamic
+	{  0 , "capture_workers",	1, "1",		conf_capture_workers },	// NOT dynamic
 	{ 'C', "channel",		1, NULL, 	conf_channel_set },
 	{ 's', "channel_scan",		0, NULL,	conf_channel_scan },
 	{  0 , "channel_scan_rounds",	1, "-1",	conf_channel_scan_rounds },
@@ -320,11 +661,25 @@ static struct conf_option conf_options[] = {
 	{ 'N', "server",		0, NULL,	conf_server },		// NOT dynamic
 	{ 'n', "client",		1, NULL,	conf_client },		// NOT dynamic
 	{ 'p', "port",			1, "4444",	conf_port },		// NOT dynamic
+	{ 'r', "readfile",		1, NULL,	conf_readfile },	// NOT dynamic
+	{  0 , "replay_speed",		1, "1",		conf_replay_speed },	// NOT dynamic
+	{ 'Q', "query",			1, NULL,	conf_query },		// NOT dynamic
+	{ 'A', "analyze",		1, NULL,	conf_analyze },		// NOT dynamic
+	{  0 , "analyze_threads",	1, "0",		conf_analyze_threads },	// NOT dynamic
+	{  0 , "analyze_format",	1, "table",	conf_analyze_format },	// NOT dynamic
 	{ 'X', "control_pipe",		2, NULL,	conf_control_pipe },	// NOT dynamic
+	{  0 , "dissector_udp",		1, NULL,	conf_dissector_udp },	// NOT dynamic
+	{  0 , "dissector_ether",	1, NULL,	conf_dissector_ether },	// NOT dynamic
+	{  0 , "dissector_enable",	1, NULL,	conf_dissector_enable },
+	{  0 , "dissector_disable",	1, NULL,	conf_dissector_disable },
 	{ 'e', "filter_mac", 		1, NULL,	conf_filter_mac },
+	{  0 , "filter_mac_allow",	1, NULL,	conf_filter_mac_allow },
+	{  0 , "filter_mac_deny",	1, NULL,	conf_filter_mac_deny },
+	{  0 , "filter_mac_addr",	1, "src",	conf_filter_mac_addr },
 	{ 'B', "filter_bssid", 		1, NULL,	conf_filter_bssid },
 	{ 'm', "filter_mode",		1, "ALL",	conf_filter_mode },
 	{ 'f', "filter_packet",		1, "ALL",	conf_filter_pkt },
+	{ 'F', "filter",		1, NULL,	conf_filter_expr },
 	{ 'M', "mac_names",		2, NULL,	conf_mac_names },
 };
 
@@ -359,6 +714,7 @@ bool config_handle_option(int c, const char* name, const char* value)
 				else
 					LOG_INF("Set '%s'", conf_options[i].name);
 			}
+			mac_addr_reset = true;
 			if (value != NULL) {
 				/* split list values and call function multiple times */
 				while ((end = strchr(value, ',')) != NULL) {
@@ -397,7 +753,10 @@ static void config_read_file(const char* filename)
 
 		// Note: 200 below has to match MAX_CONF_VALUE_STRLEN
 		// Note: 32 below has to match MAX_CONF_NAME_STRLEN
-		n = sscanf(line, " %32[^= \n] = %200[^ \n]", name, value);
+		// values in double quotes can contain spaces
+		n = sscanf(line, " %32[^= \n] = \"%200[^\"\n]\"", name, value);
+		if (n < 2)
+			n = sscanf(line, " %32[^= \n] = %200[^ \n]", name, value);
 		if (n < 0) { // empty line
 			continue;
 		} else if (n == 0) {
@@ -458,8 +817,8 @@ static char* config_get_getopt_string(char* buf, size_t maxlen, const char* add)
 static void print_usage(const char* name)
 {
 	printf("\nUsage: %s [-v] [-h] [-q] [-D] [-a] [-c file] [-i interface] [-t sec] [-d ms] [-V view] [-b bytes]\n"
-		"\t\t[-s] [-u] [-N] [-n IP] [-p port] [-o file] [-X[name]] [-x command]\n"
-		"\t\t[][-e MAC] [-f PKT_NAME] [-m MODE] [-B BSSID]\n\n"
+		"\t\t[-s] [-u] [-N] [-n IP] [-p port] [-o file] [-w file] [-r file] [-Q query] [-A files] [-X[name]] [-x command]\n"
+		"\t\t[][-e MAC] [-f PKT_NAME] [-m MODE] [-B BSSID] [-F expression]\n\n"
 
 		"General Options: Description (default value)\n"
 		"  -v\t\tshow version\n"
@@ -471,10 +830,10 @@ static void print_usage(const char* name)
 		"  -a\t\tAlways add virtual monitor interface\n"
 		"  -c <file>\tConfig file (" CONFIG_FILE ")\n"
 		"  -C <chan>\tSet initial channel\n"
-		"  -i <intf>\tInterface name (wlan0)\n"
+		"  -i <intf>\tInterface name (wlan0), up to 4 times\n"
 		"  -t <sec>\tNode timeout in seconds (60)\n"
 		"  -d <ms>\tDisplay update interval in ms (100)\n"
-		"  -V view\tDisplay view: history|essid|statistics|spectrum\n"
+		"  -V view\tDisplay view: history|essid|statistics|spectrum|links\n"
 		"  -b <bytes>\tReceive buffer size in bytes (not set)\n"
 		"  -M[filename]\tMAC address to host name mapping (/tmp/dhcp.leases)\n"
 
@@ -486,7 +845,13 @@ static void print_usage(const char* name)
 		"  -n <IP>\tConnect to server with <IP>, client mode (off)\n"
 		"  -p <port>\tPort number of server (4444)\n\n"
 
-		"  -o <filename>\tWrite packet info into 'filename'\n\n"
+		"  -o <filename>\tWrite packet info into 'filename'\n"
+		"  -w <filename>\tWrite raw frames into pcapng file 'filename'\n"
+		"  -r <filename>\tRead packets from pcap/pcapng file, '-' for stdin\n"
+		"  -Q <query>\tPrint records of binary outfile (-o) matching\n"
+		"\t\tmac=MAC,from=TIME,to=TIME as CSV and exit\n"
+		"  -A <files>\tAnalyze pcap/pcapng files in parallel, print a\n"
+		"\t\treport and exit\n\n"
 
 		"  -X[filename]\tAllow control socket on 'filename' (/tmp/horst)\n"
 		"  -x <command>\tSend control command\n"
@@ -500,6 +865,7 @@ static void print_usage(const char* name)
 		"  -f <PKT_NAME>\tFilter packet types, multiple\n"
 		"  -m <MODE>\tOperating mode: AP|STA|ADH|PRB|WDS|UNKNOWN, multiple\n"
 		"  -B <MAC>\tBSSID (xx:xx:xx:xx:xx:xx), only one\n"
+		"  -F <expr>\tFilter expression, e.g. 'beacon or signal > -70'\n"
 		"\n",
 		name);
 }
@@ -536,6 +902,7 @@ void config_parse_file_and_cmdline(int argc, char** argv)
 	}
 
 	/* read config file */
+	intf_list_reset = true;
 	config_read_file(conf_filename);
 
 	/*
@@ -543,9 +910,11 @@ void config_parse_file_and_cmdline(int argc, char** argv)
 	 * override or add to the config file options
 	 */
 	optind = 1;
+	intf_list_reset = true;
 	while ((c = getopt(argc, argv, getopt_str)) > 0) {
 		config_handle_option(c, NULL, optarg);
 	}
+	intf_list_final = true;
 
 	/*
 	 * and finally get command line options ("commands") which depend
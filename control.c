@@ -29,6 +29,10 @@
 #include "main.h"
 #include "control.h"
 #include "conf_options.h"
+#include "socket_filter.h"
+#include "network.h"
+#include "macfilter.h"
+#include "linktable.h"
 
 #define MAX_CMD 255
 
@@ -78,6 +82,31 @@ void control_send_command(const char* cmd)
 	close(ctlpipe);
 }
 
+/* written to a temporary file first, so readers never see a partial dump */
+static void link_dump_file(const char* name)
+{
+	char tmp[MAX_CONF_VALUE_STRLEN + 5];
+	FILE* fp;
+
+	if (name == NULL || name[0] == '\0') {
+		LOG_ERR("link_dump needs a file name");
+		return;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		LOG_ERR("Could not open '%s'", tmp);
+		return;
+	}
+
+	link_dump(fp);
+	if (fclose(fp) != 0 || rename(tmp, name) != 0) {
+		LOG_ERR("Could not write '%s'", name);
+		unlink(tmp);
+	}
+}
+
 static void parse_command(char* in) {
 	char* cmd;
 	char* val;
@@ -97,9 +126,21 @@ static void parse_command(char* in) {
 	else if (strcmp(cmd, "reset") == 0) {
 		main_reset();
 	}
+	else if (strcmp(cmd, "link_dump") == 0) {
+		link_dump_file(val);
+	}
+	else if (strcmp(cmd, "filter_mac_reload") == 0) {
+		macfilter_reload();
+		socket_filter_update();
+		net_send_filter_config();
+	}
 	else {
 		/* handle the rest thru config options */
-		config_handle_option(0, cmd, val);
+		if (config_handle_option(0, cmd, val)) {
+			socket_filter_update();
+			update_parse_depth();
+			net_send_filter_config();
+		}
 	}
 }
 
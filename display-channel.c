@@ -170,7 +170,10 @@ bool channel_input(WINDOW *win, int c)
 		    set_ht40plus != uwifi_channel_is_ht40plus(&conf.intf.channel)) {
 			uwifi_channel_fix_center_freq(&conf.intf.channel_set, set_ht40plus);
 			/* some setting changed */
-			if (conf.serveraddr[0] == '\0') {
+			if (conf.readfile[0] != '\0') {
+				/* replay: no radio to tune */
+				conf.intf.channel_set = conf.intf.channel;
+			} else if (conf.serveraddr[0] == '\0') {
 				/* server */
 				if (!uwifi_channel_change(&conf.intf, &conf.intf.channel_set)) {
 					/* reset UI */
@@ -28,6 +28,8 @@
 #include "main.h"
 #include "hutil.h"
 #include "network.h"
+#include "socket_filter.h"
+#include "macfilter.h"
 
 #define MAC_COL 2
 #define MODE_COL 30
@@ -88,7 +90,8 @@ void update_filter_win(WINDOW *win)
 
 	l = THIRD_ROW;
 	wattron(win, A_BOLD);
-	mvwprintw(win, l++, MAC_COL, "Source MAC Addresses");
+	mvwprintw(win, l++, MAC_COL, "%s MAC Addresses",
+		  conf.filter_mac_addr == MACFILTER_SRC ? "Source" : "Allowed");
 	wattroff(win, A_BOLD);
 
 	for (i = 0; i < MAX_FILTERMAC; i++) {
@@ -115,6 +118,14 @@ void update_filter_win(WINDOW *win)
 	mvwprintw(win, l++, MODE_COL, "%: [%c] WDS/4ADDR", CHECKED(conf.filter_mode & WLAN_MODE_4ADDR));
 	mvwprintw(win, l++, MODE_COL, "^: [%c] Unknown", CHECKED(conf.filter_mode & WLAN_MODE_UNKNOWN));
 
+	/* loaded from files with filter_mac_allow and filter_mac_deny */
+	mvwprintw(win, l++, MODE_COL, "Allow %u Deny %u MACs",
+		  conf.filter_mac_count[0], conf.filter_mac_count[1]);
+
+	/* set with the filter option, it is too long to edit here */
+	mvwprintw(win, ++l, MAC_COL, "Expression: %.*s", FILTER_WIN_WIDTH - 16,
+		  conf.filter_expr[0] != '\0' ? conf.filter_expr : "-");
+
 	wattroff(win, WHITE);
 	print_centered(win, ++l, FILTER_WIN_WIDTH, "[ Press key or ENTER ]");
 
@@ -201,13 +212,11 @@ bool filter_input(WINDOW *win, int c)
 
 out:
 	/* recalculate filter flag */
-	conf.do_macfilter = 0;
-	for (i = 0; i < MAX_FILTERMAC; i++) {
-		if (conf.filtermac_enabled[i])
-			conf.do_macfilter = 1;
-	}
+	macfilter_update();
 
 	net_send_filter_config();
+	socket_filter_update();
+	update_parse_depth();
 
 	update_filter_win(win);
 	return true;
@@ -0,0 +1,84 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/******************* LINKS *******************/
+
+#include <stdlib.h>
+
+#include <uwifi/util.h>
+
+#include "display.h"
+#include "main.h"
+#include "hutil.h"
+#include "linktable.h"
+
+#define LINK_BAR_POS	94
+
+void update_link_win(WINDOW *win)
+{
+	struct link** arr;
+	struct link* l;
+	unsigned int i, count;
+	int line = 1;
+	int rate, percent;
+	float usage;
+
+	werase(win);
+	wattron(win, WHITE);
+	wattroff(win, A_BOLD);
+	box(win, 0 , 0);
+	print_centered(win, 0, COLS, " Links by Airtime ");
+
+	mvwprintw(win, line++, 2, "%-17s %-17s %8s %8s %6s %9s %5s %4s %-5s %3s",
+		  "TRANSMITTER", "RECEIVER", "PACKETS", "BYTES", "RETRY%",
+		  "AIRTIME", "USE%", "SIG", "RATE", "%");
+	mvwhline(win, line++, 2, '-', COLS - 4);
+
+	arr = link_sorted(&count);
+	if (arr == NULL) {
+		wnoutrefresh(win);
+		return;
+	}
+
+	for (i = 0; i < count && line < LINES - 2; i++) {
+		l = arr[i];
+
+		if (l->last_seen > (time_mono.tv_sec - conf.node_timeout / 2))
+			wattron(win, A_BOLD);
+		else
+			wattroff(win, A_BOLD);
+
+		usage = stats.duration > 0 ? l->duration * 100.0 / stats.duration : 0;
+		rate = link_top_rate(l, &percent);
+
+		mvwprintw(win, line, 2, "%-17s", mac_name_lookup(l->src, 0));
+		mvwprintw(win, line, 20, "%-17s", mac_name_lookup(l->dst, 0));
+		mvwprintw(win, line, 38, "%8lu %8s %6.1f %9lu %5.1f %4d %-5s %3d",
+			  l->packets, kilo_mega_ize(l->bytes),
+			  l->retries * 100.0 / l->packets, l->duration, usage,
+			  l->signal, link_rate_name(rate), percent);
+		if (COLS - LINK_BAR_POS - 2 > 0)
+			mvwhline(win, line, LINK_BAR_POS, '*',
+				 normalize(usage, 100, COLS - LINK_BAR_POS - 2));
+		line++;
+	}
+	wattroff(win, A_BOLD);
+	free(arr);
+	wnoutrefresh(win);
+}
@@ -33,7 +33,11 @@
 #include "hutil.h"
 #include "olsr_header.h"
 #include "batman_adv_header-14.h"
+#include "batman_adv_header-15.h"
 #include "listsort.h"
+#include "protocol_parser.h"
+#include "olsr.h"
+#include "batadv.h"
 
 static WINDOW *sort_win = NULL;
 static WINDOW *dump_win = NULL;
@@ -232,6 +236,9 @@ static char spin[4] = {'/', '-', '\\', '|'};
 
 static bool print_node_list_line(int line, struct uwifi_node* n)
 {
+	struct olsr_orig orig;
+	struct batadv_orig bat;
+
 	if (conf.filter_mode != 0 && (n->wlan_mode & conf.filter_mode) == 0)
 		return false;
 
@@ -293,15 +300,32 @@ static bool print_node_list_line(int line, struct uwifi_node* n)
 		wprintw(list_win, " (%d)", n->wlan_bintval);
 	}
 
-	if (n->pkt_types & PKT_TYPE_OLSR)
+	if (n->pkt_types & PKT_TYPE_OLSR) {
 		wprintw(list_win, "OLSR N:%d ", n->olsr_neigh);
+		if (olsr_orig_get(n->ip_src, &orig))
+			wprintw(list_win, "TC:%d %s", orig.tc_neigh,
+				orig.gw ? "GW " : "");
+	}
 
-	if (n->pkt_types & PKT_TYPE_BATMAN)
+	if (n->pkt_types & PKT_TYPE_BATMAN) {
 		wprintw(list_win, "BATMAN %s", n->bat_gw ? "GW " : "");
+		if (batadv_orig_get(n->wlan_src, &bat)) {
+			if (bat.tq >= 0)
+				wprintw(list_win, "TQ:%d ", bat.tq);
+			else
+				wprintw(list_win, "%uM ", bat.throughput / 1000);
+			if (bat.gw_down)
+				wprintw(list_win, "GW:%u/%uM ", bat.gw_down / 1000,
+					bat.gw_up / 1000);
+		}
+	}
 
 	if (n->pkt_types & (PKT_TYPE_MESHZ))
 		wprintw(list_win, "MC ");
 
+	if (n->pkt_types & PKT_TYPE_CUSTOM)
+		wprintw(list_win, "%s ", dissector_custom_name(n->pkt_types));
+
 	if (n->pkt_types & PKT_TYPE_IP)
 		wprintw(list_win, "%s", ip_sprintf(n->ip_src));
 
@@ -418,8 +442,8 @@ void update_dump_win(struct uwifi_packet* p)
 		return;
 	}
 
-	if ((p->pkt_types & PKT_TYPE_BATMAN) && p->bat_packet_type == BAT_UNICAST) {
-		/* unicast traffic can carry IP/ICMP which we show below */
+	if ((p->pkt_types & PKT_TYPE_BATMAN) && (p->pkt_types & PKT_TYPE_IP)) {
+		/* unicast and broadcast traffic can carry IP which we show below */
 		wprintw(dump_win, "BATMAN ");
 	}
 
@@ -435,7 +459,23 @@ void update_dump_win(struct uwifi_packet* p)
 			default: wprintw(dump_win, "(%d)", p->olsr_type);
 		}
 	}
-	else if ((p->pkt_types & PKT_TYPE_BATMAN) && p->bat_packet_type != BAT_UNICAST) {
+	else if ((p->pkt_types & PKT_TYPE_BATMAN) && p->bat_version == BATADV_COMPAT_VERSION) {
+		wprintw(dump_win, "BATMAN ");
+		switch (p->bat_packet_type) {
+			case BATADV_IV_OGM: wprintw(dump_win, "OGM"); break;
+			case BATADV_OGM2: wprintw(dump_win, "OGM2"); break;
+			case BATADV_ELP: wprintw(dump_win, "ELP"); break;
+			case BATADV_BCAST: wprintw(dump_win, "BCAST"); break;
+			case BATADV_CODED: wprintw(dump_win, "CODED"); break;
+			case BATADV_UNICAST: wprintw(dump_win, "UNICAST"); break;
+			case BATADV_UNICAST_FRAG: wprintw(dump_win, "FRAG"); break;
+			case BATADV_UNICAST_4ADDR: wprintw(dump_win, "UNICAST_4ADDR"); break;
+			case BATADV_ICMP: wprintw(dump_win, "BAT_ICMP"); break;
+			case BATADV_UNICAST_TVLV: wprintw(dump_win, "TVLV"); break;
+			default: wprintw(dump_win, "UNKNOWN %d", p->bat_packet_type);
+		}
+	}
+	else if ((p->pkt_types & PKT_TYPE_BATMAN) && !(p->pkt_types & PKT_TYPE_IP)) {
 		wprintw(dump_win, "BATMAN ");
 		switch (p->bat_packet_type) {
 			case BAT_OGM: wprintw(dump_win, "OGM"); break;
@@ -454,6 +494,11 @@ void update_dump_win(struct uwifi_packet* p)
 			ip_sprintf(p->ip_src));
 		wprintw(dump_win, " -> %s", ip_sprintf(p->ip_dst));
 	}
+	else if (p->pkt_types & PKT_TYPE_CUSTOM) {
+		wprintw(dump_win, "%-7s%s", dissector_custom_name(p->pkt_types),
+			ip_sprintf(p->ip_src));
+		wprintw(dump_win, " -> %s", ip_sprintf(p->ip_dst));
+	}
 	else if (p->pkt_types & PKT_TYPE_UDP) {
 		wprintw(dump_win, "%-7s%s", "UDP", ip_sprintf(p->ip_src));
 		wprintw(dump_win, " -> %s", ip_sprintf(p->ip_dst));
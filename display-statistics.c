@@ -26,6 +26,7 @@
 #include "display.h"
 #include "main.h"
 #include "hutil.h"
+#include "outfile.h"
 
 
 #define STAT_PACK_POS 9
@@ -42,6 +43,7 @@ void update_statistics_win(WINDOW *win)
 	int line;
 	int bps, dps, pps, rps;
 	float duration;
+	struct outfile_stats ostats;
 
 	werase(win);
 	wattron(win, WHITE);
@@ -73,7 +75,20 @@ void update_statistics_win(WINDOW *win)
 		  dps * 1.0 / 10000, dps ); /* usec in % */
 	wattroff(win, A_BOLD);
 
-	line = 6;
+	/* each on its own line, they are too long for half a line */
+	line = 5;
+	if (conf.capture_thread) {
+		mvwprintw(win, line++, 2, "Queue:   %u (max %u)  Overflows: %lu",
+			  stats.queue_depth, stats.queue_depth_max,
+			  stats.queue_overflows);
+	}
+	if (conf.dumpfile[0] != '\0') {
+		outfile_get_stats(&ostats);
+		mvwprintw(win, line++, 2, "Outfile: %s (%lu)  Dropped: %lu",
+			  kilo_mega_ize(ostats.bytes_written),
+			  ostats.records_written, ostats.records_dropped);
+	}
+	line++;
 	mvwprintw(win, line, STAT_PACK_POS, " Packets");
 	mvwprintw(win, line, STAT_BYTE_POS, "   Bytes");
 	mvwprintw(win, line, STAT_BPP_POS, "~B/P");
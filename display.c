@@ -200,7 +200,8 @@ static void update_mini_status(void)
 {
 	wattron(stdscr, BLACKONWHITE);
 	mvwprintw(stdscr, LINES-1, COLS-31, conf.paused ? "|=" : "|>");
-	if (!conf.filter_off && (conf.do_macfilter || conf.filter_pkt != PKT_TYPE_ALL || conf.filter_mode != WLAN_MODE_ALL))
+	if (!conf.filter_off && (conf.do_macfilter || conf.filter_pkt != PKT_TYPE_ALL || conf.filter_mode != WLAN_MODE_ALL ||
+	    conf.filter_expr[0] != '\0'))
 		mvwprintw(stdscr, LINES-1, COLS-29, "|F");
 	else
 		mvwprintw(stdscr, LINES-1, COLS-29, "| ");
@@ -225,6 +226,7 @@ static void update_menu(void)
 	attron(KEYMARK); printw("E"); attroff(KEYMARK); printw("SSID St");
 	attron(KEYMARK); printw("a"); attroff(KEYMARK); printw("ts ");
 	attron(KEYMARK); printw("S"); attroff(KEYMARK); printw("pec ");
+	attron(KEYMARK); printw("L"); attroff(KEYMARK); printw("inks ");
 	attron(KEYMARK); printw("F"); attroff(KEYMARK); printw("ilt ");
 	attron(KEYMARK); printw("C"); attroff(KEYMARK); printw("han ");
 	attron(KEYMARK); printw("?"); attroff(KEYMARK); printw(" ");
@@ -255,6 +257,8 @@ static void update_show_win(void)
 		update_statistics_win(show_win);
 	else if (show_win_current == 's')
 		update_spectrum_win(show_win);
+	else if (show_win_current == 'l')
+		update_link_win(show_win);
 	else if (show_win_current == '?')
 		update_help_win(show_win);
 }
@@ -266,6 +270,7 @@ static void show_window(int which)
 		show_win = NULL;
 		show_win_current = 0;
 		update_menu();
+		update_parse_depth();
 		return;
 	}
 	if (show_win == NULL) {
@@ -275,6 +280,13 @@ static void show_window(int which)
 	show_win_current = which;
 	update_show_win();
 	update_menu();
+	update_parse_depth();
+}
+
+/* main and ESSID views show IP addresses and mesh protocol info */
+bool display_shows_packet_details(void)
+{
+	return show_win == NULL || show_win_current == 'e';
 }
 
 static void show_conf_window(int key)
@@ -412,6 +424,7 @@ void handle_user_input(void)
 	case 'h': case 'H':
 	case 'a': case 'A':
 	case 's': case 'S':
+	case 'l': case 'L':
 		show_window(tolower(key));
 		break;
 
@@ -40,7 +40,7 @@
 #define CHECKED(_exp) (_exp) ? '*' : ' '
 
 #define FILTER_WIN_WIDTH	56
-#define FILTER_WIN_HEIGHT	35
+#define FILTER_WIN_HEIGHT	37
 
 #define CHANNEL_WIN_WIDTH	41
 #define CHANNEL_WIN_HEIGHT	31
@@ -65,6 +65,7 @@ void handle_user_input(void);
 void init_display(void);
 void finish_display(void);
 void display_clear(void);
+bool display_shows_packet_details(void);
 
 /* main windows are special */
 void init_display_main(void);
@@ -85,6 +86,7 @@ bool channel_input(WINDOW *win, int c);
 void update_spectrum_win(WINDOW *win);
 void update_statistics_win(WINDOW *win);
 void update_essid_win(WINDOW *win);
+void update_link_win(WINDOW *win);
 void update_history_win(WINDOW *win);
 void update_help_win(WINDOW *win);
 bool spectrum_input(WINDOW *win, int c);
@@ -0,0 +1,1027 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include <uwifi/wlan_parser.h>
+#include <uwifi/wlan_util.h>
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "filter_expr.h"
+
+/*
+ * Filter expression grammar:
+ *
+ *	expr	:= and { ("or" | "||") and }
+ *	and	:= not { ("and" | "&&") not }
+ *	not	:= ("not" | "!") not | primary
+ *	primary	:= "(" expr ")" | field op value | flag
+ *	op	:= "==" | "=" | "!=" | "<" | "<=" | ">" | ">="
+ *
+ * The operands of "and" and "or" are reordered so that the cheaper ones are
+ * evaluated first, and flags of the same kind in an "or" are merged into one
+ * bit test. The program is then generated back to front, so that all jump
+ * targets are known when an instruction is emitted.
+ */
+
+#define FEXPR_MAX_INSN		250	/* jump offsets are 8 bit */
+#define FEXPR_MAX_WORD		64
+
+/* targets for the code generator */
+#define FEXPR_TRUE		(FEXPR_MAX_INSN + 1)
+#define FEXPR_FALSE		(FEXPR_MAX_INSN + 2)
+
+enum fexpr_op {
+	FX_EQ,
+	FX_GT,
+	FX_GE,
+	FX_SET,			/* any bit of k is set */
+};
+
+enum fexpr_field {
+	FF_SIGNAL,
+	FF_RATE,
+	FF_FREQ,
+	FF_LEN,
+	FF_RETRIES,
+	FF_CHANNEL,
+	FF_SEQNO,
+	FF_PORT,
+	FF_IP_SRC,
+	FF_IP_DST,
+	FF_SRC,
+	FF_DST,
+	FF_BSSID,
+	FF_STYPE,		/* BIT(subtype * 4 + type) */
+	FF_PKT,			/* pkt_types */
+	FF_MODE,		/* wlan_mode */
+	FF_RETRY,
+	FF_PROTECTED,
+};
+
+enum fexpr_kind {
+	FK_NUM,
+	FK_RATE,		/* Mbps, can have one decimal */
+	FK_MAC,
+	FK_IP,
+};
+
+static const struct {
+	const char*		name;
+	enum fexpr_field	field;
+	enum fexpr_kind		kind;
+	enum parse_depth	depth;
+} fexpr_fields[] = {
+	{ "signal",	FF_SIGNAL,	FK_NUM,		PARSE_WLAN },
+	{ "rate",	FF_RATE,	FK_RATE,	PARSE_WLAN },
+	{ "freq",	FF_FREQ,	FK_NUM,		PARSE_WLAN },
+	{ "len",	FF_LEN,		FK_NUM,		PARSE_WLAN },
+	{ "retries",	FF_RETRIES,	FK_NUM,		PARSE_WLAN },
+	{ "channel",	FF_CHANNEL,	FK_NUM,		PARSE_WLAN },
+	{ "seqno",	FF_SEQNO,	FK_NUM,		PARSE_WLAN },
+	{ "port",	FF_PORT,	FK_NUM,		PARSE_ALL },	/* UDP only */
+	{ "ip_src",	FF_IP_SRC,	FK_IP,		PARSE_IP },
+	{ "ip_dst",	FF_IP_DST,	FK_IP,		PARSE_IP },
+	{ "src",	FF_SRC,		FK_MAC,		PARSE_WLAN },
+	{ "dst",	FF_DST,		FK_MAC,		PARSE_WLAN },
+	{ "bssid",	FF_BSSID,	FK_MAC,		PARSE_WLAN },
+};
+
+#define STYPE_ALL(_t)	(0x1111111111111111LL << (_t))
+
+/* frame subtype names (BEACON, QDATA, ...) and custom dissectors are
+ * looked up after these */
+static const struct {
+	const char*		name;
+	enum fexpr_field	field;
+	int64_t			k;
+} fexpr_flags[] = {
+	{ "mgmt",	FF_STYPE,	STYPE_ALL(WLAN_FRAME_TYPE_MGMT) },
+	{ "ctrl",	FF_STYPE,	STYPE_ALL(WLAN_FRAME_TYPE_CTRL) },
+	{ "data",	FF_STYPE,	STYPE_ALL(WLAN_FRAME_TYPE_DATA) },
+	{ "arp",	FF_PKT,		PKT_TYPE_ARP },
+	{ "ip",		FF_PKT,		PKT_TYPE_IP },
+	{ "icmp",	FF_PKT,		PKT_TYPE_ICMP },
+	{ "udp",	FF_PKT,		PKT_TYPE_UDP },
+	{ "tcp",	FF_PKT,		PKT_TYPE_TCP },
+	{ "olsr",	FF_PKT,		PKT_TYPE_OLSR },
+	{ "batman",	FF_PKT,		PKT_TYPE_BATMAN },
+	{ "meshz",	FF_PKT,		PKT_TYPE_MESHZ },
+	{ "ap",		FF_MODE,	WLAN_MODE_AP },
+	{ "sta",	FF_MODE,	WLAN_MODE_STA },
+	{ "ibss",	FF_MODE,	WLAN_MODE_IBSS },
+	{ "adh",	FF_MODE,	WLAN_MODE_IBSS },
+	{ "prb",	FF_MODE,	WLAN_MODE_PROBE },
+	{ "wds",	FF_MODE,	WLAN_MODE_4ADDR },
+	{ "retry",	FF_RETRY,	1 },
+	{ "protected",	FF_PROTECTED,	1 },
+};
+
+enum fexpr_tok {
+	T_END,
+	T_WORD,
+	T_LPAREN,
+	T_RPAREN,
+	T_NOT,
+	T_AND,
+	T_OR,
+	T_EQ,
+	T_NE,
+	T_LT,
+	T_LE,
+	T_GT,
+	T_GE,
+};
+
+struct fexpr_parser {
+	const char*		pos;
+	const char*		tok_start;
+	enum fexpr_tok		tok;
+	char			word[FEXPR_MAX_WORD];
+	enum parse_depth	depth;
+	bool			error;
+};
+
+enum fexpr_node_type {
+	FN_CMP,
+	FN_NOT,
+	FN_AND,
+	FN_OR,
+};
+
+struct fexpr_node {
+	enum fexpr_node_type	type;
+	unsigned int		cost;
+
+	/* FN_CMP */
+	enum fexpr_op		op;
+	enum fexpr_field	field;
+	int64_t			k;
+
+	/* FN_NOT has one child */
+	struct fexpr_node**	child;
+	unsigned int		num_child;
+};
+
+/* active program and the ones it replaced, which capture threads may still
+ * be running. they are only freed at exit */
+static struct fexpr_prog* filter_prog;
+static struct fexpr_prog* filter_retired;
+
+/*** evaluation ***/
+
+static inline uint64_t fexpr_load(const struct fexpr_insn* in,
+				  const struct uwifi_packet* p)
+{
+	uint64_t a;
+
+	memcpy(&a, (const unsigned char*)p + in->off, sizeof(a));
+	a = (a >> in->shift) & in->fmask;
+	a = (a ^ in->sbit) - in->sbit;
+	return in->bitset ? (in->mask >> (a & 63)) & 1 : a & in->mask;
+}
+
+bool fexpr_run(const struct fexpr_prog* prog, const struct uwifi_packet* p)
+{
+	const struct fexpr_insn* in = prog->insn;
+	uint64_t a;
+	unsigned int j;
+
+	/* all jumps go forward and end in FEXPR_RET_TRUE or FEXPR_RET_FALSE */
+	for (;;) {
+		a = fexpr_load(in, p);
+		j = (a - in->lo <= in->range) ? in->jt : in->jf;
+		if (j >= FEXPR_RET_FALSE)
+			return j == FEXPR_RET_TRUE;
+		in += 1 + j;
+	}
+}
+
+/*** field loads ***/
+
+/* 8 bytes are loaded from the offset of the field, or from before it when it
+ * is at the end of struct uwifi_packet */
+static void fexpr_set_load(struct fexpr_insn* in, size_t off, size_t size,
+			   bool is_signed)
+{
+	size_t base = off;
+
+	if (base + 8 > sizeof(struct uwifi_packet))
+		base = sizeof(struct uwifi_packet) - 8;
+
+	in->off = base;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	in->shift = 8 * (base + 8 - off - size);
+#else
+	in->shift = 8 * (off - base);
+#endif
+	in->fmask = size >= 8 ? UINT64_MAX : (1ULL << (8 * size)) - 1;
+	in->sbit = is_signed ? 1ULL << (8 * size - 1) : 0;
+	in->bitset = 0;
+	in->mask = UINT64_MAX;
+}
+
+#define LOAD_MEMBER(_in, _m, _signed) \
+	fexpr_set_load(_in, offsetof(struct uwifi_packet, _m), \
+		       sizeof(((struct uwifi_packet*)0)->_m), _signed)
+
+/* bit fields have no offset, find the bit by setting it */
+static void fexpr_set_load_bit(struct fexpr_insn* in,
+			       void (*set)(struct uwifi_packet* p))
+{
+	struct uwifi_packet p;
+	const unsigned char* b = (const unsigned char*)&p;
+	size_t i;
+
+	memset(&p, 0, sizeof(p));
+	set(&p);
+	for (i = 0; i < sizeof(p) - 1 && b[i] == 0; i++)
+		;
+	fexpr_set_load(in, i, 1, false);
+	in->shift += __builtin_ctz(b[i]);
+	in->fmask = 1;
+}
+
+static void set_retry(struct uwifi_packet* p) { p->wlan_retry = 1; }
+static void set_protected(struct uwifi_packet* p) { p->wlan_wep = 1; }
+
+static void fexpr_field_load(struct fexpr_insn* in, enum fexpr_field field)
+{
+	in->field = field;
+
+	switch (field) {
+	case FF_SIGNAL:		LOAD_MEMBER(in, phy_signal, true); break;
+	case FF_RATE:		LOAD_MEMBER(in, phy_rate, false); break;
+	case FF_FREQ:		LOAD_MEMBER(in, phy_freq, false); break;
+	case FF_LEN:		LOAD_MEMBER(in, wlan_len, false); break;
+	case FF_RETRIES:	LOAD_MEMBER(in, wlan_retries, false); break;
+	case FF_CHANNEL:	LOAD_MEMBER(in, wlan_channel, false); break;
+	case FF_SEQNO:		LOAD_MEMBER(in, wlan_seqno, false); break;
+	case FF_PORT:		LOAD_MEMBER(in, tcpudp_port, false); break;
+	case FF_IP_SRC:		LOAD_MEMBER(in, ip_src, false); break;
+	case FF_IP_DST:		LOAD_MEMBER(in, ip_dst, false); break;
+	case FF_SRC:		LOAD_MEMBER(in, wlan_src, false); break;
+	case FF_DST:		LOAD_MEMBER(in, wlan_dst, false); break;
+	case FF_BSSID:		LOAD_MEMBER(in, wlan_bssid, false); break;
+	case FF_PKT:		LOAD_MEMBER(in, pkt_types, false); break;
+	case FF_MODE:		LOAD_MEMBER(in, wlan_mode, false); break;
+	case FF_RETRY:		fexpr_set_load_bit(in, set_retry); break;
+	case FF_PROTECTED:	fexpr_set_load_bit(in, set_protected); break;
+	case FF_STYPE:
+		/* subtype and type of the frame control field */
+		LOAD_MEMBER(in, wlan_type, false);
+		in->shift += 2;
+		in->fmask = 0x3f;
+		in->bitset = 1;
+		break;
+	}
+}
+
+/* addresses are compared as loaded, in whatever byte order that is */
+static int64_t fexpr_addr_value(enum fexpr_field field, const unsigned char* mac,
+				uint32_t ip)
+{
+	struct uwifi_packet p;
+	struct fexpr_insn ld;
+
+	memset(&p, 0, sizeof(p));
+	switch (field) {
+	case FF_SRC:	memcpy(p.wlan_src, mac, WLAN_MAC_LEN); break;
+	case FF_DST:	memcpy(p.wlan_dst, mac, WLAN_MAC_LEN); break;
+	case FF_BSSID:	memcpy(p.wlan_bssid, mac, WLAN_MAC_LEN); break;
+	case FF_IP_SRC:	p.ip_src = ip; break;
+	case FF_IP_DST:	p.ip_dst = ip; break;
+	default:	break;
+	}
+
+	fexpr_field_load(&ld, field);
+	return fexpr_load(&ld, &p);
+}
+
+/*** parser ***/
+
+static void* fexpr_error(struct fexpr_parser* ps, const char* msg)
+{
+	if (!ps->error) {
+		if (*ps->tok_start == '\0')
+			LOG_ERR("Filter expression: %s at the end", msg);
+		else
+			LOG_ERR("Filter expression: %s at '%s'", msg, ps->tok_start);
+	}
+	ps->error = true;
+	return NULL;
+}
+
+static bool is_word_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') || c == '_' || c == ':' ||
+		c == '.' || c == '-';
+}
+
+static void fexpr_next(struct fexpr_parser* ps)
+{
+	const char* s;
+	size_t len;
+
+	while (*ps->pos == ' ' || *ps->pos == '\t')
+		ps->pos++;
+
+	s = ps->tok_start = ps->pos;
+	if (ps->error) {
+		ps->tok = T_END;
+		return;
+	}
+
+	switch (*s) {
+	case '\0': ps->tok = T_END; return;
+	case '(': ps->tok = T_LPAREN; ps->pos++; return;
+	case ')': ps->tok = T_RPAREN; ps->pos++; return;
+	case '=':
+		ps->tok = T_EQ;
+		ps->pos += (s[1] == '=') ? 2 : 1;
+		return;
+	case '!':
+		ps->tok = (s[1] == '=') ? T_NE : T_NOT;
+		ps->pos += (s[1] == '=') ? 2 : 1;
+		return;
+	case '<':
+		ps->tok = (s[1] == '=') ? T_LE : T_LT;
+		ps->pos += (s[1] == '=') ? 2 : 1;
+		return;
+	case '>':
+		ps->tok = (s[1] == '=') ? T_GE : T_GT;
+		ps->pos += (s[1] == '=') ? 2 : 1;
+		return;
+	case '&':
+	case '|':
+		if (s[1] != s[0])
+			break;
+		ps->tok = (*s == '&') ? T_AND : T_OR;
+		ps->pos += 2;
+		return;
+	}
+
+	for (len = 0; is_word_char(s[len]); len++)
+		;
+
+	if (len == 0) {
+		ps->tok = T_END;
+		fexpr_error(ps, "unexpected character");
+		return;
+	}
+	if (len >= FEXPR_MAX_WORD) {
+		ps->tok = T_END;
+		fexpr_error(ps, "word too long");
+		return;
+	}
+
+	memcpy(ps->word, s, len);
+	ps->word[len] = '\0';
+	ps->pos += len;
+
+	if (strcasecmp(ps->word, "and") == 0)
+		ps->tok = T_AND;
+	else if (strcasecmp(ps->word, "or") == 0)
+		ps->tok = T_OR;
+	else if (strcasecmp(ps->word, "not") == 0)
+		ps->tok = T_NOT;
+	else
+		ps->tok = T_WORD;
+}
+
+static void fexpr_node_free(struct fexpr_node* n)
+{
+	unsigned int i;
+
+	if (n == NULL)
+		return;
+	for (i = 0; i < n->num_child; i++)
+		fexpr_node_free(n->child[i]);
+	free(n->child);
+	free(n);
+}
+
+static struct fexpr_node* fexpr_node_new(struct fexpr_parser* ps,
+					 enum fexpr_node_type type)
+{
+	struct fexpr_node* n = calloc(1, sizeof(struct fexpr_node));
+	if (n == NULL)
+		return fexpr_error(ps, "out of memory");
+	n->type = type;
+	return n;
+}
+
+static bool fexpr_node_add(struct fexpr_parser* ps, struct fexpr_node* n,
+			   struct fexpr_node* c)
+{
+	struct fexpr_node** child;
+
+	child = realloc(n->child, (n->num_child + 1) * sizeof(struct fexpr_node*));
+	if (child == NULL) {
+		fexpr_error(ps, "out of memory");
+		return false;
+	}
+	n->child = child;
+	n->child[n->num_child++] = c;
+	return true;
+}
+
+static struct fexpr_node* fexpr_not(struct fexpr_parser* ps, struct fexpr_node* c)
+{
+	struct fexpr_node* n;
+
+	/* "not not" cancels out */
+	if (c->type == FN_NOT) {
+		n = c->child[0];
+		c->num_child = 0;
+		fexpr_node_free(c);
+		return n;
+	}
+
+	n = fexpr_node_new(ps, FN_NOT);
+	if (n == NULL || !fexpr_node_add(ps, n, c)) {
+		fexpr_node_free(n);
+		fexpr_node_free(c);
+		return NULL;
+	}
+	return n;
+}
+
+/* a AND b or a OR b, flattened into one node with many operands */
+static struct fexpr_node* fexpr_join(struct fexpr_parser* ps, enum fexpr_node_type type,
+				     struct fexpr_node* a, struct fexpr_node* b)
+{
+	struct fexpr_node* n = a;
+	unsigned int i;
+
+	if (a->type != type) {
+		n = fexpr_node_new(ps, type);
+		if (n == NULL || !fexpr_node_add(ps, n, a))
+			goto fail;
+	}
+
+	if (b->type != type) {
+		if (!fexpr_node_add(ps, n, b))
+			goto fail;
+		return n;
+	}
+
+	for (i = 0; i < b->num_child; i++) {
+		if (!fexpr_node_add(ps, n, b->child[i]))
+			goto fail;
+		b->child[i] = NULL;
+	}
+	fexpr_node_free(b);
+	return n;
+
+fail:
+	if (n != a)
+		fexpr_node_free(n);
+	fexpr_node_free(a);
+	fexpr_node_free(b);
+	return NULL;
+}
+
+static void fexpr_use_depth(struct fexpr_parser* ps, enum parse_depth depth)
+{
+	if (depth > ps->depth)
+		ps->depth = depth;
+}
+
+static bool fexpr_value(struct fexpr_parser* ps, unsigned int f, int64_t* k)
+{
+	unsigned char mac[WLAN_MAC_LEN];
+	struct in_addr ip;
+	char* end;
+	double d;
+	int n = 0;
+
+	/* no field is wider than 48 bit, this keeps the ranges from overflowing */
+	switch (fexpr_fields[f].kind) {
+	case FK_NUM:
+		*k = strtoll(ps->word, &end, 0);
+		return *end == '\0' && llabs(*k) < (1LL << 62);
+	case FK_RATE:
+		/* phy_rate is in 100kbps */
+		d = strtod(ps->word, &end);
+		*k = (int64_t)(d * 10 + 0.5);
+		return *end == '\0' && fabs(d) < (1LL << 58);
+	case FK_MAC:
+		if (sscanf(ps->word, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx%n",
+			   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5],
+			   &n) != 6 || ps->word[n] != '\0')
+			return false;
+		*k = fexpr_addr_value(fexpr_fields[f].field, mac, 0);
+		return true;
+	case FK_IP:
+		if (inet_pton(AF_INET, ps->word, &ip) != 1)
+			return false;
+		*k = fexpr_addr_value(fexpr_fields[f].field, NULL, ip.s_addr);
+		return true;
+	}
+	return false;
+}
+
+static struct fexpr_node* fexpr_compare(struct fexpr_parser* ps, unsigned int f)
+{
+	enum fexpr_tok op = ps->tok;
+	struct fexpr_node* n;
+	int64_t k;
+
+	if (op < T_EQ)
+		return fexpr_error(ps, "expected comparison");
+
+	if ((fexpr_fields[f].kind == FK_MAC || fexpr_fields[f].kind == FK_IP) &&
+	    op != T_EQ && op != T_NE)
+		return fexpr_error(ps, "addresses can only be compared with == and !=");
+
+	fexpr_next(ps);
+	if (ps->tok != T_WORD)
+		return fexpr_error(ps, "expected value");
+	if (!fexpr_value(ps, f, &k))
+		return fexpr_error(ps, "invalid value");
+	fexpr_next(ps);
+
+	n = fexpr_node_new(ps, FN_CMP);
+	if (n == NULL)
+		return NULL;
+
+	n->field = fexpr_fields[f].field;
+	n->k = k;
+	fexpr_use_depth(ps, fexpr_fields[f].depth);
+
+	/* only EQ, GT and GE exist, the others are their negation */
+	switch (op) {
+	case T_EQ: n->op = FX_EQ; break;
+	case T_NE: n->op = FX_EQ; return fexpr_not(ps, n);
+	case T_GT: n->op = FX_GT; break;
+	case T_GE: n->op = FX_GE; break;
+	case T_LT: n->op = FX_GE; return fexpr_not(ps, n);
+	case T_LE: n->op = FX_GT; return fexpr_not(ps, n);
+	default: break;
+	}
+	return n;
+}
+
+static bool fexpr_flag(const char* name, enum fexpr_field* field, int64_t* k)
+{
+	unsigned int i, t;
+
+	for (i = 0; i < sizeof(fexpr_flags)/sizeof(fexpr_flags[0]); i++) {
+		if (strcasecmp(fexpr_flags[i].name, name) == 0) {
+			*field = fexpr_flags[i].field;
+			*k = fexpr_flags[i].k;
+			return true;
+		}
+	}
+
+	for (t = 0; t < WLAN_NUM_TYPES; t++) {
+		for (i = 0; i < WLAN_NUM_STYPES; i++) {
+			if (stype_names[t][i].name != NULL &&
+			    strcasecmp(stype_names[t][i].name, name) == 0) {
+				*field = FF_STYPE;
+				*k = 1LL << (i * 4 + t);
+				return true;
+			}
+		}
+	}
+
+	*k = dissector_pkt_type(name) & PKT_TYPE_CUSTOM;
+	*field = FF_PKT;
+	return *k != 0;
+}
+
+static struct fexpr_node* fexpr_parse_or(struct fexpr_parser* ps);
+
+static struct fexpr_node* fexpr_parse_primary(struct fexpr_parser* ps)
+{
+	struct fexpr_node* n;
+	enum fexpr_field field;
+	unsigned int i;
+	int64_t k;
+
+	if (ps->tok == T_LPAREN) {
+		fexpr_next(ps);
+		n = fexpr_parse_or(ps);
+		if (n == NULL)
+			return NULL;
+		if (ps->tok != T_RPAREN) {
+			fexpr_node_free(n);
+			return fexpr_error(ps, "expected ')'");
+		}
+		fexpr_next(ps);
+		return n;
+	}
+
+	if (ps->tok != T_WORD)
+		return fexpr_error(ps, "expected field or flag");
+
+	for (i = 0; i < sizeof(fexpr_fields)/sizeof(fexpr_fields[0]); i++) {
+		if (strcasecmp(fexpr_fields[i].name, ps->word) == 0) {
+			fexpr_next(ps);
+			return fexpr_compare(ps, i);
+		}
+	}
+
+	if (!fexpr_flag(ps->word, &field, &k))
+		return fexpr_error(ps, "unknown field or flag");
+	fexpr_next(ps);
+
+	n = fexpr_node_new(ps, FN_CMP);
+	if (n == NULL)
+		return NULL;
+	n->op = FX_SET;
+	n->field = field;
+	n->k = k;
+	if (field == FF_PKT)
+		fexpr_use_depth(ps, parse_depth_for_pkt_types(k));
+	return n;
+}
+
+static struct fexpr_node* fexpr_parse_not(struct fexpr_parser* ps)
+{
+	struct fexpr_node* n;
+
+	if (ps->tok != T_NOT)
+		return fexpr_parse_primary(ps);
+
+	fexpr_next(ps);
+	n = fexpr_parse_not(ps);
+	if (n == NULL)
+		return NULL;
+	return fexpr_not(ps, n);
+}
+
+static struct fexpr_node* fexpr_parse_and(struct fexpr_parser* ps)
+{
+	struct fexpr_node *n, *b;
+
+	n = fexpr_parse_not(ps);
+	while (n != NULL && ps->tok == T_AND) {
+		fexpr_next(ps);
+		b = fexpr_parse_not(ps);
+		if (b == NULL) {
+			fexpr_node_free(n);
+			return NULL;
+		}
+		n = fexpr_join(ps, FN_AND, n, b);
+	}
+	return n;
+}
+
+static struct fexpr_node* fexpr_parse_or(struct fexpr_parser* ps)
+{
+	struct fexpr_node *n, *b;
+
+	n = fexpr_parse_and(ps);
+	while (n != NULL && ps->tok == T_OR) {
+		fexpr_next(ps);
+		b = fexpr_parse_and(ps);
+		if (b == NULL) {
+			fexpr_node_free(n);
+			return NULL;
+		}
+		n = fexpr_join(ps, FN_OR, n, b);
+	}
+	return n;
+}
+
+/*** optimization ***/
+
+static bool is_flag(const struct fexpr_node* n)
+{
+	return n->type == FN_CMP && n->op == FX_SET;
+}
+
+static bool is_not_flag(const struct fexpr_node* n)
+{
+	return n->type == FN_NOT && is_flag(n->child[0]);
+}
+
+static const struct fexpr_node* flag_of(const struct fexpr_node* n)
+{
+	return n->type == FN_NOT ? n->child[0] : n;
+}
+
+/* "beacon or probe" is one bit test, so is "not arp and not udp" */
+static void fexpr_merge_flags(struct fexpr_node* n)
+{
+	bool (*mergeable)(const struct fexpr_node*) =
+		(n->type == FN_OR) ? is_flag : is_not_flag;
+	struct fexpr_node *a, *b;
+	unsigned int i, j;
+
+	for (i = 0; i < n->num_child; i++) {
+		if (!mergeable(n->child[i]))
+			continue;
+		a = (struct fexpr_node*)flag_of(n->child[i]);
+		for (j = i + 1; j < n->num_child; ) {
+			b = n->child[j];
+			if (mergeable(b) && flag_of(b)->field == a->field) {
+				a->k |= flag_of(b)->k;
+				fexpr_node_free(b);
+				memmove(&n->child[j], &n->child[j + 1],
+					(n->num_child - j - 1) * sizeof(struct fexpr_node*));
+				n->num_child--;
+			} else {
+				j++;
+			}
+		}
+	}
+}
+
+static unsigned int field_cost(enum fexpr_field field)
+{
+	/* 48 bit MAC addresses are assembled from 6 bytes */
+	if (field == FF_SRC || field == FF_DST || field == FF_BSSID)
+		return 3;
+	return 1;
+}
+
+static struct fexpr_node* fexpr_optimize(struct fexpr_node* n)
+{
+	struct fexpr_node* c;
+	unsigned int i, j;
+
+	switch (n->type) {
+	case FN_CMP:
+		n->cost = field_cost(n->field);
+		return n;
+	case FN_NOT:
+		n->child[0] = fexpr_optimize(n->child[0]);
+		n->cost = n->child[0]->cost;
+		return n;
+	case FN_AND:
+	case FN_OR:
+		break;
+	}
+
+	for (i = 0; i < n->num_child; i++)
+		n->child[i] = fexpr_optimize(n->child[i]);
+
+	fexpr_merge_flags(n);
+
+	if (n->num_child == 1) {
+		c = n->child[0];
+		n->num_child = 0;
+		fexpr_node_free(n);
+		return c;
+	}
+
+	/* cheapest operands first, keep the order of the user otherwise */
+	for (i = 1; i < n->num_child; i++) {
+		c = n->child[i];
+		for (j = i; j > 0 && n->child[j - 1]->cost > c->cost; j--)
+			n->child[j] = n->child[j - 1];
+		n->child[j] = c;
+	}
+
+	n->cost = 0;
+	for (i = 0; i < n->num_child; i++)
+		n->cost += n->child[i]->cost;
+	return n;
+}
+
+/*** code generation ***/
+
+struct fexpr_gen {
+	struct fexpr_insn	insn[FEXPR_MAX_INSN];
+	unsigned int		pos;		/* first emitted instruction */
+	bool			overflow;
+};
+
+static uint8_t fexpr_jump(const struct fexpr_gen* g, unsigned int target)
+{
+	if (target == FEXPR_TRUE)
+		return FEXPR_RET_TRUE;
+	if (target == FEXPR_FALSE)
+		return FEXPR_RET_FALSE;
+	return target - g->pos - 1;
+}
+
+/* emit an instruction in front of the ones already emitted. jump targets
+ * t and f are absolute and always behind it */
+static unsigned int fexpr_emit(struct fexpr_gen* g, const struct fexpr_node* n,
+			       unsigned int t, unsigned int f)
+{
+	struct fexpr_insn* in;
+
+	if (g->overflow || g->pos == 0) {
+		g->overflow = true;
+		return FEXPR_FALSE;
+	}
+
+	in = &g->insn[--g->pos];
+	fexpr_field_load(in, n->field);
+	in->jt = fexpr_jump(g, t);
+	in->jf = fexpr_jump(g, f);
+
+	/* ranges are unsigned and may wrap around, so that
+	 * signed values work too */
+	in->lo = n->k;
+	switch (n->op) {
+	case FX_EQ:
+		in->range = 0;
+		break;
+	case FX_GT:
+		in->lo = n->k + 1;
+		in->range = (uint64_t)INT64_MAX - n->k - 1;
+		break;
+	case FX_GE:
+		in->range = (uint64_t)INT64_MAX - n->k;
+		break;
+	case FX_SET:
+		/* not zero */
+		in->mask = n->k;
+		in->lo = 1;
+		in->range = UINT64_MAX - 1;
+		break;
+	}
+	return g->pos;
+}
+
+/* returns the entry point of the code for node n */
+static unsigned int fexpr_gen_node(struct fexpr_gen* g, const struct fexpr_node* n,
+				   unsigned int t, unsigned int f)
+{
+	unsigned int entry;
+	int i;
+
+	switch (n->type) {
+	case FN_CMP:
+		return fexpr_emit(g, n, t, f);
+	case FN_NOT:
+		return fexpr_gen_node(g, n->child[0], f, t);
+	case FN_AND:
+		/* each operand continues with the next one if it is true */
+		entry = t;
+		for (i = n->num_child - 1; i >= 0; i--)
+			entry = fexpr_gen_node(g, n->child[i], entry, f);
+		return entry;
+	case FN_OR:
+		entry = f;
+		for (i = n->num_child - 1; i >= 0; i--)
+			entry = fexpr_gen_node(g, n->child[i], t, entry);
+		return entry;
+	}
+	return f;
+}
+
+struct fexpr_prog* fexpr_compile(const char* expr)
+{
+	struct fexpr_parser ps = { .pos = expr, .depth = PARSE_WLAN };
+	struct fexpr_gen* g;
+	struct fexpr_prog* prog = NULL;
+	struct fexpr_node* root;
+	unsigned int entry;
+
+	fexpr_next(&ps);
+	root = fexpr_parse_or(&ps);
+	if (root != NULL && ps.tok != T_END) {
+		fexpr_error(&ps, "unexpected input");
+		fexpr_node_free(root);
+		return NULL;
+	}
+	if (root == NULL)
+		return NULL;
+
+	root = fexpr_optimize(root);
+
+	g = malloc(sizeof(struct fexpr_gen));
+	if (g == NULL)
+		goto out;
+	g->pos = FEXPR_MAX_INSN;
+	g->overflow = false;
+
+	entry = fexpr_gen_node(g, root, FEXPR_TRUE, FEXPR_FALSE);
+
+	if (g->overflow) {
+		LOG_ERR("Filter expression is too complex");
+		goto out;
+	}
+
+	prog = malloc(sizeof(struct fexpr_prog) +
+		      (FEXPR_MAX_INSN - entry) * sizeof(struct fexpr_insn));
+	if (prog == NULL)
+		goto out;
+
+	prog->old = NULL;
+	prog->depth = ps.depth;
+	prog->len = FEXPR_MAX_INSN - entry;
+	memcpy(prog->insn, &g->insn[entry], prog->len * sizeof(struct fexpr_insn));
+
+out:
+	free(g);
+	fexpr_node_free(root);
+	return prog;
+}
+
+#if DEBUG
+static void fexpr_dump_target(char* buf, size_t len, unsigned int i, uint8_t j)
+{
+	if (j == FEXPR_RET_TRUE)
+		snprintf(buf, len, "true");
+	else if (j == FEXPR_RET_FALSE)
+		snprintf(buf, len, "false");
+	else
+		snprintf(buf, len, "%u", i + 1 + j);
+}
+
+void fexpr_dump(const struct fexpr_prog* prog)
+{
+	static const char* fields[] = {
+		"signal", "rate", "freq", "len", "retries", "channel", "seqno",
+		"port", "ip_src", "ip_dst", "src", "dst", "bssid", "stype",
+		"pkt", "mode", "retry", "protected"
+	};
+	const struct fexpr_insn* in;
+	char jt[8], jf[8];
+	unsigned int i;
+
+	for (i = 0; i < prog->len; i++) {
+		in = &prog->insn[i];
+		fexpr_dump_target(jt, sizeof(jt), i, in->jt);
+		fexpr_dump_target(jf, sizeof(jf), i, in->jf);
+		LOG_DBG("%3u: %-9s %s 0x%llx - %lld <= %llu ? %s : %s", i,
+			fields[in->field], in->bitset ? "in" : "&",
+			(unsigned long long)in->mask, (long long)in->lo,
+			(unsigned long long)in->range, jt, jf);
+	}
+}
+#endif
+
+/*** active filter ***/
+
+bool filter_expr_set(const char* expr)
+{
+	struct fexpr_prog* prog = NULL;
+	struct fexpr_prog* old;
+
+	if (expr != NULL && expr[0] != '\0') {
+		prog = fexpr_compile(expr);
+		if (prog == NULL)
+			return false;
+#if DEBUG
+		fexpr_dump(prog);
+#endif
+	}
+
+	old = __atomic_exchange_n(&filter_prog, prog, __ATOMIC_ACQ_REL);
+	if (old != NULL) {
+		old->old = filter_retired;
+		filter_retired = old;
+	}
+	return true;
+}
+
+bool filter_expr_match(const struct uwifi_packet* p)
+{
+	struct fexpr_prog* prog = __atomic_load_n(&filter_prog, __ATOMIC_ACQUIRE);
+
+	return prog == NULL || fexpr_run(prog, p);
+}
+
+enum parse_depth filter_expr_depth(void)
+{
+	struct fexpr_prog* prog = __atomic_load_n(&filter_prog, __ATOMIC_ACQUIRE);
+
+	return prog != NULL ? prog->depth : PARSE_WLAN;
+}
+
+void filter_expr_free(void)
+{
+	struct fexpr_prog* prog;
+
+	free(filter_prog);
+	filter_prog = NULL;
+
+	while (filter_retired != NULL) {
+		prog = filter_retired;
+		filter_retired = prog->old;
+		free(prog);
+	}
+}
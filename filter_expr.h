@@ -0,0 +1,86 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _FILTER_EXPR_H_
+#define _FILTER_EXPR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "protocol_parser.h"
+
+struct uwifi_packet;
+
+/*
+ * Filter expressions like
+ *
+ *	(qdata and bssid == 00:11:22:33:44:55 and signal > -70) or deauth
+ *
+ * are compiled into a small BPF-like program: each instruction loads one
+ * packet field into the register, checks if it is in a range and jumps
+ * forward to one of two targets, so "and" and "or" short-circuit without a
+ * stack. Fields are loaded by offset and all comparisons and bit tests are
+ * range checks, so an instruction needs no branch except for its jump.
+ */
+struct fexpr_insn {
+	uint16_t	off;		/* of the 8 bytes loaded from the packet */
+	uint8_t		shift;		/* to the lowest bit of the field */
+	uint8_t		bitset;		/* field is an index into mask */
+	uint8_t		jt;		/* relative to the next instruction, */
+	uint8_t		jf;		/* or FEXPR_RET_TRUE/FALSE */
+	uint8_t		field;
+	uint64_t	fmask;		/* width of the field */
+	uint64_t	sbit;		/* sign bit of signed fields */
+	uint64_t	mask;
+	uint64_t	lo;		/* match if value - lo <= range */
+	uint64_t	range;
+};
+
+#define FEXPR_RET_TRUE		0xff
+#define FEXPR_RET_FALSE		0xfe
+
+struct fexpr_prog {
+	struct fexpr_prog*	old;		/* list of replaced programs */
+	enum parse_depth	depth;		/* needed for the fields used */
+	unsigned int		len;
+	struct fexpr_insn	insn[];
+};
+
+/* returns NULL and logs the error if the expression is invalid */
+struct fexpr_prog* fexpr_compile(const char* expr);
+
+/* true if the packet matches */
+bool fexpr_run(const struct fexpr_prog* prog, const struct uwifi_packet* p);
+
+#if DEBUG
+void fexpr_dump(const struct fexpr_prog* prog);
+#endif
+
+/* compile and activate conf.filter_expr, an empty string removes it.
+ * returns false and keeps the previous program on errors */
+bool filter_expr_set(const char* expr);
+
+/* true if there is no filter expression or the packet matches it */
+bool filter_expr_match(const struct uwifi_packet* p);
+
+enum parse_depth filter_expr_depth(void);
+
+void filter_expr_free(void);
+
+#endif
@@ -0,0 +1,117 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * horst-logcat: convert a binary horst outfile (outfile_format=binary) to the
+ * CSV format of outfile_format=csv.
+ *
+ * usage: horst-logcat [file]	(default: stdin)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "outfile_reader.h"
+
+#define BUF_MAX		(64 * 1024 * 1024)
+
+static FILE* in;
+static unsigned char* buf;
+static size_t buf_len;
+static size_t buf_size;
+
+/* read more data, returns false at the end of the file */
+static bool fill(void)
+{
+	unsigned char* n;
+	size_t ret;
+
+	if (buf_len == buf_size) {
+		if (buf_size >= BUF_MAX)
+			return false;
+		n = realloc(buf, buf_size ? buf_size * 2 : 256 * 1024);
+		if (n == NULL)
+			return false;
+		buf = n;
+		buf_size = buf_size ? buf_size * 2 : 256 * 1024;
+	}
+
+	ret = fread(buf + buf_len, 1, buf_size - buf_len, in);
+	buf_len += ret;
+	return ret > 0;
+}
+
+static void consume(size_t len)
+{
+	memmove(buf, buf + len, buf_len - len);
+	buf_len -= len;
+}
+
+int main(int argc, char** argv)
+{
+	struct outfile_reader r;
+	struct outfile_rblock b;
+	ssize_t ret;
+	unsigned int i;
+
+	if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1] != '\0')) {
+		fprintf(stderr, "usage: %s [file]\n", argv[0]);
+		return 1;
+	}
+
+	if (argc == 2 && strcmp(argv[1], "-") != 0) {
+		in = fopen(argv[1], "rb");
+		if (in == NULL) {
+			perror(argv[1]);
+			return 1;
+		}
+	} else
+		in = stdin;
+
+	while ((ret = outfile_read_header(&r, buf, buf_len)) == 0 && fill())
+		;
+	if (ret <= 0) {
+		fprintf(stderr, "not a binary horst outfile\n");
+		return 1;
+	}
+	consume(ret);
+
+	printf(OUTFILE_CSV_HEADER);
+	for (;;) {
+		ret = outfile_read_block(&r, buf, buf_len, &b);
+		if (ret == 0) {
+			if (fill())
+				continue;
+			if (buf_len == 0)
+				break;
+		}
+		if (ret == OUTFILE_READ_END)
+			break;
+		if (ret <= 0) {
+			fprintf(stderr, "broken file\n");
+			return 1;
+		}
+
+		for (i = 0; i < b.hdr.records; i++)
+			outfile_print_csv(stdout, &r, &b, i);
+		consume(ret);
+	}
+	return 0;
+}
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
 
 #include "hutil.h"
 
@@ -74,3 +78,87 @@ int normalize(float oval, int max_val, int max) {
 		val = 0;
 	return val;
 }
+
+/* length of the UTF-8 character at s, 0 if it is not valid UTF-8. overlong
+ * forms, surrogates and code points above U+10FFFF are not valid */
+int utf8_char_len(const char* s)
+{
+	const unsigned char* c = (const unsigned char*)s;
+	unsigned int cp;
+	int len, i;
+
+	if (c[0] < 0x80)
+		return 1;
+	else if (c[0] >= 0xc2 && c[0] <= 0xdf) {
+		len = 2;
+		cp = c[0] & 0x1f;
+	} else if (c[0] >= 0xe0 && c[0] <= 0xef) {
+		len = 3;
+		cp = c[0] & 0x0f;
+	} else if (c[0] >= 0xf0 && c[0] <= 0xf4) {
+		len = 4;
+		cp = c[0] & 0x07;
+	} else
+		return 0;
+
+	/* also stops at the terminating NUL */
+	for (i = 1; i < len; i++) {
+		if ((c[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (c[i] & 0x3f);
+	}
+
+	if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+	    (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	return len;
+}
+
+/* number after the newest rotated file "BASE.N", which may have further
+ * suffixes like ".gz" or ".tmp". 0 if there is none */
+unsigned int file_next_seq(const char* base)
+{
+	char dir[PATH_MAX];
+	const char* name = strrchr(base, '/');
+	size_t len;
+	unsigned int next = 0;
+	unsigned long n;
+	struct dirent* de;
+	char* end;
+	DIR* d;
+
+	if (name == base) {
+		strcpy(dir, "/");
+		name++;
+	} else if (name != NULL) {
+		len = name - base;
+		if (len >= sizeof(dir))
+			return 0;
+		memcpy(dir, base, len);
+		dir[len] = '\0';
+		name++;
+	} else {
+		strcpy(dir, ".");
+		name = base;
+	}
+	len = strlen(name);
+
+	d = opendir(dir);
+	if (d == NULL)
+		return 0;
+
+	while ((de = readdir(d)) != NULL) {
+		if (strncmp(de->d_name, name, len) != 0 ||
+		    de->d_name[len] != '.' ||
+		    de->d_name[len + 1] < '0' || de->d_name[len + 1] > '9')
+			continue;
+		errno = 0;
+		n = strtoul(de->d_name + len + 1, &end, 10);
+		if (errno != 0 || n >= UINT_MAX || (*end != '\0' && *end != '.'))
+			continue;
+		if (n >= next)
+			next = n + 1;
+	}
+	closedir(d);
+	return next;
+}
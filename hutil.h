@@ -7,6 +7,8 @@ const char* mac_sprint_short(const unsigned char *mac);
 const char* ip_sprintf(const unsigned int ip);
 const char* ip_sprintf_short(const unsigned int ip);
 int normalize(float val, int max_val, int max);
+int utf8_char_len(const char* s);
+unsigned int file_next_seq(const char* base);
 
 static inline int normalize_db(int val, int max)
 {
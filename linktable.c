@@ -0,0 +1,335 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+
+#include <uwifi/util.h>
+#include <uwifi/wlan_util.h>
+
+#include "main.h"
+#include "linktable.h"
+
+/*
+ * Table of links (transmitter, receiver) for the airtime each pair of
+ * stations uses. The links are kept in an array of conf.link_max entries,
+ * which is allocated once, so the memory is bounded. They are found with an
+ * open addressing hash table of small slots, which keep the hash so that
+ * probing only touches the slot array. All links are on a list from the most
+ * to the least recently used, when the table is full the last one is reused.
+ * Only the main thread uses the table.
+ */
+
+#define LINK_NONE	UINT32_MAX
+
+struct link_slot {
+	uint32_t	hash;
+	uint32_t	idx;		/* link index + 1, 0 is free */
+};
+
+static struct link* links;
+static unsigned int link_cap;
+static unsigned int link_top;		/* links handed out so far */
+static unsigned int num_links;
+static uint32_t free_head = LINK_NONE;
+static uint32_t lru_head = LINK_NONE;
+static uint32_t lru_tail = LINK_NONE;
+
+static struct link_slot* slots;
+static unsigned int slot_mask;		/* at most half of the slots are used */
+
+static uint32_t link_hash(const unsigned char* src, const unsigned char* dst)
+{
+	uint64_t a = 0, b = 0;
+
+	memcpy(&a, src, WLAN_MAC_LEN);
+	memcpy(&b, dst, WLAN_MAC_LEN);
+
+	/* splitmix64 finalizer, as in macfilter.c */
+	a ^= b * 0x9e3779b97f4a7c15ULL;
+	a = (a ^ (a >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	a = (a ^ (a >> 27)) * 0x94d049bb133111ebULL;
+	return a ^ (a >> 31);
+}
+
+static void link_alloc(void)
+{
+	unsigned int size = 2;
+
+	link_cap = conf.link_max;
+	while (size < 2 * link_cap)
+		size <<= 1;
+
+	links = calloc(link_cap, sizeof(struct link));
+	slots = calloc(size, sizeof(struct link_slot));
+	if (links == NULL || slots == NULL)
+		err(1, "Could not allocate link table");
+	slot_mask = size - 1;
+}
+
+/* the slot of link 'src' to 'dst' or the free slot where it belongs */
+static struct link_slot* slot_find(uint32_t hash, const unsigned char* src,
+				   const unsigned char* dst)
+{
+	unsigned int i = hash & slot_mask;
+	struct link* l;
+
+	for (; slots[i].idx != 0; i = (i + 1) & slot_mask) {
+		if (slots[i].hash != hash)
+			continue;
+		l = &links[slots[i].idx - 1];
+		if (memcmp(l->src, src, WLAN_MAC_LEN) == 0 &&
+		    memcmp(l->dst, dst, WLAN_MAC_LEN) == 0)
+			break;
+	}
+	return &slots[i];
+}
+
+/* linear probing needs no tombstones when the following slots are moved
+ * back into the gap */
+static void slot_delete(struct link_slot* s)
+{
+	unsigned int j = s - slots;
+	unsigned int k = j;
+	unsigned int home;
+
+	for (;;) {
+		k = (k + 1) & slot_mask;
+		if (slots[k].idx == 0)
+			break;
+		home = slots[k].hash & slot_mask;
+		if (((k - home) & slot_mask) >= ((k - j) & slot_mask)) {
+			slots[j] = slots[k];
+			j = k;
+		}
+	}
+	slots[j].idx = 0;
+}
+
+static void lru_unlink(uint32_t i)
+{
+	struct link* l = &links[i];
+
+	if (l->lru_prev != LINK_NONE)
+		links[l->lru_prev].lru_next = l->lru_next;
+	else
+		lru_head = l->lru_next;
+
+	if (l->lru_next != LINK_NONE)
+		links[l->lru_next].lru_prev = l->lru_prev;
+	else
+		lru_tail = l->lru_prev;
+}
+
+static void lru_push(uint32_t i)
+{
+	struct link* l = &links[i];
+
+	l->lru_prev = LINK_NONE;
+	l->lru_next = lru_head;
+	if (lru_head != LINK_NONE)
+		links[lru_head].lru_prev = i;
+	else
+		lru_tail = i;
+	lru_head = i;
+}
+
+static void link_remove(uint32_t i)
+{
+	struct link* l = &links[i];
+
+	slot_delete(slot_find(link_hash(l->src, l->dst), l->src, l->dst));
+	lru_unlink(i);
+	l->lru_next = free_head;
+	free_head = i;
+	num_links--;
+}
+
+static uint32_t link_new(void)
+{
+	uint32_t i;
+
+	if (free_head == LINK_NONE)
+		return link_top++;
+
+	i = free_head;
+	free_head = links[i].lru_next;
+	return i;
+}
+
+void link_update(struct uwifi_packet* p)
+{
+	struct link_slot* s;
+	struct link* l;
+	uint32_t hash, i;
+
+	/* without a transmitter (ACK, CTS) the airtime is not on a link */
+	if (conf.link_max == 0 || (p->phy_flags & PHY_FLAG_BADFCS) ||
+	    MAC_EMPTY(p->wlan_src))
+		return;
+
+	if (links == NULL)
+		link_alloc();
+
+	hash = link_hash(p->wlan_src, p->wlan_dst);
+	s = slot_find(hash, p->wlan_src, p->wlan_dst);
+
+	if (s->idx != 0) {
+		i = s->idx - 1;
+		l = &links[i];
+		if (i != lru_head) {
+			lru_unlink(i);
+			lru_push(i);
+		}
+	} else {
+		/* full: reuse the least recently used link, removing it may
+		 * move the slots */
+		if (free_head == LINK_NONE && link_top == link_cap) {
+			link_remove(lru_tail);
+			s = slot_find(hash, p->wlan_src, p->wlan_dst);
+		}
+		i = link_new();
+		l = &links[i];
+		memset(l, 0, sizeof(struct link));
+		memcpy(l->src, p->wlan_src, WLAN_MAC_LEN);
+		memcpy(l->dst, p->wlan_dst, WLAN_MAC_LEN);
+		l->first_seen = time_mono.tv_sec;
+		s->hash = hash;
+		s->idx = i + 1;
+		lru_push(i);
+		num_links++;
+	}
+
+	l->packets++;
+	l->bytes += p->wlan_len;
+	l->duration += p->pkt_duration;
+	if (p->wlan_retry)
+		l->retries++;
+	if (p->phy_signal != 0)
+		l->signal = p->phy_signal;
+	if (p->phy_rate_idx > 0 && p->phy_rate_idx < MAX_RATES)
+		l->packets_per_rate[p->phy_rate_idx]++;
+	l->last_seen = time_mono.tv_sec;
+}
+
+/* the least recently used links are at the end of the list */
+void link_timeout(unsigned int timeout_sec)
+{
+	while (lru_tail != LINK_NONE &&
+	       links[lru_tail].last_seen < time_mono.tv_sec - (time_t)timeout_sec)
+		link_remove(lru_tail);
+}
+
+static int link_cmp(const void* a, const void* b)
+{
+	const struct link* la = *(const struct link**)a;
+	const struct link* lb = *(const struct link**)b;
+
+	if (la->duration != lb->duration)
+		return la->duration < lb->duration ? 1 : -1;
+	return (la->packets < lb->packets) - (la->packets > lb->packets);
+}
+
+struct link** link_sorted(unsigned int* count)
+{
+	struct link** arr = malloc((num_links + 1) * sizeof(struct link*));
+	unsigned int n = 0;
+	uint32_t i;
+
+	if (arr == NULL) {
+		*count = 0;
+		return NULL;
+	}
+
+	for (i = lru_head; i != LINK_NONE; i = links[i].lru_next)
+		arr[n++] = &links[i];
+	qsort(arr, n, sizeof(struct link*), link_cmp);
+	*count = n;
+	return arr;
+}
+
+int link_top_rate(const struct link* l, int* percent)
+{
+	unsigned long sum = 0;
+	int i, top = 0;
+
+	for (i = 1; i < MAX_RATES; i++) {
+		sum += l->packets_per_rate[i];
+		if (l->packets_per_rate[i] > l->packets_per_rate[top])
+			top = i;
+	}
+	*percent = sum ? l->packets_per_rate[top] * 100 / sum : 0;
+	return top;
+}
+
+/* as in the statistics view */
+const char* link_rate_name(int rate_idx)
+{
+	static char buf[12];
+
+	if (rate_idx <= 0 || rate_idx >= MAX_RATES)
+		return "-";
+	if (rate_idx <= 12)
+		snprintf(buf, sizeof(buf), "%dM", wlan_rate_to_rate(rate_idx) / 10);
+	else
+		snprintf(buf, sizeof(buf), "MCS%d", rate_idx - 12);
+	return buf;
+}
+
+void link_dump(FILE* fp)
+{
+	unsigned int i, count;
+	struct link** arr = link_sorted(&count);
+	struct link* l;
+	int r;
+
+	fprintf(fp, "# %u links, %lu usec airtime in total\n", count, stats.duration);
+	fprintf(fp, "# TRANSMITTER RECEIVER PACKETS BYTES RETRIES AIRTIME SIGNAL "
+		"FIRST_SEEN LAST_SEEN (sec ago) RATE:PACKETS...\n");
+
+	for (i = 0; i < count; i++) {
+		l = arr[i];
+		fprintf(fp, MAC_FMT " " MAC_FMT " %lu %lu %lu %lu %d %ld %ld",
+			MAC_PAR(l->src), MAC_PAR(l->dst), l->packets, l->bytes,
+			l->retries, l->duration, l->signal,
+			(long)(time_mono.tv_sec - l->first_seen),
+			(long)(time_mono.tv_sec - l->last_seen));
+		for (r = 1; r < MAX_RATES; r++) {
+			if (l->packets_per_rate[r] > 0)
+				fprintf(fp, " %s:%u", link_rate_name(r),
+					l->packets_per_rate[r]);
+		}
+		fputc('\n', fp);
+	}
+	free(arr);
+}
+
+void link_free(void)
+{
+	free(links);
+	free(slots);
+	links = NULL;
+	slots = NULL;
+	link_top = 0;
+	num_links = 0;
+	free_head = lru_head = lru_tail = LINK_NONE;
+}
@@ -0,0 +1,63 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _LINKTABLE_H_
+#define _LINKTABLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "main.h"
+
+struct uwifi_packet;
+
+/* traffic from one transmitter to one receiver */
+struct link {
+	unsigned char	src[WLAN_MAC_LEN];	/* transmitter */
+	unsigned char	dst[WLAN_MAC_LEN];	/* receiver */
+	uint32_t	lru_prev;		/* more recently used */
+	uint32_t	lru_next;		/* less recently used, or next free */
+	unsigned long	packets;
+	unsigned long	bytes;
+	unsigned long	retries;
+	unsigned long	duration;		/* usec airtime */
+	int		signal;			/* of the last packet */
+	time_t		first_seen;
+	time_t		last_seen;
+	uint32_t	packets_per_rate[MAX_RATES];
+};
+
+/* account packet to its link, the least recently used link is dropped when
+ * there are already conf.link_max */
+void link_update(struct uwifi_packet* p);
+
+void link_timeout(unsigned int timeout_sec);
+
+/* all links sorted by airtime, to be freed by the caller */
+struct link** link_sorted(unsigned int* count);
+
+/* the most used rate index of a link and its share in percent */
+int link_top_rate(const struct link* l, int* percent);
+const char* link_rate_name(int rate_idx);
+
+void link_dump(FILE* fp);
+void link_free(void);
+
+#endif
@@ -0,0 +1,280 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "macfilter.h"
+
+#define MACSET_USED		(1ULL << 63)
+#define MACSET_MIN_SIZE		16
+
+static uint64_t mac_key(const unsigned char* mac)
+{
+	return MACSET_USED |
+		(uint64_t)mac[0] << 40 | (uint64_t)mac[1] << 32 |
+		(uint64_t)mac[2] << 24 | (uint64_t)mac[3] << 16 |
+		(uint64_t)mac[4] << 8 | mac[5];
+}
+
+/* splitmix64 finalizer, vendor prefixes are very similar */
+static uint64_t key_mix(uint64_t k)
+{
+	k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	k = (k ^ (k >> 27)) * 0x94d049bb133111ebULL;
+	return k ^ (k >> 31);
+}
+
+static uint64_t* slot_find(uint64_t* slots, unsigned int mask, uint64_t key)
+{
+	unsigned int i = key_mix(key) & mask;
+
+	/* linear probing, the table is never more than half full */
+	while (slots[i] != 0 && slots[i] != key)
+		i = (i + 1) & mask;
+	return &slots[i];
+}
+
+static bool macset_grow(struct macset* s)
+{
+	unsigned int size = s->slots ? (s->mask + 1) * 2 : MACSET_MIN_SIZE;
+	uint64_t* n = calloc(size, sizeof(uint64_t));
+
+	if (n == NULL)
+		return false;
+
+	for (unsigned int i = 0; s->slots && i <= s->mask; i++) {
+		if (s->slots[i] != 0)
+			*slot_find(n, size - 1, s->slots[i]) = s->slots[i];
+	}
+	free(s->slots);
+	s->slots = n;
+	s->mask = size - 1;
+	return true;
+}
+
+bool macset_add(struct macset* s, const unsigned char* mac)
+{
+	uint64_t key = mac_key(mac);
+	uint64_t* slot;
+	uint64_t mix;
+
+	if ((s->slots == NULL || (s->count + 1) * 2 > s->mask + 1) &&
+	    !macset_grow(s))
+		return false;
+
+	slot = slot_find(s->slots, s->mask, key);
+	if (*slot == key)
+		return true;
+
+	*slot = key;
+	s->count++;
+	mix = key_mix(key ^ 0x5555555555555555ULL);
+	s->hash += mix ^ (mix >> 32);
+	return true;
+}
+
+bool macset_contains(const struct macset* s, const unsigned char* mac)
+{
+	uint64_t key;
+
+	if (s->count == 0)
+		return false;
+
+	key = mac_key(mac);
+	return *slot_find(s->slots, s->mask, key) == key;
+}
+
+void macset_free(struct macset* s)
+{
+	free(s->slots);
+	memset(s, 0, sizeof(struct macset));
+}
+
+static bool parse_mac(const char* str, unsigned char* mac)
+{
+	int n = 0;
+
+	if (sscanf(str, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx%n", &mac[0],
+		   &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &n) != 6)
+		return false;
+
+	str += n;
+	while (isspace((unsigned char)*str))
+		str++;
+	return *str == '\0' || *str == '#';
+}
+
+bool macset_load(struct macset* s, const char* filename)
+{
+	FILE* fp;
+	char line[256];
+	char* pos;
+	unsigned char mac[WLAN_MAC_LEN];
+	int linenum = 0;
+	bool ret = true;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		LOG_ERR("Could not open MAC list '%s'", filename);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		linenum++;
+
+		pos = line;
+		while (isspace((unsigned char)*pos))
+			pos++;
+		if (*pos == '\0' || *pos == '#')
+			continue;
+
+		if (!parse_mac(pos, mac)) {
+			LOG_ERR("%s:%d: Invalid MAC address", filename, linenum);
+			continue;
+		}
+		if (!macset_add(s, mac)) {
+			ret = false;
+			break;
+		}
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+/*
+ * The allow and deny sets of the packet filter. MACs from the allow file and
+ * the ones entered in the filter window (conf.filtermac) are kept in separate
+ * sets, so the window can change without reading the file again. Packets are
+ * filtered in the capture threads, so the sets are locked.
+ */
+
+static struct macset allow_set;
+static struct macset deny_set;
+static struct macset ui_set;
+static pthread_rwlock_t sets_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* call with sets_lock held */
+static void macfilter_conf_update(void)
+{
+	conf.filter_mac_count[0] = allow_set.count;
+	conf.filter_mac_hash[0] = allow_set.hash;
+	conf.filter_mac_count[1] = deny_set.count;
+	conf.filter_mac_hash[1] = deny_set.hash;
+	conf.do_macfilter = allow_set.count > 0 || deny_set.count > 0 ||
+			    ui_set.count > 0;
+}
+
+bool macfilter_load(bool deny, const char* filename)
+{
+	struct macset n = { 0 };
+	struct macset old;
+	struct macset* s = deny ? &deny_set : &allow_set;
+
+	if (filename != NULL && filename[0] != '\0') {
+		if (!macset_load(&n, filename)) {
+			macset_free(&n);
+			return false;
+		}
+		LOG_INF("Loaded %u MACs to %s from '%s'", n.count,
+			deny ? "deny" : "allow", filename);
+	}
+
+	pthread_rwlock_wrlock(&sets_lock);
+	old = *s;
+	*s = n;
+	macfilter_conf_update();
+	pthread_rwlock_unlock(&sets_lock);
+
+	macset_free(&old);
+	return true;
+}
+
+bool macfilter_reload(void)
+{
+	bool ret = macfilter_load(false, conf.filter_mac_allow);
+	return macfilter_load(true, conf.filter_mac_deny) && ret;
+}
+
+void macfilter_update(void)
+{
+	struct macset n = { 0 };
+	struct macset old;
+
+	for (int i = 0; i < MAX_FILTERMAC; i++) {
+		if (conf.filtermac_enabled[i] && MAC_NOT_EMPTY(conf.filtermac[i]))
+			macset_add(&n, conf.filtermac[i]);
+	}
+
+	pthread_rwlock_wrlock(&sets_lock);
+	old = ui_set;
+	ui_set = n;
+	macfilter_conf_update();
+	pthread_rwlock_unlock(&sets_lock);
+
+	macset_free(&old);
+}
+
+/* only MACs from the filter window on the source address are compiled into
+ * the socket filter, everything else is checked in macfilter_drop() */
+bool macfilter_simple(void)
+{
+	return conf.filter_mac_addr == MACFILTER_SRC &&
+	       allow_set.count == 0 && deny_set.count == 0;
+}
+
+bool macfilter_drop(struct uwifi_packet* p)
+{
+	const unsigned char* addr[3] = { p->wlan_src, p->wlan_dst, p->wlan_bssid };
+	bool allowed = false;
+	bool denied = false;
+	bool allow;
+
+	pthread_rwlock_rdlock(&sets_lock);
+	allow = allow_set.count > 0 || ui_set.count > 0;
+
+	for (int i = 0; i < 3 && !denied; i++) {
+		if (!(conf.filter_mac_addr & BIT(i)) || !MAC_NOT_EMPTY(addr[i]))
+			continue;
+		if (macset_contains(&deny_set, addr[i]))
+			denied = true;
+		else if (macset_contains(&allow_set, addr[i]) ||
+			 macset_contains(&ui_set, addr[i]))
+			allowed = true;
+	}
+
+	pthread_rwlock_unlock(&sets_lock);
+	return denied || (allow && !allowed);
+}
+
+void macfilter_free(void)
+{
+	pthread_rwlock_wrlock(&sets_lock);
+	macset_free(&allow_set);
+	macset_free(&deny_set);
+	macset_free(&ui_set);
+	pthread_rwlock_unlock(&sets_lock);
+}
@@ -0,0 +1,64 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _MACFILTER_H_
+#define _MACFILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <uwifi/util.h>
+
+struct uwifi_packet;
+
+/* open-addressing hash set of MAC addresses */
+struct macset {
+	uint64_t*	slots;		/* 48 bit MAC | MACSET_USED, 0 is free */
+	unsigned int	mask;
+	unsigned int	count;
+	uint32_t	hash;		/* of the content, independent of order */
+};
+
+bool macset_add(struct macset* s, const unsigned char* mac);
+bool macset_contains(const struct macset* s, const unsigned char* mac);
+void macset_free(struct macset* s);
+
+/* one MAC address per line, '#' starts a comment */
+bool macset_load(struct macset* s, const char* filename);
+
+/* addresses of a packet the MAC filter looks at (conf.filter_mac_addr) */
+#define MACFILTER_SRC		BIT(0)
+#define MACFILTER_DST		BIT(1)
+#define MACFILTER_BSSID		BIT(2)
+
+/* load allow or deny set from file, an empty name clears it */
+bool macfilter_load(bool deny, const char* filename);
+bool macfilter_reload(void);
+
+/* to be called after conf.filtermac[] changed */
+void macfilter_update(void);
+
+bool macfilter_simple(void);
+
+/* true if the MAC filter drops the packet */
+bool macfilter_drop(struct uwifi_packet* p);
+
+void macfilter_free(void);
+
+#endif
@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <err.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <net/if.h>
 
 #include <uwifi/packet_sock.h>
@@ -48,11 +50,25 @@
 #include "conf_options.h"
 #include "ieee80211_duration.h"
 #include "protocol_parser.h"
+#include "olsr.h"
+#include "batadv.h"
+#include "macfilter.h"
+#include "filter_expr.h"
+#include "linktable.h"
+#include "capture.h"
+#include "pkt_queue.h"
+#include "socket_filter.h"
+#include "pcap_reader.h"
+#include "pcap_writer.h"
+#include "outfile.h"
+#include "outfile_query.h"
+#include "analyze.h"
 
 struct list_head essids;
 struct history hist;
 struct statistics stats;
 struct channel_info spectrum[MAX_CHANNELS];
+struct uwifi_channels spectrum_channels;
 struct node_names_info node_names;
 
 struct config conf;
@@ -60,7 +76,12 @@ struct config conf;
 struct timespec time_mono;
 struct timespec time_real;
 
-static FILE* DF = NULL;
+/* CLOCK_MONOTONIC - CLOCK_REALTIME, to convert packet timestamps */
+static struct timespec mono_offset;
+static time_t mono_offset_sec;
+/* the time was taken from a packet in this wakeup */
+static bool packet_time;
+
 
 /* receive packet buffer
  *
@@ -69,25 +90,58 @@ static FILE* DF = NULL;
  * packets at one. thus we implement a buffered receive where partially received
  * data stays in the buffer.
  *
- * we need two buffers: one for packet capture or receiving from the server and
- * another one for data the clients sends to the server.
- *
- * not sure if this is also an issue with local packet capture, but it is not
- * implemented there.
+ * we need two buffers: one for receiving from the server and another one for
+ * data the clients sends to the server. local packet capture has its own
+ * buffers (see capture.c).
  *
- * size: max 80211 frame (2312) + space for prism2 header (144)
- * or radiotap header (usually only 26) + some extra */
-static unsigned char buffer[2312 + 200];
+ * the buffer is big enough for a whole batch of packets from the server. */
+static unsigned char* buffer;
+static size_t bufsize;
 static size_t buflen;
 
+/* local packet capture, one per interface or one per worker */
+static struct capture_intf {
+	struct capture		capt;
+	struct pkt_queue	queue;	/* from the capture thread, if enabled */
+	int			idx;	/* interface index */
+} capt_intf[MAX_INTERFACES * MAX_WORKERS];
+static int num_capt;
+
 /* for packets from client to server */
 static unsigned char cli_buffer[500];
 static size_t cli_buflen;
 
-/* for select */
-static fd_set read_fds;
-static fd_set write_fds;
-static fd_set excpt_fds;
+/* event loop: all fds stay registered with epoll, the event data tells us
+ * what it is. fds which the network and control code open and close are
+ * followed in event_sync() */
+enum event_type {
+	EV_STDIN,
+	EV_SERVER,		/* client mode: stream from the server */
+	EV_CAPTURE,		/* index into capt_intf */
+	EV_SRV_LISTEN,
+	EV_CLI_CONN,
+	EV_CTLPIPE,
+	EV_TIMER_CHANNEL,
+	EV_TIMER_NODES,
+	EV_TIMER_CLOCK,
+	EV_TIMER_REPLAY,
+	EV_TIMER_OUTFILE,
+};
+
+#define EV_DATA(type, idx)	((uint64_t)(type) << 32 | (uint32_t)(idx))
+#define EV_TYPE(data)		((enum event_type)((data) >> 32))
+#define EV_IDX(data)		((int)((data) & 0xffffffff))
+#define MAX_EVENTS		32
+
+static int epfd = -1;
+static int timer_channel = -1;
+static int timer_nodes = -1;
+static int timer_clock = -1;
+static int timer_replay = -1;
+static int timer_outfile = -1;
+
+/* registered srv_fd, cli_fd, ctlpipe */
+static int ev_fds[3] = { -1, -1, -1 };
 
 static volatile sig_atomic_t is_sigint_caught;
 
@@ -110,6 +164,34 @@ log_out(enum loglevel level, const char *fmt, ...)
 	}
 }
 
+static void clock_read(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &time_mono);
+	clock_gettime(CLOCK_REALTIME, &time_real);
+
+	mono_offset.tv_sec = time_mono.tv_sec - time_real.tv_sec;
+	mono_offset.tv_nsec = time_mono.tv_nsec - time_real.tv_nsec;
+	if (mono_offset.tv_nsec < 0) {
+		mono_offset.tv_sec--;
+		mono_offset.tv_nsec += 1000000000;
+	}
+	mono_offset_sec = time_mono.tv_sec;
+}
+
+/* local packets carry their kernel receive time, so we only need to read the
+ * clock after wakeups without packets, and once per second to follow changes
+ * of the wall clock */
+static void time_update(void)
+{
+	/* replay: virtual clock from the capture timestamps only */
+	if (conf.readfile[0] != '\0')
+		return;
+
+	if (!packet_time || time_mono.tv_sec != mono_offset_sec)
+		clock_read();
+	packet_time = false;
+}
+
 static void update_history(struct uwifi_packet* p)
 {
 	if (p->phy_signal == 0)
@@ -125,30 +207,30 @@ static void update_history(struct uwifi_packet* p)
 		hist.index = 0;
 }
 
-static void update_statistics(struct uwifi_packet* p)
+void update_statistics(struct statistics* s, struct uwifi_packet* p)
 {
 	int type = (p->phy_flags & PHY_FLAG_BADFCS) ? 1 : p->wlan_type;
 
 	if (p->phy_rate_idx == 0)
 		return;
 
-	stats.packets++;
-	stats.bytes += p->wlan_len;
+	s->packets++;
+	s->bytes += p->wlan_len;
 	if (p->wlan_retry)
-		stats.retries++;
+		s->retries++;
 
 	if (p->phy_rate_idx > 0 && p->phy_rate_idx < MAX_RATES) {
-		stats.duration += p->pkt_duration;
-		stats.packets_per_rate[p->phy_rate_idx]++;
-		stats.bytes_per_rate[p->phy_rate_idx] += p->wlan_len;
-		stats.duration_per_rate[p->phy_rate_idx] += p->pkt_duration;
+		s->duration += p->pkt_duration;
+		s->packets_per_rate[p->phy_rate_idx]++;
+		s->bytes_per_rate[p->phy_rate_idx] += p->wlan_len;
+		s->duration_per_rate[p->phy_rate_idx] += p->pkt_duration;
 	}
 
 	if (type >= 0 && type < MAX_FSTYPE) {
-		stats.packets_per_type[type]++;
-		stats.bytes_per_type[type] += p->wlan_len;
+		s->packets_per_type[type]++;
+		s->bytes_per_type[type] += p->wlan_len;
 		if (p->phy_rate_idx > 0 && p->phy_rate_idx < MAX_RATES)
-			stats.duration_per_type[type] += p->pkt_duration;
+			s->duration_per_type[type] += p->pkt_duration;
 	}
 }
 
@@ -196,47 +278,62 @@ static void update_spectrum(struct uwifi_packet* p, struct uwifi_node* n)
 	cn->packets++;
 }
 
-void update_spectrum_durations(void)
+void update_spectrum_durations(struct uwifi_interface* intf)
 {
+	int idx = spectrum_idx(intf, intf->channel_idx);
+
 	/* also if channel was not changed, keep stats only for every channel_time.
 	 * display code uses durations_last to get a more stable view */
-	if (conf.intf.channel_idx >= 0) {
-		spectrum[conf.intf.channel_idx].durations_last =
-				spectrum[conf.intf.channel_idx].durations;
-		spectrum[conf.intf.channel_idx].durations = 0;
-		ewma_add(&spectrum[conf.intf.channel_idx].durations_avg,
-			 spectrum[conf.intf.channel_idx].durations_last);
+	if (idx >= 0) {
+		spectrum[idx].durations_last = spectrum[idx].durations;
+		spectrum[idx].durations = 0;
+		ewma_add(&spectrum[idx].durations_avg, spectrum[idx].durations_last);
 	}
 }
 
-static void write_to_file(struct uwifi_packet* p)
+/* map a channel index of an interface to the merged spectrum */
+int spectrum_idx(struct uwifi_interface* intf, int chan_idx)
 {
-	char buf[40];
-	int i;
-	struct tm* ltm = localtime(&time_real.tv_sec);
-
-	//timestamp, e.g. 2015-05-16 15:05:44.338806 +0300
-	i = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", ltm);
-	i += snprintf(buf + i, sizeof(buf) - i, ".%06ld", (long)(time_real.tv_nsec / 1000));
-	i += strftime(buf + i, sizeof(buf) - i, " %z", ltm);
-	fprintf(DF, "%s, ", buf);
-
-	fprintf(DF, "%s, " MAC_FMT ", ",
-		wlan_get_packet_type_name(p->wlan_type), MAC_PAR(p->wlan_src));
-	fprintf(DF, MAC_FMT ", ", MAC_PAR(p->wlan_dst));
-	fprintf(DF, MAC_FMT ", ", MAC_PAR(p->wlan_bssid));
-	fprintf(DF, "%x, %d, %d, %d, %d, ",
-		p->pkt_types, p->phy_signal, p->wlan_len, p->phy_rate, p->phy_freq);
-	fprintf(DF, "%016llx, ", (unsigned long long)p->wlan_tsf);
-	fprintf(DF, "%s, %d, %d, %d, %d, %d, ",
-		p->wlan_essid, p->wlan_mode, p->wlan_channel,
-		p->wlan_wep, p->wlan_wpa, p->wlan_rsn);
-	fprintf(DF, "%s, %s\n", ip_sprintf(p->ip_src), ip_sprintf(p->ip_dst));
-	fflush(DF);
+	/* the primary interface's channels come first, in the same order */
+	if (intf == &conf.intf || chan_idx < 0)
+		return chan_idx;
+
+	return uwifi_channel_idx_from_freq(&spectrum_channels,
+			uwifi_channel_get_freq(&intf->channels, chan_idx));
+}
+
+/* build the list of channels of all interfaces, for the spectrum */
+void spectrum_channels_merge(void)
+{
+	struct uwifi_interface* intf;
+	const struct uwifi_band* band;
+	int i, n, freq, added;
+
+	spectrum_channels = conf.intf.channels;
+
+	for (i = 1; i < conf.num_intf; i++) {
+		intf = get_intf(i);
+		added = 0;
+		for (n = 0; n < uwifi_channel_get_num_channels(&intf->channels); n++) {
+			freq = uwifi_channel_get_freq(&intf->channels, n);
+			if (uwifi_channel_idx_from_freq(&spectrum_channels, freq) >= 0)
+				continue;
+			if (!uwifi_channel_list_add(&spectrum_channels, freq))
+				break;
+			added++;
+		}
+
+		/* one band per additional interface, for the network client */
+		band = uwifi_channel_get_band(&intf->channels, 0);
+		if (added > 0 && band != NULL)
+			uwifi_channel_band_add(&spectrum_channels, added,
+					       band->max_chan_width,
+					       band->streams_rx, band->streams_tx);
+	}
 }
 
 /* return true if packet is filtered */
-static bool filter_packet(struct uwifi_packet* p)
+static bool packet_is_filtered(struct uwifi_packet* p)
 {
 	int i;
 
@@ -246,74 +343,111 @@ static bool filter_packet(struct uwifi_packet* p)
 	/* if packets with bad FCS are not filtered, still we can not trust any
 	 * other header, so in any case return */
 	if (p->phy_flags & PHY_FLAG_BADFCS) {
-		if (!conf.filter_badfcs) {
-			stats.filtered_packets++;
-			return true;
-		}
-		return false;
+		return !conf.filter_badfcs;
 	}
 
 	/* filter by WLAN frame type and also type 3 which is not defined */
 	i = WLAN_FRAME_TYPE(p->wlan_type);
-	if (i == 3 || !(conf.filter_stype[i] & BIT(WLAN_FRAME_STYPE(p->wlan_type)))) {
-		stats.filtered_packets++;
+	if (i == 3 || !(conf.filter_stype[i] & BIT(WLAN_FRAME_STYPE(p->wlan_type))))
 		return true;
-	}
 
 	/* filter by MODE (AP, IBSS, ...) this also filters packets where we
 	 * cannot associate a mode (ACK, RTS/CTS) */
-	if (conf.filter_mode != WLAN_MODE_ALL && ((p->wlan_mode & ~conf.filter_mode) || p->wlan_mode == 0)) {
-		stats.filtered_packets++;
+	if (conf.filter_mode != WLAN_MODE_ALL && ((p->wlan_mode & ~conf.filter_mode) || p->wlan_mode == 0))
 		return true;
-	}
 
 	/* filter higher level packet types */
-	if (conf.filter_pkt != PKT_TYPE_ALL && (p->pkt_types & ~conf.filter_pkt)) {
-		stats.filtered_packets++;
+	if (conf.filter_pkt != PKT_TYPE_ALL && (p->pkt_types & ~conf.filter_pkt))
 		return true;
-	}
 
 	/* filter BSSID */
 	if (MAC_NOT_EMPTY(conf.filterbssid) &&
-	    memcmp(p->wlan_bssid, conf.filterbssid, WLAN_MAC_LEN) != 0) {
-		stats.filtered_packets++;
+	    memcmp(p->wlan_bssid, conf.filterbssid, WLAN_MAC_LEN) != 0)
 		return true;
-	}
 
 	/* filter MAC adresses */
-	if (conf.do_macfilter) {
-		for (i = 0; i < MAX_FILTERMAC; i++) {
-			if (MAC_NOT_EMPTY(p->wlan_src) &&
-			    conf.filtermac_enabled[i] &&
-			    memcmp(p->wlan_src, conf.filtermac[i], WLAN_MAC_LEN) == 0) {
-				return false;
-			}
-		}
-		stats.filtered_packets++;
+	if (conf.do_macfilter && macfilter_drop(p))
 		return true;
-	}
 
-	return false;
+	/* the expression is the most expensive, so it comes last */
+	return !filter_expr_match(p);
 }
 
-void handle_packet(struct uwifi_packet* p)
+static bool filter_packet(struct uwifi_packet* p)
 {
-	struct uwifi_node* n = NULL;
+	if (!packet_is_filtered(p))
+		return false;
 
-	/* filter on server side only */
-	if (conf.serveraddr[0] == '\0' && filter_packet(p)) {
-		if (!conf.quiet && !conf.paused && !conf.debug)
-			update_display_clock();
+	/* also called from the capture threads */
+	__atomic_add_fetch(&stats.filtered_packets, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+/* the deepest layer which can set a packet type the filter drops or which
+ * has a field the filter expression uses */
+static enum parse_depth filter_parse_depth(void)
+{
+	unsigned int drop = ~conf.filter_pkt & PKT_TYPE_ALL;
+	enum parse_depth depth;
+
+	if (conf.filter_off)
+		return PARSE_WLAN;
+
+	depth = parse_depth_for_pkt_types(drop);
+	if (filter_expr_depth() > depth)
+		depth = filter_expr_depth();
+	return depth;
+}
+
+/* only parse beyond 802.11 when someone uses the IP and mesh protocol
+ * fields: the outfile, a network client, the main and ESSID views or the
+ * packet filter. call again whenever one of them changes */
+void update_parse_depth(void)
+{
+	enum parse_depth depth = filter_parse_depth();
+
+	if (conf.dumpfile[0] != '\0' || cli_fd != -1 || conf.debug ||
+	    (!conf.quiet && display_shows_packet_details()))
+		depth = PARSE_ALL;
+
+	parse_set_depth(depth);
+}
+
+static void packet_duration(struct uwifi_packet* p)
+{
+	/* we can't trust any fields except phy_* of packets with bad FCS */
+	if (p->phy_flags & PHY_FLAG_BADFCS)
 		return;
-	}
 
-	uwifi_fixup_packet_channel(p, &conf.intf);
+	p->pkt_duration = ieee80211_frame_duration(
+			p->phy_flags & PHY_FLAG_MODE_MASK,
+			p->wlan_len, p->phy_rate,
+			p->phy_flags & PHY_FLAG_SHORTPRE,
+			0 /*shortslot*/, p->wlan_type,
+			p->wlan_qos_class,
+			p->wlan_retries);
+}
+
+/* local packets have been filtered already (see local_handle_frame) */
+void handle_packet(struct uwifi_packet* p, int intf_idx)
+{
+	struct uwifi_node* n = NULL;
+	struct uwifi_interface* intf = &conf.intf;
+
+	/* a client only knows the merged channel list of the server */
+	if (conf.serveraddr[0] == '\0')
+		intf = get_intf(intf_idx);
+	else
+		packet_duration(p);
+
+	uwifi_fixup_packet_channel(p, intf);
+	p->pkt_chan_idx = spectrum_idx(intf, p->pkt_chan_idx);
 
 	if (cli_fd != -1)
-		net_send_packet(p);
+		net_send_packet(p, intf_idx);
 
-	if (conf.dumpfile[0] != '\0' && !conf.paused && DF != NULL)
-		write_to_file(p);
+	if (conf.dumpfile[0] != '\0' && !conf.paused)
+		outfile_write(p, intf_idx, &time_real);
 
 	if (conf.paused)
 		return;
@@ -325,20 +459,16 @@ void handle_packet(struct uwifi_packet* p)
 			MAC_PAR(p->wlan_src), MAC_PAR(p->wlan_bssid));
 
 		n = uwifi_node_update(p, &conf.intf.wlan_nodes);
-		if (n)
+		if (n) {
+			/* time of reception, not of processing */
+			n->last_seen = time_mono.tv_sec;
 			uwifi_nodes_find_ap(n, &conf.intf.wlan_nodes);
-
-		p->pkt_duration = ieee80211_frame_duration(
-				p->phy_flags & PHY_FLAG_MODE_MASK,
-				p->wlan_len, p->phy_rate,
-				p->phy_flags & PHY_FLAG_SHORTPRE,
-				0 /*shortslot*/, p->wlan_type,
-				p->wlan_qos_class,
-				p->wlan_retries);
+		}
 	}
 
 	update_history(p);
-	update_statistics(p);
+	update_statistics(&stats, p);
+	link_update(p);
 	update_spectrum(p, n);
 	uwifi_essids_update(&essids, p, n);
 
@@ -346,93 +476,516 @@ void handle_packet(struct uwifi_packet* p)
 		update_display(p);
 }
 
-static void local_receive_packet(int fd, unsigned char* buffer, size_t bufsize)
+/* use the kernel receive time of the packet as current time */
+static void packet_time_set(const struct timespec* ts)
 {
-	struct uwifi_packet p;
-
-	LOG_DBG("===============================================================================");
-
-	ssize_t len = packet_socket_recv(fd, buffer, bufsize);
-	if (len <= 0) {
-		LOG_DBG("recv error");
+	if (ts == NULL || ts->tv_sec == 0)
 		return;
+
+	time_real = *ts;
+	time_mono.tv_sec = ts->tv_sec + mono_offset.tv_sec;
+	time_mono.tv_nsec = ts->tv_nsec + mono_offset.tv_nsec;
+	if (time_mono.tv_nsec >= 1000000000) {
+		time_mono.tv_sec++;
+		time_mono.tv_nsec -= 1000000000;
 	}
+	packet_time = true;
+}
+
+/* parse, filter and calculate airtime of a captured or replayed frame, this
+ * runs in the capture thread if enabled and in the analysis workers. 'ts' is
+ * the receive time, NULL if the kernel did not give one. returns false if it
+ * is dropped */
+bool frame_to_packet(unsigned char* buf, size_t len, size_t orig_len,
+		     int arphdr, const struct timespec* ts, struct uwifi_packet* p)
+{
+	struct timespec now;
+
+	LOG_DBG("===============================================================================");
 
 #if DEBUG
 	if (conf.debug) {
-		dump_hex(buffer, len, NULL);
+		dump_hex(buf, len, NULL);
 	}
 #endif
-	memset(&p, 0, sizeof(p));
+	memset(p, 0, sizeof(struct uwifi_packet));
+
+	/* time_real belongs to the main thread */
+	if (ts == NULL || ts->tv_sec == 0) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		ts = &now;
+	}
 
-	if (!parse_packet(buffer, len, &p)) {
+	if (!parse_packet(buf, len, p, arphdr, ts)) {
 		LOG_DBG("parsing failed");
-		return;
+		return false;
 	}
 
-	handle_packet(&p);
+	/* frame was truncated by snaplen: the headers are all there, but the
+	 * length has to be the one on the air for airtime and statistics */
+	if (orig_len > len)
+		p->wlan_len += orig_len - len;
+
+	/* filter on server side only */
+	if (filter_packet(p))
+		return false;
+
+	packet_duration(p);
+	return true;
 }
 
-static void receive_any(const sigset_t *const waitmask)
+/* keep the raw frame in the pcapng file, with the channel index in the merged
+ * spectrum and our airtime */
+static void record_frame(int intf_idx, int arphdr, unsigned char* buf,
+			 size_t len, size_t orig_len, const struct timespec* ts,
+			 struct uwifi_packet* p)
 {
-	int ret, mfd;
-	uint32_t usecs = UINT32_MAX;
-	struct timespec ts;
+	struct uwifi_interface* intf = get_intf(intf_idx);
+	int chan_idx;
 
-	FD_ZERO(&read_fds);
-	FD_ZERO(&write_fds);
-	FD_ZERO(&excpt_fds);
-	if (!conf.quiet && !conf.debug)
-		FD_SET(0, &read_fds);
-	FD_SET(conf.intf.sock, &read_fds);
-	if (srv_fd != -1)
-		FD_SET(srv_fd, &read_fds);
-	if (cli_fd != -1)
-		FD_SET(cli_fd, &read_fds);
-	if (ctlpipe != -1)
-		FD_SET(ctlpipe, &read_fds);
-
-	usecs = MIN(uwifi_channel_get_remaining_dwell_time(&conf.intf), 1000000);
-	ts.tv_sec = usecs / 1000000;
-	ts.tv_nsec = usecs % 1000000 * 1000;
-	mfd = MAX(conf.intf.sock, srv_fd);
-	mfd = MAX(mfd, ctlpipe);
-	mfd = MAX(mfd, cli_fd) + 1;
-
-	ret = pselect(mfd, &read_fds, &write_fds, &excpt_fds, &ts, waitmask);
-	if (ret == -1 && errno == EINTR) /* interrupted */
+	if (conf.pcapfile[0] == '\0' || conf.paused)
+		return;
+
+	if (p->phy_freq > 0)
+		chan_idx = uwifi_channel_idx_from_freq(&spectrum_channels, p->phy_freq);
+	else
+		chan_idx = spectrum_idx(intf, intf->channel_idx);
+
+	pcap_writer_frame(intf_idx, arphdr, buf, len, orig_len, ts,
+			  p->pkt_duration, p->phy_freq, chan_idx);
+}
+
+static void local_handle_frame(struct capture* c, unsigned char* buf,
+			       size_t len, size_t orig_len,
+			       const struct timespec* ts)
+{
+	struct capture_intf* ci = c->priv;
+	struct pkt_queue* q = conf.capture_thread ? &ci->queue : NULL;
+	struct pkt_queue_entry* e = NULL;
+	struct uwifi_packet pkt;
+	struct uwifi_packet* p = &pkt;
+
+	/* in the capture thread parse directly into the queue */
+	if (q != NULL) {
+		e = pkt_queue_reserve(q);
+		if (e == NULL)
+			return;
+		p = &e->pkt;
+	}
+
+	if (!frame_to_packet(buf, len, orig_len, get_intf(ci->idx)->arphdr, ts, p))
 		return;
-	if (ret == 0) { /* timeout */
+
+	record_frame(ci->idx, get_intf(ci->idx)->arphdr, buf, len, orig_len, ts, p);
+
+	if (q != NULL) {
+		if (ts != NULL)
+			e->ts = *ts;
+		else
+			e->ts.tv_sec = 0;
+		pkt_queue_commit(q);
+	} else {
+		packet_time_set(ts);
+		handle_packet(p, ci->idx);
+	}
+}
+
+static void local_capture_done(struct capture* c,
+			       __attribute__((unused)) int count)
+{
+	struct capture_intf* ci = c->priv;
+	pkt_queue_signal(&ci->queue);
+}
+
+/* handle packets from the capture thread */
+static void local_drain_queue(struct capture_intf* ci)
+{
+	struct pkt_queue* q = &ci->queue;
+	struct pkt_queue_entry* e;
+	unsigned int max = q->mask + 1;
+
+	/* clear the eventfd first, so we don't miss packets which are queued
+	 * while we are draining */
+	pkt_queue_wait_clear(q);
+
+	/* limit the work per wakeup, so housekeeping still happens when the
+	 * producer is faster than us */
+	while (max-- > 0 && (e = pkt_queue_peek(q)) != NULL) {
+		packet_time_set(&e->ts);
+		handle_packet(&e->pkt, ci->idx);
+		pkt_queue_release(q);
+	}
+
+	if (pkt_queue_depth(q) > 0)
+		pkt_queue_signal(q);
+}
+
+static void update_queue_statistics(void)
+{
+	struct pkt_queue* q;
+
+	stats.queue_depth = 0;
+	stats.queue_overflows = 0;
+	for (int i = 0; i < num_capt; i++) {
+		q = &capt_intf[i].queue;
+		stats.queue_depth += pkt_queue_depth(q);
+		stats.queue_depth_max = MAX(stats.queue_depth_max, q->depth_max);
+		stats.queue_overflows += pkt_queue_overflows(q);
+	}
+}
+
+/* the fd to wait for: the socket or the queue of the capture thread */
+static int local_capture_fd(struct capture_intf* ci)
+{
+	return ci->capt.thread_running ? ci->queue.efd : ci->capt.fd;
+}
+
+static void local_channel_auto_change(struct uwifi_interface* intf)
+{
+	int ret = uwifi_channel_auto_change(intf);
+
+	if (ret == 1) {
+		/* the network protocol only knows one channel */
+		if (intf == &conf.intf)
+			net_send_channel_config();
+		update_spectrum_durations(intf);
 		if (!conf.quiet && !conf.debug)
-			update_display_clock();
+			update_display(NULL);
+
+		if (intf->channel_idx == uwifi_channel_idx_from_freq(&intf->channels, intf->channel_set.freq)
+		    && intf->channel_scan_rounds > 0)
+			--intf->channel_scan_rounds;
+	} else if (ret == -1) {
+		LOG_ERR("Channel change failed. Disabling scan on '%s'",
+			 intf->ifname);
+		intf->channel_scan = false;
+		update_display(NULL);
+	}
+}
+
+static void event_add(int fd, enum event_type type, int idx)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_DATA(type, idx);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		err(1, "epoll_ctl");
+}
+
+/* follow fds opened and closed by the network and control code. A closed fd
+ * is removed from epoll by the kernel and its number may be reused at once,
+ * so remove all old ones first */
+static void event_sync(void)
+{
+	int fds[3] = { srv_fd, cli_fd, ctlpipe };
+	enum event_type types[3] = { EV_SRV_LISTEN, EV_CLI_CONN, EV_CTLPIPE };
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (ev_fds[i] != -1 && ev_fds[i] != fds[i]) {
+			/* fails when the fd was closed already */
+			epoll_ctl(epfd, EPOLL_CTL_DEL, ev_fds[i], NULL);
+			ev_fds[i] = -1;
+		}
+	}
+	for (i = 0; i < 3; i++) {
+		if (ev_fds[i] == -1 && fds[i] != -1) {
+			event_add(fds[i], types[i], 0);
+			ev_fds[i] = fds[i];
+		}
+	}
+}
+
+static int timer_open(enum event_type type)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd < 0)
+		err(1, "timerfd_create");
+	event_add(fd, type, 0);
+	return fd;
+}
+
+/* arm timer to expire in 'usecs' (0 disarms), periodic if 'interval' */
+static void timer_set(int fd, uint32_t usecs, bool interval)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = usecs / 1000000;
+	its.it_value.tv_nsec = usecs % 1000000 * 1000;
+	if (interval)
+		its.it_interval = its.it_value;
+	timerfd_settime(fd, 0, &its, NULL);
+}
+
+static void timer_ack(int fd)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		/* EAGAIN: already read */
+	}
+}
+
+/* wake up when the next interface has to change channel */
+static void channel_timer_update(void)
+{
+	uint32_t usecs = UINT32_MAX;
+
+	for (int i = 0; i < conf.num_intf && conf.serveraddr[0] == '\0'
+			&& conf.readfile[0] == '\0' && !conf.paused; i++) {
+		if (get_intf(i)->channel_scan)
+			usecs = MIN(usecs, uwifi_channel_get_remaining_dwell_time(get_intf(i)));
+	}
+
+	if (usecs == UINT32_MAX)
+		usecs = 0;
+	else if (usecs < 1000)
+		usecs = 1000;
+	timer_set(timer_channel, usecs, false);
+}
+
+/*
+ * Offline replay of a pcap file (-r). Frames are handled in batches from a
+ * timer, so the user interface stays responsive. The capture timestamps drive
+ * time_real and time_mono, and with replay_speed > 0 we wait until a frame is
+ * due at that speed.
+ */
+
+#define REPLAY_BATCH	4096
+
+static struct pcap_reader* replay_reader;
+static struct pcap_frame replay_frame;
+static bool replay_pending;		/* replay_frame not handled yet */
+static unsigned long replay_count;
+static struct timespec replay_first;	/* timestamp of the first frame */
+static struct timespec replay_start;	/* when the first frame was read */
+static bool replay_finished;
+
+static double timespec_diff(const struct timespec* a, const struct timespec* b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1000000000.0;
+}
+
+static void replay_end(const struct timespec* now)
+{
+	double secs = timespec_diff(now, &replay_start);
+
+	LOG_INF("Replay finished: %lu frames in %.3f sec (%.0f frames/sec)",
+		replay_count, secs, secs > 0 ? replay_count / secs : 0);
+	pcap_reader_close(replay_reader);
+	replay_reader = NULL;
+	replay_finished = true;
+}
+
+static void replay_run(void)
+{
+	struct uwifi_packet p;
+	struct pcap_frame* f = &replay_frame;
+	struct timespec now;
+	double wait;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (conf.paused) {
+		timer_set(timer_replay, 100000, false);
 		return;
 	}
-	else if (ret < 0) /* error */
-		err(1, "select()");
 
-	/* stdin */
-	if (FD_ISSET(0, &read_fds) && !conf.quiet && !conf.debug)
-		handle_user_input();
+	for (int n = 0; n < REPLAY_BATCH; n++) {
+		if (!replay_pending) {
+			ret = pcap_reader_next(replay_reader, f);
+			if (ret <= 0) {
+				replay_end(&now);
+				return;
+			}
+			if (replay_count == 0) {
+				replay_first = f->ts;
+				replay_start = now;
+			}
+			replay_pending = true;
+		}
+
+		if (conf.replay_speed > 0) {
+			wait = timespec_diff(&f->ts, &replay_first) / conf.replay_speed
+				- timespec_diff(&now, &replay_start);
+			if (wait > 0) {
+				timer_set(timer_replay, (uint32_t)(MIN(wait, 1.0) * 1000000) + 1, false);
+				return;
+			}
+		}
+
+		replay_pending = false;
+		replay_count++;
+		if (frame_to_packet(f->buf, f->len, f->orig_len, f->arphdr, &f->ts, &p)) {
+			record_frame(0, f->arphdr, f->buf, f->len, f->orig_len,
+				     &f->ts, &p);
+			packet_time_set(&f->ts);
+			handle_packet(&p, 0);
+		}
+	}
+
+	/* more frames are due, but let other events in first */
+	timer_set(timer_replay, 1, false);
+}
+
+/* there is no interface to ask, so assume all common channels */
+static void replay_init(void)
+{
+	static const int chan5[] = { 36, 40, 44, 48, 52, 56, 60, 64, 100, 104,
+		108, 112, 116, 120, 124, 128, 132, 136, 140, 144, 149, 153,
+		157, 161, 165 };
+	struct uwifi_channels* channels = &conf.intf.channels;
+	unsigned int i;
+
+	replay_reader = pcap_reader_open(conf.readfile);
+	if (replay_reader == NULL)
+		exit(1);
+
+	LOG_INF("Replaying '%s'", conf.readfile);
+
+	for (i = 1; i <= 14; i++)
+		uwifi_channel_list_add(channels, wlan_chan2freq(i));
+	uwifi_channel_band_add(channels, 14, CHAN_WIDTH_40, 1, 1);
+
+	for (i = 0; i < sizeof(chan5) / sizeof(chan5[0]); i++)
+		uwifi_channel_list_add(channels, wlan_chan2freq(chan5[i]));
+	uwifi_channel_band_add(channels, i, CHAN_WIDTH_80, 1, 1);
+
+	list_head_init(&conf.intf.wlan_nodes);
+	conf.num_intf = 1;
+	strncpy(conf.intf.ifname, "replay", IF_NAMESIZE);
+}
+
+static void event_init(void)
+{
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		err(1, "epoll_create1");
+
+	/* stdin may be the replay input */
+	if (!conf.quiet && !conf.debug && strcmp(conf.readfile, "-") != 0)
+		event_add(0, EV_STDIN, 0);
+
+	if (conf.readfile[0] != '\0') {
+		timer_replay = timer_open(EV_TIMER_REPLAY);
+		timer_set(timer_replay, 1, false);
+	} else if (conf.serveraddr[0] != '\0')
+		event_add(conf.intf.sock, EV_SERVER, 0);
+
+	/* after the capture threads are started */
+	for (int i = 0; i < num_capt; i++)
+		event_add(local_capture_fd(&capt_intf[i]), EV_CAPTURE, i);
+
+	event_sync();
+
+	timer_channel = timer_open(EV_TIMER_CHANNEL);
+	channel_timer_update();
+
+	/* libuwifi times out nodes by the system clock, which has nothing to
+	 * do with the time of a replay */
+	if (conf.readfile[0] == '\0') {
+		timer_nodes = timer_open(EV_TIMER_NODES);
+		timer_set(timer_nodes, 1000000, true);
+	}
+
+	if (!conf.quiet && !conf.debug) {
+		timer_clock = timer_open(EV_TIMER_CLOCK);
+		timer_set(timer_clock, 1000000, true);
+	}
+
+	/* the outfile may be opened later by the control pipe */
+	timer_outfile = timer_open(EV_TIMER_OUTFILE);
+	timer_set(timer_outfile, conf.outfile_flush * 1000, false);
+}
+
+static void event_handle(uint64_t data)
+{
+	struct capture_intf* ci;
 
-	/* local packet or client */
-	if (FD_ISSET(conf.intf.sock, &read_fds)) {
-		if (conf.serveraddr[0] != '\0')
-			net_receive(conf.intf.sock, buffer, &buflen, sizeof(buffer));
+	switch (EV_TYPE(data)) {
+	case EV_STDIN:
+		handle_user_input();
+		channel_timer_update();
+		break;
+	case EV_SERVER:
+		net_receive(conf.intf.sock, buffer, &buflen, bufsize);
+		break;
+	case EV_CAPTURE:
+		ci = &capt_intf[EV_IDX(data)];
+		if (ci->capt.thread_running)
+			local_drain_queue(ci);
 		else
-			local_receive_packet(conf.intf.sock, buffer, sizeof(buffer));
+			capture_receive(&ci->capt);
+		break;
+	case EV_SRV_LISTEN:
+		if (srv_fd != -1)
+			net_handle_server_conn();
+		break;
+	case EV_CLI_CONN:
+		/* from client to server */
+		if (cli_fd != -1)
+			net_receive(cli_fd, cli_buffer, &cli_buflen, sizeof(cli_buffer));
+		channel_timer_update();
+		break;
+	case EV_CTLPIPE:
+		if (ctlpipe != -1)
+			control_receive_command();
+		channel_timer_update();
+		break;
+	case EV_TIMER_CHANNEL:
+		timer_ack(timer_channel);
+		for (int i = 0; i < conf.num_intf && !conf.paused; i++)
+			local_channel_auto_change(get_intf(i));
+		channel_timer_update();
+		break;
+	case EV_TIMER_NODES:
+		timer_ack(timer_nodes);
+		uwifi_nodes_timeout(&conf.intf.wlan_nodes, conf.node_timeout,
+				    &conf.intf.last_nodetimeout);
+		olsr_orig_timeout(time_real.tv_sec, conf.node_timeout);
+		batadv_orig_timeout(time_real.tv_sec, conf.node_timeout);
+		link_timeout(conf.node_timeout);
+		break;
+	case EV_TIMER_CLOCK:
+		timer_ack(timer_clock);
+		update_display_clock();
+		break;
+	case EV_TIMER_REPLAY:
+		timer_ack(timer_replay);
+		replay_run();
+		break;
+	case EV_TIMER_OUTFILE:
+		timer_ack(timer_outfile);
+		outfile_flush();
+		timer_set(timer_outfile, conf.outfile_flush * 1000, false);
+		break;
 	}
+}
 
-	/* server */
-	if (srv_fd > -1 && FD_ISSET(srv_fd, &read_fds))
-		net_handle_server_conn();
+static void receive_any(const sigset_t *const waitmask)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int ret, i;
 
-	/* from client to server */
-	if (cli_fd > -1 && FD_ISSET(cli_fd, &read_fds))
-		net_receive(cli_fd, cli_buffer, &cli_buflen, sizeof(cli_buffer));
+	/* signals are only delivered while we wait here */
+	ret = epoll_pwait(epfd, events, MAX_EVENTS, -1, waitmask);
+	if (ret == -1 && errno == EINTR) /* interrupted */
+		return;
+	else if (ret < 0) /* error */
+		err(1, "epoll_pwait()");
 
-	/* named pipe */
-	if (ctlpipe > -1 && FD_ISSET(ctlpipe, &read_fds))
-		control_receive_command();
+	for (i = 0; i < ret; i++)
+		event_handle(events[i].data.u64);
+
+	if (conf.capture_thread)
+		update_queue_statistics();
+
+	pcap_writer_report_errors();
+	event_sync();
 }
 
 void free_lists(void)
@@ -440,7 +993,7 @@ void free_lists(void)
 	struct chan_node *cn, *cn2;
 
 	/* free channel nodes */
-	for (int i = 0; i < uwifi_channel_get_num_channels(&conf.intf.channels); i++) {
+	for (int i = 0; i < uwifi_channel_get_num_channels(&spectrum_channels); i++) {
 		list_for_each_safe(&spectrum[i].nodes, cn, cn2, chan_list) {
 			LOG_DBG("free chan_node %p", cn);
 			list_del(&cn->chan_list);
@@ -451,22 +1004,53 @@ void free_lists(void)
 
 	uwifi_nodes_free(&conf.intf.wlan_nodes);
 	uwifi_essids_free(&essids);
+	olsr_orig_free();
+	batadv_orig_free();
+	link_free();
 }
 
 static void exit_handler(void)
 {
 	free_lists();
+	macfilter_free();
+	filter_expr_free();
+
+	for (int i = 0; i < num_capt; i++) {
+		capture_close(&capt_intf[i].capt);
+		pkt_queue_free(&capt_intf[i].queue);
+		/* additional worker sockets */
+		if (capt_intf[i].capt.fd != get_intf(capt_intf[i].idx)->sock)
+			close(capt_intf[i].capt.fd);
+	}
+	free(buffer);
+	buffer = NULL;
+	pcap_writer_close();
+
+	if (epfd != -1) {
+		close(timer_channel);
+		if (timer_nodes != -1)
+			close(timer_nodes);
+		if (timer_clock != -1)
+			close(timer_clock);
+		if (timer_replay != -1)
+			close(timer_replay);
+		if (timer_outfile != -1)
+			close(timer_outfile);
+		close(epfd);
+		epfd = -1;
+	}
 
-	uwifi_fini(&conf.intf);
+	pcap_reader_close(replay_reader);
 
-	if (conf.monitor_added)
-		ifctrl_iwdel(conf.intf.ifname);
+	for (int i = 0; i < conf.num_intf && conf.readfile[0] == '\0'; i++) {
+		uwifi_fini(get_intf(i));
 
-	if (DF != NULL) {
-		fclose(DF);
-		DF = NULL;
+		if (conf.monitor_added & BIT(i))
+			ifctrl_iwdel(get_intf(i)->ifname);
 	}
 
+	outfile_close();
+
 	if (conf.allow_control)
 		control_finish();
 
@@ -570,6 +1154,82 @@ static void generate_mon_ifname(char *const buf, const size_t buf_size)
 	}
 }
 
+/* set up capture 'worker' of interface 'idx' */
+static void local_init_capture(int idx, int worker)
+{
+	struct uwifi_interface* intf = get_intf(idx);
+	struct capture_intf* ci = &capt_intf[num_capt++];
+	int fd = intf->sock;
+
+	/* the first worker uses the socket of the interface */
+	if (worker > 0) {
+		fd = packet_socket_open(intf->ifname);
+		if (fd < 0)
+			err(1, "Couldn't open packet socket for worker");
+	}
+
+	if (conf.recv_buffer_size)
+		socket_set_receive_buffer(fd, conf.recv_buffer_size);
+
+	if (conf.capture_thread && !pkt_queue_init(&ci->queue, conf.queue_size))
+		err(1, "Couldn't allocate packet queue");
+
+	ci->idx = idx;
+	if (!capture_open(&ci->capt, fd, local_handle_frame, ci))
+		err(1, "Couldn't allocate receive buffer");
+
+	/* spread packets over the workers by transmitter address */
+	if (conf.capture_workers > 1 &&
+	    !capture_fanout_join(fd, getpid() + idx, intf->arphdr))
+		err(1, "Couldn't join fanout group");
+
+	socket_filter_add(fd, intf->arphdr);
+}
+
+static void local_init_interface(int idx)
+{
+	struct uwifi_interface* intf = get_intf(idx);
+
+	intf->channel_idx = -1;
+
+	/* additional interfaces scan like the primary one, but on their own
+	 * channels */
+	if (intf != &conf.intf) {
+		intf->channel_scan = conf.intf.channel_scan;
+		intf->channel_scan_rounds = conf.intf.channel_scan_rounds;
+		intf->channel_time = conf.intf.channel_time;
+	}
+
+	ifctrl_iwget_interface_info(intf);
+
+	/* if the interface is not already in monitor mode, try to set
+	 * it to monitor or create an additional virtual monitor interface */
+	if (conf.add_monitor || (!ifctrl_is_monitor(intf) &&
+				 !ifctrl_iwset_monitor(intf->ifname))) {
+		char mon_ifname[IF_NAMESIZE];
+		generate_mon_ifname(mon_ifname, IF_NAMESIZE);
+		if (!ifctrl_iwadd_monitor(intf->ifname, mon_ifname))
+			err(1, "failed to add virtual monitor interface");
+
+		LOG_INF("A virtual interface '%s' will be used "
+			 "instead of '%s'.", mon_ifname, intf->ifname);
+
+		strncpy(intf->ifname, mon_ifname, IF_NAMESIZE);
+		conf.monitor_added |= BIT(idx);
+		/* Now we have a new monitor interface, proceed
+		 * normally. The interface will be deleted at exit. */
+	}
+
+	printf("SURVEY\n");
+	struct survey_info sinf[10];
+	ifctrl_iwget_survey(intf->ifname, sinf, 10);
+
+	uwifi_init(intf);
+
+	for (int w = 0; w < conf.capture_workers; w++)
+		local_init_capture(idx, w);
+}
+
 int main(int argc, char** argv)
 {
 	sigset_t workmask;
@@ -580,8 +1240,15 @@ int main(int argc, char** argv)
 	list_head_init(&essids);
 	init_spectrum();
 
+	protocol_parser_init();
 	config_parse_file_and_cmdline(argc, argv);
 
+	if (conf.query)
+		exit(outfile_query_run(conf.dumpfile));
+
+	if (conf.analyze)
+		exit(analyze_run());
+
 	sigint_action.sa_handler = sigint_handler;
 	sigemptyset(&sigint_action.sa_mask);
 	sigint_action.sa_flags = 0;
@@ -595,8 +1262,7 @@ int main(int argc, char** argv)
 	atexit(exit_handler);
 
 	clock_gettime(CLOCK_MONOTONIC, &stats.stats_time);
-	clock_gettime(CLOCK_MONOTONIC, &time_mono);
-	clock_gettime(CLOCK_REALTIME, &time_real);
+	clock_read();
 
 	conf.intf.channel_idx = -1;
 
@@ -608,38 +1274,23 @@ int main(int argc, char** argv)
 		control_init_pipe();
 	}
 
-	if (conf.serveraddr[0] != '\0')
+	if (conf.readfile[0] != '\0') {
+		replay_init();
+	} else if (conf.serveraddr[0] != '\0') {
 		conf.intf.sock = net_open_client_socket(conf.serveraddr, conf.port);
-	else {
+		/* read a whole batch of packet infos from the stream at once */
+		bufsize = net_receive_buffer_size(conf.recv_batch);
+	} else {
 		ifctrl_init();
-		ifctrl_iwget_interface_info(&conf.intf);
-
-		/* if the interface is not already in monitor mode, try to set
-		 * it to monitor or create an additional virtual monitor interface */
-		if (conf.add_monitor || (!ifctrl_is_monitor(&conf.intf) &&
-					 !ifctrl_iwset_monitor(conf.intf.ifname))) {
-			char mon_ifname[IF_NAMESIZE];
-			generate_mon_ifname(mon_ifname, IF_NAMESIZE);
-			if (!ifctrl_iwadd_monitor(conf.intf.ifname, mon_ifname))
-				err(1, "failed to add virtual monitor interface");
-
-			LOG_INF("A virtual interface '%s' will be used "
-				 "instead of '%s'.", mon_ifname, conf.intf.ifname);
-
-			strncpy(conf.intf.ifname, mon_ifname, IF_NAMESIZE);
-			conf.monitor_added = 1;
-			/* Now we have a new monitor interface, proceed
-			 * normally. The interface will be deleted at exit. */
-		}
-
-		printf("SURVEY\n");
-		struct survey_info sinf[10];
-		ifctrl_iwget_survey(conf.intf.ifname, sinf, 10);
-
-		uwifi_init(&conf.intf);
+		for (int i = 0; i < conf.num_intf; i++)
+			local_init_interface(i);
+	}
+	spectrum_channels_merge();
 
-		if (conf.recv_buffer_size)
-			socket_set_receive_buffer(conf.intf.sock, conf.recv_buffer_size);
+	if (bufsize > 0) {
+		buffer = malloc(bufsize);
+		if (buffer == NULL)
+			err(1, "Couldn't allocate receive buffer");
 	}
 
 	printf("Max PHY rate: %d Mbps\n", conf.intf.max_phy_rate/10);
@@ -650,10 +1301,12 @@ int main(int argc, char** argv)
 	if (conf.serveraddr[0] == '\0' && conf.port && conf.allow_client)
 		net_init_server_socket(conf.port);
 
+	update_parse_depth();
+
 	/* Race-free signal handling:
 	 *   1. block all handled signals while working (with workmask)
-	 *   2. receive signals *only* while waiting in pselect() (with waitmask)
-	 *   3. switch between these two masks atomically with pselect()
+	 *   2. receive signals *only* while waiting in epoll_pwait() (with waitmask)
+	 *   3. switch between these two masks atomically with epoll_pwait()
 	 */
 	if (sigemptyset(&workmask)                       == -1 ||
 	    sigaddset(&workmask, SIGINT)                 == -1 ||
@@ -662,6 +1315,16 @@ int main(int argc, char** argv)
 	    sigprocmask(SIG_BLOCK, &workmask, &waitmask) == -1)
 		err(1, "failed to block signals: %m");
 
+	for (int i = 0; i < num_capt && conf.capture_thread; i++) {
+		if (!capture_thread_start(&capt_intf[i].capt, local_capture_done))
+			err(1, "Couldn't start capture thread");
+		LOG_INF("Capturing on '%s' in separate thread (queue size %u)",
+			get_intf(capt_intf[i].idx)->ifname,
+			capt_intf[i].queue.mask + 1);
+	}
+
+	event_init();
+
 	while (!conf.intf.channel_scan || conf.intf.channel_scan_rounds != 0)
 	{
 		receive_any(&waitmask);
@@ -669,29 +1332,12 @@ int main(int argc, char** argv)
 		if (is_sigint_caught)
 			exit(1);
 
-		clock_gettime(CLOCK_MONOTONIC, &time_mono);
-		clock_gettime(CLOCK_REALTIME, &time_real);
-		uwifi_nodes_timeout(&conf.intf.wlan_nodes, conf.node_timeout,
-				    &conf.intf.last_nodetimeout);
+		/* without user interface we are done */
+		if (replay_finished && (conf.quiet || conf.debug))
+			exit(0);
 
-		if (conf.serveraddr[0] == '\0' /* server */ && !conf.paused) {
-			int ret = uwifi_channel_auto_change(&conf.intf);
-			if (ret == 1) {
-				net_send_channel_config();
-				update_spectrum_durations();
-				if (!conf.quiet && !conf.debug)
-					update_display(NULL);
-
-				if (conf.intf.channel_idx == uwifi_channel_idx_from_freq(&conf.intf.channels, conf.intf.channel_set.freq)
-				    && conf.intf.channel_scan_rounds > 0)
-					--conf.intf.channel_scan_rounds;
-			} else if (ret == -1) {
-				LOG_ERR("Channel change failed. Disabling scan on '%s'",
-					 conf.intf.ifname);
-				conf.intf.channel_scan = false;
-				update_display(NULL);
-			}
-		}
+		/* channel changes and node timeouts are driven by timers */
+		time_update();
 	}
 	return 0;
 }
@@ -716,33 +1362,6 @@ void main_reset(void)
 	clock_gettime(CLOCK_REALTIME, &time_real);
 }
 
-void dumpfile_open(const char* name)
-{
-	if (DF != NULL) {
-		fclose(DF);
-		DF = NULL;
-	}
-
-	if (name == NULL || strlen(name) == 0) {
-		LOG_INF("- Not writing outfile");
-		conf.dumpfile[0] = '\0';
-		return;
-	}
-
-	strncpy(conf.dumpfile, name, MAX_CONF_VALUE_STRLEN);
-	conf.dumpfile[MAX_CONF_VALUE_STRLEN] = '\0';
-	DF = fopen(conf.dumpfile, "w");
-	if (DF == NULL)
-		err(1, "Couldn't open dump file");
-
-	fprintf(DF, "TIME, WLAN TYPE, MAC SRC, MAC DST, BSSID, PACKET TYPES, SIGNAL, ");
-	fprintf(DF, "LENGTH, PHY RATE, FREQUENCY, TSF, ESSID, MODE, CHANNEL, ");
-	fprintf(DF, "WEP, WPA1, RSN (WPA2), IP SRC, IP DST\n");
-
-	LOG_INF("- Writing to outfile %s", conf.dumpfile);
-}
-
-
 #if 0
 void print_rate_duration_table(void)
 {
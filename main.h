@@ -38,6 +38,13 @@
 #define MAX_RATES		44	/* 12 legacy rates and 32 MCS */
 #define MAX_FSTYPE		0xff
 
+/* max 80211 frame (2312) + space for prism2 header (144)
+ * or radiotap header (usually only 26) + some extra */
+#define MAX_FRAME_LEN		(2312 + 200)
+
+#define MAX_INTERFACES		4
+#define MAX_WORKERS		8	/* capture sockets per interface */
+
 #define MAX_NODE_NAME_STRLEN	18
 #define MAX_NODE_NAMES		64
 
@@ -50,10 +57,14 @@
 #define PKT_TYPE_OLSR		BIT(5)
 #define PKT_TYPE_BATMAN		BIT(6)
 #define PKT_TYPE_MESHZ		BIT(7)
+/* protocols of custom dissectors (dissector_udp, dissector_ether) */
+#define PKT_TYPE_CUSTOM_FIRST	BIT(8)
+#define PKT_TYPE_CUSTOM		0xff00
 
 #define PKT_TYPE_ALL		(PKT_TYPE_ARP | PKT_TYPE_IP | PKT_TYPE_ICMP | \
 				 PKT_TYPE_UDP | PKT_TYPE_TCP | \
-				 PKT_TYPE_OLSR | PKT_TYPE_BATMAN | PKT_TYPE_MESHZ)
+				 PKT_TYPE_OLSR | PKT_TYPE_BATMAN | PKT_TYPE_MESHZ | \
+				 PKT_TYPE_CUSTOM)
 
 #define DEFAULT_MAC_NAME_FILE	"/tmp/dhcp.leases"
 
@@ -62,23 +73,54 @@
 #define MAX_FILTERMAC		9
 
 struct config {
-	struct uwifi_interface	intf;
+	struct uwifi_interface	intf;		/* primary interface */
+	struct uwifi_interface	intf_extra[MAX_INTERFACES - 1];
+	int			num_intf;
 	int			port;
 	int			quiet;
 	int			display_interval;
 	char			display_view;
 	char			dumpfile[MAX_CONF_VALUE_STRLEN + 1];
+	unsigned int		outfile_format;
+	unsigned int		outfile_buffer;
+	unsigned int		outfile_flush;		/* ms */
+	unsigned int		outfile_policy;
+	unsigned int		outfile_rotate_size;	/* MiB */
+	unsigned int		outfile_rotate_time;	/* seconds */
+	unsigned int		outfile_rotate_files;	/* 0: keep all */
+	int			outfile_compress;	/* zlib level, 0: off */
+	char			pcapfile[MAX_CONF_VALUE_STRLEN + 1];
+	unsigned int		pcap_rotate_size;	/* MiB */
+	unsigned int		pcap_rotate_time;	/* seconds */
+	unsigned int		pcap_rotate_files;	/* 0: keep all */
 	int			recv_buffer_size;
+	unsigned int		ring_size;
+	unsigned int		ring_block_timeout;
+	unsigned int		recv_batch;
+	unsigned int		snaplen;
+	unsigned int		queue_size;
+	int			capture_workers;
 	char			serveraddr[MAX_CONF_VALUE_STRLEN + 1];
 	char			control_pipe[MAX_CONF_VALUE_STRLEN + 1];
 	char			mac_name_file[MAX_CONF_VALUE_STRLEN + 1];
+	char			readfile[MAX_CONF_VALUE_STRLEN + 1];
+	double			replay_speed;	/* 0: as fast as possible */
+	int			analyze_threads;	/* 0: one per CPU */
+	unsigned int		analyze_format;
 
 	unsigned char		filtermac[MAX_FILTERMAC][WLAN_MAC_LEN];
 	char			filtermac_enabled[MAX_FILTERMAC];
+	char			filter_mac_allow[MAX_CONF_VALUE_STRLEN + 1];
+	char			filter_mac_deny[MAX_CONF_VALUE_STRLEN + 1];
+	unsigned int		filter_mac_addr;	/* MACFILTER_SRC, ... */
+	/* allow [0] and deny [1] sets, on a client from the server */
+	unsigned int		filter_mac_count[2];
+	uint32_t		filter_mac_hash[2];
 	unsigned char		filterbssid[WLAN_MAC_LEN];
 	unsigned int		filter_pkt;
 	uint16_t		filter_stype[WLAN_NUM_TYPES];  /* one for MGMT, CTRL, DATA */
 	unsigned int		filter_mode;
+	char			filter_expr[MAX_CONF_VALUE_STRLEN + 1];
 	unsigned int		filter_off:1,
 				filter_badfcs:1,
 				allow_client:1,
@@ -86,16 +128,26 @@ struct config {
 				debug:1,
 				mac_name_lookup:1,
 				add_monitor:1,
+				capture_thread:1,
+				query:1,
+				analyze:1,
 	/* this isn't exactly config, but wtf... */
 				do_macfilter:1,
-				display_initialized:1,
-				monitor_added:1;
+				display_initialized:1;
+	unsigned int		monitor_added;	/* bitmask of interfaces */
 	int			paused;
 	unsigned int		node_timeout;
+	unsigned int		link_max;
 };
 
 extern struct config conf;
 
+/* all nodes are kept in the list of the primary interface (index 0) */
+static inline struct uwifi_interface* get_intf(int idx)
+{
+	return idx == 0 ? &conf.intf : &conf.intf_extra[idx - 1];
+}
+
 struct history {
 	int			signal[MAX_HISTORY];
 	int			rate[MAX_HISTORY];
@@ -122,6 +174,11 @@ struct statistics {
 
 	unsigned long		filtered_packets;
 
+	/* queue between capture thread and main thread */
+	unsigned int		queue_depth;
+	unsigned int		queue_depth_max;
+	unsigned long		queue_overflows;
+
 	struct timespec		stats_time;
 };
 
@@ -141,6 +198,9 @@ struct channel_info {
 
 extern struct channel_info spectrum[MAX_CHANNELS];
 
+/* channels of all interfaces, the index into spectrum[] */
+extern struct uwifi_channels spectrum_channels;
+
 /* helper for keeping lists of nodes for each channel
  * (a node can be on more than one channel) */
 struct chan_node {
@@ -170,11 +230,16 @@ extern struct list_head essids;
 
 void free_lists(void);
 void init_spectrum(void);
-void update_spectrum_durations(void);
-void handle_packet(struct uwifi_packet* p);
+void update_spectrum_durations(struct uwifi_interface* intf);
+int spectrum_idx(struct uwifi_interface* intf, int chan_idx);
+void spectrum_channels_merge(void);
+void handle_packet(struct uwifi_packet* p, int intf_idx);
+bool frame_to_packet(unsigned char* buf, size_t len, size_t orig_len,
+		     int arphdr, const struct timespec* ts, struct uwifi_packet* p);
+void update_statistics(struct statistics* s, struct uwifi_packet* p);
+void update_parse_depth(void);
 void main_pause(int pause);
 void main_reset(void);
-void dumpfile_open(const char* name);
 const char* mac_name_lookup(const unsigned char* mac, int shorten_mac);
 
 #endif
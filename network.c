@@ -36,6 +36,9 @@
 #include "main.h"
 #include "network.h"
 #include "display.h"
+#include "socket_filter.h"
+#include "macfilter.h"
+#include "filter_expr.h"
 
 extern struct config conf;
 
@@ -43,7 +46,7 @@ int srv_fd = -1;
 int cli_fd = -1;
 static int netmon_fd;
 
-#define PROTO_VERSION	4
+#define PROTO_VERSION	6
 
 enum pkt_type {
 	PROTO_PKT_INFO		= 0,
@@ -84,6 +87,14 @@ struct net_conf_filter {
 #define NET_FILTER_OFF		0x01
 #define NET_FILTER_BADFCS	0x02
 	unsigned char	filter_flags;
+
+	/* MAC allow and deny sets stay on the server, only their size and
+	 * content hash are sent */
+	unsigned char	filter_mac_addr;
+	uint32_t	filter_mac_count[2];
+	uint32_t	filter_mac_hash[2];
+
+	char		filter_expr[MAX_CONF_VALUE_STRLEN + 1];
 } __attribute__ ((packed));
 
 struct net_band {
@@ -101,7 +112,7 @@ struct net_chan_list {
 	unsigned int freq[1];
 } __attribute__ ((packed));
 
-#define PKT_INFO_VERSION	2
+#define PKT_INFO_VERSION	3
 
 struct net_packet_info {
 	struct net_header	proto;
@@ -157,6 +168,8 @@ struct net_packet_info {
 #define PKT_BAT_FLAG_GW		0x1
 	unsigned char		bat_flags;
 	unsigned char		bat_pkt_type;
+
+	unsigned char		intf_idx;	/* capture interface on server */
 } __attribute__ ((packed));
 
 static bool net_write(int fd, unsigned char* buf, size_t len)
@@ -167,8 +180,10 @@ static bool net_write(int fd, unsigned char* buf, size_t len)
 		if (errno == EPIPE) {
 			LOG_INF("Client has closed");
 			close(fd);
-			if (fd == cli_fd)
+			if (fd == cli_fd) {
 				cli_fd = -1;
+				update_parse_depth();
+			}
 			net_init_server_socket(conf.port);
 		}
 		else
@@ -178,7 +193,7 @@ static bool net_write(int fd, unsigned char* buf, size_t len)
 	return true;
 }
 
-void net_send_packet(struct uwifi_packet *p)
+void net_send_packet(struct uwifi_packet *p, int intf_idx)
 {
 	struct net_packet_info np;
 
@@ -231,6 +246,7 @@ void net_send_packet(struct uwifi_packet *p)
 	if (p->bat_gw)
 		np.bat_flags |= PKT_BAT_FLAG_GW;
 	np.bat_pkt_type = p->bat_packet_type;
+	np.intf_idx	= intf_idx;
 
 	net_write(cli_fd, (unsigned char *)&np, sizeof(np));
 }
@@ -296,7 +312,7 @@ static int net_receive_packet(unsigned char *buffer, size_t len)
 		p.bat_gw = 1;
 	p.bat_packet_type = np->bat_pkt_type;
 
-	handle_packet(&p);
+	handle_packet(&p, np->intf_idx);
 
 	return sizeof(struct net_packet_info);
 }
@@ -351,7 +367,7 @@ static int net_receive_conf_chan(unsigned char *buffer, size_t len)
 		} else { /* client */
 			conf.intf.channel_idx = uwifi_channel_idx_from_freq(&conf.intf.channels, ch.freq);
 			conf.intf.channel = conf.intf.channel_set = ch;
-			update_spectrum_durations();
+			update_spectrum_durations(&conf.intf);
 			update_display(NULL);
 		}
 	}
@@ -385,6 +401,15 @@ static void net_send_conf_filter(int fd)
 	if (conf.filter_badfcs)
 		nc.filter_flags |= NET_FILTER_BADFCS;
 
+	nc.filter_mac_addr = conf.filter_mac_addr;
+	for (i = 0; i < 2; i++) {
+		nc.filter_mac_count[i] = htole32(conf.filter_mac_count[i]);
+		nc.filter_mac_hash[i] = htole32(conf.filter_mac_hash[i]);
+	}
+
+	strncpy(nc.filter_expr, conf.filter_expr, MAX_CONF_VALUE_STRLEN);
+	nc.filter_expr[MAX_CONF_VALUE_STRLEN] = '\0';
+
 	net_write(fd, (unsigned char *)&nc, sizeof(nc));
 }
 
@@ -412,6 +437,29 @@ static int net_receive_conf_filter(unsigned char *buffer, size_t len)
 	conf.filter_mode = le32toh(nc->filter_mode);
 	conf.filter_off = !!(nc->filter_flags & NET_FILTER_OFF);
 	conf.filter_badfcs = !!(nc->filter_flags & NET_FILTER_BADFCS);
+	conf.filter_mac_addr = nc->filter_mac_addr;
+
+	macfilter_update();
+
+	/* only recompile when it changed */
+	nc->filter_expr[MAX_CONF_VALUE_STRLEN] = '\0';
+	if (strcmp(nc->filter_expr, conf.filter_expr) != 0) {
+		if (filter_expr_set(nc->filter_expr))
+			strcpy(conf.filter_expr, nc->filter_expr);
+	}
+
+	/* a client shows the MAC sets of the server */
+	if (conf.serveraddr[0] != '\0') {
+		for (i = 0; i < 2; i++) {
+			conf.filter_mac_count[i] = le32toh(nc->filter_mac_count[i]);
+			conf.filter_mac_hash[i] = le32toh(nc->filter_mac_hash[i]);
+			if (conf.filter_mac_count[i] > 0)
+				conf.do_macfilter = 1;
+		}
+	}
+
+	socket_filter_update();
+	update_parse_depth();
 
 	return sizeof(struct net_conf_filter);
 }
@@ -423,7 +471,7 @@ static void net_send_chan_list(int fd)
 	int i;
 
 	buf = malloc(sizeof(struct net_chan_list) +
-		     sizeof(unsigned int) * (uwifi_channel_get_num_channels(&conf.intf.channels) - 1));
+		     sizeof(unsigned int) * (uwifi_channel_get_num_channels(&spectrum_channels) - 1));
 	if (buf == NULL)
 		return;
 
@@ -431,18 +479,18 @@ static void net_send_chan_list(int fd)
 	nc->proto.version = PROTO_VERSION;
 	nc->proto.type	= PROTO_CHAN_LIST;
 
-	nc->num_bands = uwifi_channel_get_num_bands(&conf.intf.channels);
+	nc->num_bands = uwifi_channel_get_num_bands(&spectrum_channels);
 	for (i = 0; i < nc->num_bands; i++) {
-		const struct uwifi_band* bp = uwifi_channel_get_band(&conf.intf.channels, i);
+		const struct uwifi_band* bp = uwifi_channel_get_band(&spectrum_channels, i);
 		nc->band[i].num_chans = bp->num_channels;
 		nc->band[i].max_width = bp->max_chan_width;
 		nc->band[i].streams_rx = bp->streams_rx;
 		nc->band[i].streams_tx = bp->streams_tx;
 	}
 
-	for (i = 0; i < uwifi_channel_get_num_channels(&conf.intf.channels); i++) {
-		nc->freq[i] = htole32(uwifi_channel_get_freq(&conf.intf.channels, i));
-		LOG_DBG("NET send freq %d %d", i, uwifi_channel_get_freq(&conf.intf.channels, i));
+	for (i = 0; i < uwifi_channel_get_num_channels(&spectrum_channels); i++) {
+		nc->freq[i] = htole32(uwifi_channel_get_freq(&spectrum_channels, i));
+		LOG_DBG("NET send freq %d %d", i, uwifi_channel_get_freq(&spectrum_channels, i));
 	}
 
 	net_write(fd, (unsigned char *)buf, sizeof(struct net_chan_list) +
@@ -473,6 +521,7 @@ static int net_receive_chan_list(unsigned char *buffer, size_t len)
 		uwifi_channel_list_add(&conf.intf.channels, le32toh(nc->freq[i]));
 		LOG_DBG("NET recv freq %d %d", i, le32toh(nc->freq[i]));
 	}
+	spectrum_channels_merge();
 	init_spectrum();
 	return sizeof(struct net_chan_list) + sizeof(unsigned int) * (num_chans - 1);
 }
@@ -507,6 +556,14 @@ static int try_receive_packet(unsigned char* buf, size_t len)
 	return len; /* the number of bytes we have consumed */
 }
 
+/* buffer size to receive 'batch' packet infos with one recv(), but in any
+ * case big enough for the biggest message, the channel list */
+size_t net_receive_buffer_size(unsigned int batch)
+{
+	size_t len = sizeof(struct net_chan_list) + sizeof(unsigned int) * MAX_CHANNELS;
+	return MAX(len, batch * sizeof(struct net_packet_info));
+}
+
 int net_receive(int fd, unsigned char* buffer, size_t* buflen, size_t maxlen)
 {
 	int len, consumed = 0;
@@ -540,6 +597,7 @@ void net_handle_server_conn(void)
 	cli_fd = accept(srv_fd, (struct sockaddr*)&cin, &cinlen);
 
 	LOG_INF("Accepting client");
+	update_parse_depth();
 
 	/* send initial config */
 	net_send_chan_list(cli_fd);
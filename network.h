@@ -29,9 +29,10 @@ extern int cli_fd;
 
 void net_init_server_socket(int rport);
 void net_handle_server_conn(void);
-void net_send_packet(struct uwifi_packet *pkt);
+void net_send_packet(struct uwifi_packet *pkt, int intf_idx);
 void net_send_channel_config(void);
 void net_send_filter_config(void);
+size_t net_receive_buffer_size(unsigned int batch);
 int net_receive(int fd, unsigned char* buffer, size_t* buflen, size_t maxlen);
 int net_open_client_socket(char* server, int rport);
 void net_finish(void);
@@ -0,0 +1,137 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "olsr.h"
+
+/*
+ * Table of OLSR originators by IP. TC and HNA messages are relayed through
+ * the mesh, so what they say belongs to their originator and not to the node
+ * which sent the packet. Packets are parsed in the capture threads, so the
+ * table is locked.
+ */
+
+#define OLSR_ORIG_HASH		256
+
+static struct list_head orig_hash[OLSR_ORIG_HASH];
+static pthread_mutex_t orig_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void olsr_orig_init(void)
+{
+	for (int i = 0; i < OLSR_ORIG_HASH; i++)
+		list_head_init(&orig_hash[i]);
+}
+
+static struct list_head* orig_bucket(uint32_t ip)
+{
+	/* network byte order: the host part is in the last byte */
+	return &orig_hash[(ip ^ (ip >> 8) ^ (ip >> 16) ^ (ip >> 24)) % OLSR_ORIG_HASH];
+}
+
+/* call with orig_lock held */
+static struct olsr_orig* orig_find(uint32_t ip, bool add)
+{
+	struct list_head* head = orig_bucket(ip);
+	struct olsr_orig* o;
+
+	list_for_each(head, o, list) {
+		if (o->ip == ip)
+			return o;
+	}
+
+	if (!add)
+		return NULL;
+
+	o = calloc(1, sizeof(struct olsr_orig));
+	if (o == NULL)
+		return NULL;
+	o->ip = ip;
+	list_add_tail(head, &o->list);
+	return o;
+}
+
+void olsr_orig_tc(uint32_t ip, unsigned int neigh, const struct timespec* ts)
+{
+	struct olsr_orig* o;
+
+	pthread_mutex_lock(&orig_lock);
+	o = orig_find(ip, true);
+	if (o != NULL) {
+		o->tc_neigh = neigh;
+		o->last_seen = ts->tv_sec;
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
+
+void olsr_orig_hna(uint32_t ip, bool gw, const struct timespec* ts)
+{
+	struct olsr_orig* o;
+
+	pthread_mutex_lock(&orig_lock);
+	o = orig_find(ip, true);
+	if (o != NULL) {
+		o->gw = gw;
+		o->last_seen = ts->tv_sec;
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
+
+bool olsr_orig_get(uint32_t ip, struct olsr_orig* o)
+{
+	struct olsr_orig* f;
+
+	pthread_mutex_lock(&orig_lock);
+	f = orig_find(ip, false);
+	if (f != NULL)
+		*o = *f;
+	pthread_mutex_unlock(&orig_lock);
+	return f != NULL;
+}
+
+void olsr_orig_timeout(time_t now, unsigned int timeout_sec)
+{
+	struct olsr_orig *o, *o2;
+
+	pthread_mutex_lock(&orig_lock);
+	for (int i = 0; i < OLSR_ORIG_HASH; i++) {
+		list_for_each_safe(&orig_hash[i], o, o2, list) {
+			if (o->last_seen < now - (time_t)timeout_sec) {
+				list_del(&o->list);
+				free(o);
+			}
+		}
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
+
+void olsr_orig_free(void)
+{
+	struct olsr_orig *o, *o2;
+
+	pthread_mutex_lock(&orig_lock);
+	for (int i = 0; i < OLSR_ORIG_HASH; i++) {
+		list_for_each_safe(&orig_hash[i], o, o2, list) {
+			list_del(&o->list);
+			free(o);
+		}
+	}
+	pthread_mutex_unlock(&orig_lock);
+}
@@ -0,0 +1,49 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OLSR_H_
+#define _OLSR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#undef LIST_HEAD
+#include <ccan/list/list.h>
+
+/* what relayed TC and HNA messages tell about their originator */
+struct olsr_orig {
+	struct list_node	list;
+	uint32_t		ip;
+	unsigned int		tc_neigh;	/* neighbours in last TC */
+	bool			gw;		/* announces 0.0.0.0/0 by HNA */
+	time_t			last_seen;	/* receive time, CLOCK_REALTIME */
+};
+
+void olsr_orig_init(void);
+void olsr_orig_tc(uint32_t ip, unsigned int neigh, const struct timespec* ts);
+void olsr_orig_hna(uint32_t ip, bool gw, const struct timespec* ts);
+
+/* copy originator 'ip' into 'o', returns false if unknown */
+bool olsr_orig_get(uint32_t ip, struct olsr_orig* o);
+
+void olsr_orig_timeout(time_t now, unsigned int timeout_sec);
+void olsr_orig_free(void);
+
+#endif
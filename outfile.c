@@ -0,0 +1,1082 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <uwifi/util.h>
+#include <uwifi/wlan_util.h>
+#include <uwifi/channel.h>
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "hutil.h"
+#include "outfile.h"
+#include "outfile_format.h"
+
+/*
+ * Records are serialized into a memory buffer by the packet thread. A writer
+ * thread writes full buffers, and the current one every conf.outfile_flush
+ * ms, so a slow disk does not stall packet processing. There are two buffers
+ * of conf.outfile_buffer bytes: when the packet thread fills its buffer while
+ * the other one is still being written, it either waits or drops records,
+ * depending on conf.outfile_policy. A binary block which is not full yet is
+ * moved to the buffer by outfile_flush(), at the same interval.
+ *
+ * The writer thread also splits the output into segments by size or time and
+ * compresses them. Segments are written as NAME.N.tmp and renamed to NAME.N
+ * (NAME.N.gz) when they are complete, so collectors can pick up finished
+ * files while the capture continues. Each segment starts with the file header
+ * of its format and can be read on its own.
+ */
+
+/* longer than any CSV line */
+#define CSV_LINE_MAX		512
+
+/* a block is written at the latest after this time, so a reader is not too
+ * far behind and the timestamp offsets fit */
+#define BLOCK_MAX_USEC		1000000
+
+#define MAC_HASH_SIZE		(4 * OUTFILE_BLOCK_RECORDS)	/* 3 MACs per record */
+#define ESSID_HASH_SIZE		(2 * OUTFILE_BLOCK_RECORDS)
+
+struct outbuf {
+	char*		data;
+	size_t		len;
+	unsigned int	records;
+	unsigned int*	blocks;		/* offsets of binary blocks */
+	unsigned int	num_blocks;
+	unsigned int	max_blocks;
+};
+
+static bool started;
+static enum outfile_format format;	/* of the open file */
+
+/* header written at the start of each segment */
+static char seg_header[sizeof(struct outfile_header) + COL_MAX +
+		       sizeof(OUTFILE_CSV_HEADER)];
+static size_t seg_header_len;
+
+/* segments, only used by the writer thread */
+static char seg_base[MAX_CONF_VALUE_STRLEN + 1];
+static char seg_name[MAX_CONF_VALUE_STRLEN + sizeof(".4294967295.gz")];
+static char seg_tmp[MAX_CONF_VALUE_STRLEN + sizeof(".4294967295.gz.tmp")];
+static int seg_fd = -1;
+static unsigned int seg_seq;
+static size_t seg_bytes;
+static time_t seg_start;
+static size_t rot_size;
+static unsigned int rot_time;
+static unsigned int rot_files;
+static int zlevel;
+
+/* index of uncompressed binary segments */
+static bool seg_indexed;
+static struct outfile_index_entry* idx;
+static unsigned int idx_num;
+static unsigned int idx_max;
+static int64_t idx_first;
+static int64_t idx_last;
+static uint8_t bloom[OUTFILE_BLOOM_BYTES];
+#if HAVE_ZLIB
+static z_stream zs;
+static unsigned char zbuf[64 * 1024];
+#endif
+
+/* shared with the writer thread, protected by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_full;	/* writer: a buffer is ready */
+static pthread_cond_t cond_free;	/* packet thread: buffer was written */
+static struct outbuf bufs[2];
+static struct outbuf* cur;		/* filled by the packet thread */
+static struct outbuf* full;		/* being written, or NULL */
+static size_t buf_size;
+static bool writer_stop;
+static struct outfile_stats ostats;
+
+/* first error of the writer thread, logged by the main thread */
+static const char* err_what;
+static int err_errno;
+static char err_name[sizeof(seg_tmp)];
+static unsigned long dropped_logged;	/* with OUTFILE_POLICY_COUNT */
+
+static pthread_t writer_thread;
+
+/* current block of the binary format */
+static struct outfile_block blk;
+static unsigned char* col[COL_MAX];
+static unsigned char mac_tab[3 * OUTFILE_BLOCK_RECORDS][WLAN_MAC_LEN];
+static uint16_t mac_hash[MAC_HASH_SIZE];		/* index + 1 */
+static char essid_tab[OUTFILE_BLOCK_RECORDS][WLAN_MAX_SSID_LEN];
+static uint16_t essid_hash[ESSID_HASH_SIZE];		/* index + 1 */
+
+/*** buffers and writer thread ***/
+
+/* called with lock held */
+static void buf_swap(void)
+{
+	full = cur;
+	cur = (cur == &bufs[0]) ? &bufs[1] : &bufs[0];
+	cur->len = 0;
+	cur->records = 0;
+	cur->num_blocks = 0;
+	pthread_cond_signal(&cond_full);
+}
+
+static bool write_all(const void* data, size_t len)
+{
+	ssize_t ret;
+
+	seg_bytes += len;
+	while (len > 0) {
+		ret = write(seg_fd, data, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+		data = (const char*)data + ret;
+		len -= ret;
+	}
+	return true;
+}
+
+static time_t now_sec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+static bool rotating(void)
+{
+	return rot_size > 0 || rot_time > 0;
+}
+
+#if HAVE_ZLIB
+static bool seg_deflate(const void* data, size_t len, int flush)
+{
+	int ret;
+
+	zs.next_in = (unsigned char*)data;
+	zs.avail_in = len;
+	do {
+		zs.next_out = zbuf;
+		zs.avail_out = sizeof(zbuf);
+		ret = deflate(&zs, flush);
+		if (ret == Z_STREAM_ERROR)
+			return false;
+		if (!write_all(zbuf, sizeof(zbuf) - zs.avail_out))
+			return false;
+	} while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+	return true;
+}
+#endif
+
+static void bloom_add(const unsigned char* mac)
+{
+	uint32_t bits[OUTFILE_BLOOM_HASHES];
+	int i;
+
+	outfile_bloom_bits(mac, bits);
+	for (i = 0; i < OUTFILE_BLOOM_HASHES; i++)
+		bloom[bits[i] / 8] |= 1 << (bits[i] % 8);
+}
+
+static void index_reset(void)
+{
+	idx_num = 0;
+	idx_first = INT64_MAX;
+	idx_last = INT64_MIN;
+	memset(bloom, 0, sizeof(bloom));
+}
+
+/* 'b' is a block written by block_write() at 'offset' in the segment */
+static void index_add(const unsigned char* b, uint64_t offset)
+{
+	struct outfile_index_entry* e;
+	struct outfile_block h;
+	uint32_t last, ts;
+	size_t pos;
+	int i;
+
+	if (idx_num == idx_max) {
+		e = realloc(idx, (idx_max + 1024) * sizeof(*idx));
+		if (e == NULL)
+			return;
+		idx = e;
+		idx_max += 1024;
+	}
+
+	memcpy(&h, b, sizeof(h));
+	pos = sizeof(h);
+	for (i = 0; i < h.macs; i++, pos += WLAN_MAC_LEN)
+		bloom_add(b + pos);
+	for (i = 0; i < h.essids; i++)
+		pos += 1 + b[pos];
+	/* COL_TS is the first column, times are not always in order */
+	for (i = 0, last = 0; i < (int)h.records; i++) {
+		memcpy(&ts, b + pos + i * sizeof(ts), sizeof(ts));
+		last = MAX(last, ts);
+	}
+
+	e = &idx[idx_num++];
+	e->offset = offset;
+	e->first_usec = h.ts_sec * 1000000LL + h.ts_usec;
+	e->last_usec = e->first_usec + last;
+	e->records = h.records;
+	e->reserved = 0;
+	idx_first = MIN(idx_first, e->first_usec);
+	idx_last = MAX(idx_last, e->last_usec);
+}
+
+static void index_write(void)
+{
+	struct outfile_index_trailer t;
+	uint32_t start[2] = { OUTFILE_INDEX_MAGIC, 0 };
+
+	t.first_usec = idx_num > 0 ? idx_first : 0;
+	t.last_usec = idx_num > 0 ? idx_last : 0;
+	t.index_offset = seg_bytes;
+	t.blocks = idx_num;
+	t.bloom_bytes = OUTFILE_BLOOM_BYTES;
+	t.bloom_hashes = OUTFILE_BLOOM_HASHES;
+	t.magic = OUTFILE_TRAILER_MAGIC;
+
+	write_all(start, sizeof(start));
+	write_all(idx, idx_num * sizeof(*idx));
+	write_all(bloom, sizeof(bloom));
+	write_all(&t, sizeof(t));
+}
+
+/* called by the writer thread without the lock */
+static void writer_error(const char* what)
+{
+	int e = errno;
+
+	pthread_mutex_lock(&lock);
+	if (err_what == NULL) {
+		err_what = what;
+		err_errno = e;
+		strcpy(err_name, seg_tmp);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static bool seg_put(const void* data, size_t len)
+{
+#if HAVE_ZLIB
+	if (zlevel > 0)
+		return seg_deflate(data, len, Z_NO_FLUSH);
+#endif
+	return write_all(data, len);
+}
+
+static bool seg_open(void)
+{
+	const char* ext = zlevel > 0 ? ".gz" : "";
+
+	if (rotating()) {
+		snprintf(seg_name, sizeof(seg_name), "%s.%u%s", seg_base, seg_seq, ext);
+		snprintf(seg_tmp, sizeof(seg_tmp), "%s.tmp", seg_name);
+	} else
+		snprintf(seg_tmp, sizeof(seg_tmp), "%s", seg_base);
+
+	seg_fd = open(seg_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (seg_fd < 0)
+		return false;
+
+	/* keep only the newest segments */
+	if (rotating() && rot_files > 0 && seg_seq >= rot_files) {
+		snprintf(seg_name, sizeof(seg_name), "%s.%u%s", seg_base,
+			 seg_seq - rot_files, ext);
+		unlink(seg_name);
+		snprintf(seg_name, sizeof(seg_name), "%s.%u%s", seg_base, seg_seq, ext);
+	}
+
+#if HAVE_ZLIB
+	if (zlevel > 0) {
+		memset(&zs, 0, sizeof(zs));
+		/* gzip header */
+		if (deflateInit2(&zs, zlevel, Z_DEFLATED, 15 + 16, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK) {
+			close(seg_fd);
+			seg_fd = -1;
+			return false;
+		}
+	}
+#endif
+	seg_bytes = 0;
+	seg_start = now_sec();
+	index_reset();
+	return seg_put(seg_header, seg_header_len);
+}
+
+/* complete the segment and make it visible under its final name */
+static void seg_finish(void)
+{
+	if (seg_fd < 0)
+		return;
+
+	if (seg_indexed)
+		index_write();
+
+#if HAVE_ZLIB
+	if (zlevel > 0) {
+		seg_deflate(NULL, 0, Z_FINISH);
+		deflateEnd(&zs);
+	}
+#endif
+	close(seg_fd);
+	seg_fd = -1;
+
+	if (rotating()) {
+		if (rename(seg_tmp, seg_name) < 0)
+			writer_error("rename outfile segment");
+		seg_seq++;
+	}
+}
+
+static bool seg_full(void)
+{
+	return (rot_size > 0 && seg_bytes >= rot_size) ||
+	       (rot_time > 0 && now_sec() - seg_start >= rot_time);
+}
+
+static bool seg_write(const struct outbuf* b)
+{
+	unsigned int i;
+
+	if (seg_fd >= 0 && seg_full())
+		seg_finish();
+
+	if (seg_fd < 0 && !seg_open()) {
+		if (seg_fd >= 0) {
+			close(seg_fd);
+			seg_fd = -1;
+		}
+		return false;
+	}
+
+	for (i = 0; seg_indexed && i < b->num_blocks; i++)
+		index_add((unsigned char*)b->data + b->blocks[i],
+			  seg_bytes + b->blocks[i]);
+
+	return seg_put(b->data, b->len);
+}
+
+static void* writer_run(__attribute__((unused)) void* arg)
+{
+	struct outbuf* b;
+	struct timespec to;
+	bool timeout = false;
+	bool err_logged = false;
+	bool ok;
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		if (full == NULL && cur->len > 0 && (timeout || writer_stop))
+			buf_swap();
+
+		if (full == NULL) {
+			if (writer_stop)
+				break;
+			/* time based rotation also when there is no traffic */
+			if (timeout && rot_time > 0 && seg_fd >= 0 && seg_full()) {
+				pthread_mutex_unlock(&lock);
+				seg_finish();
+				pthread_mutex_lock(&lock);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &to);
+			to.tv_sec += conf.outfile_flush / 1000;
+			to.tv_nsec += (conf.outfile_flush % 1000) * 1000000;
+			if (to.tv_nsec >= 1000000000) {
+				to.tv_sec++;
+				to.tv_nsec -= 1000000000;
+			}
+			timeout = pthread_cond_timedwait(&cond_full, &lock, &to)
+				  == ETIMEDOUT;
+			continue;
+		}
+
+		b = full;
+		pthread_mutex_unlock(&lock);
+		ok = seg_write(b);
+		if (!ok && !err_logged) {
+			writer_error("write outfile");
+			err_logged = true;
+		}
+		pthread_mutex_lock(&lock);
+
+		if (ok) {
+			ostats.bytes_written += b->len;
+			ostats.records_written += b->records;
+		} else {
+			ostats.bytes_dropped += b->len;
+			ostats.records_dropped += b->records;
+		}
+		full = NULL;
+		timeout = false;
+		pthread_cond_signal(&cond_free);
+	}
+	pthread_mutex_unlock(&lock);
+
+	seg_finish();
+	return NULL;
+}
+
+/* returns space for 'len' bytes in the current buffer and keeps the lock
+ * until out_commit(), or NULL if the records are dropped. dropped records are
+ * counted with all policies, OUTFILE_POLICY_COUNT also logs them */
+static char* out_reserve(size_t len, unsigned int records)
+{
+	pthread_mutex_lock(&lock);
+
+	if (cur->len + len > buf_size) {
+		while (full != NULL && conf.outfile_policy == OUTFILE_POLICY_BLOCK)
+			pthread_cond_wait(&cond_free, &lock);
+
+		if (full != NULL || len > buf_size) {
+			ostats.bytes_dropped += len;
+			ostats.records_dropped += records;
+			pthread_mutex_unlock(&lock);
+			return NULL;
+		}
+		buf_swap();
+	}
+	return cur->data + cur->len;
+}
+
+static void out_commit(size_t len, unsigned int records)
+{
+	cur->len += len;
+	cur->records += records;
+	pthread_mutex_unlock(&lock);
+}
+
+static bool writer_start(void)
+{
+	pthread_condattr_t attr;
+	int i;
+
+	strcpy(seg_base, conf.dumpfile);
+	rot_size = (size_t)conf.outfile_rotate_size * 1024 * 1024;
+	rot_time = conf.outfile_rotate_time;
+	rot_files = conf.outfile_rotate_files;
+	zlevel = conf.outfile_compress;
+	seg_indexed = (format == OUTFILE_BINARY && zlevel == 0);
+	/* a restart must not overwrite the segments of the previous run */
+	seg_seq = rotating() ? file_next_seq(seg_base) : 0;
+
+	buf_size = conf.outfile_buffer;
+	for (i = 0; i < 2; i++) {
+		bufs[i].data = malloc(buf_size);
+		if (bufs[i].data == NULL)
+			return false;
+		bufs[i].len = 0;
+		bufs[i].records = 0;
+		bufs[i].num_blocks = 0;
+	}
+	cur = &bufs[0];
+	full = NULL;
+	writer_stop = false;
+	memset(&ostats, 0, sizeof(ostats));
+	err_what = NULL;
+	dropped_logged = 0;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond_full, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&cond_free, NULL);
+
+	return pthread_create(&writer_thread, NULL, writer_run, NULL) == 0;
+}
+
+/* writes all pending data */
+static void writer_stop_join(void)
+{
+	pthread_mutex_lock(&lock);
+	writer_stop = true;
+	pthread_cond_signal(&cond_full);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer_thread, NULL);
+
+	pthread_cond_destroy(&cond_full);
+	pthread_cond_destroy(&cond_free);
+	free(bufs[0].data);
+	free(bufs[1].data);
+	bufs[0].data = bufs[1].data = NULL;
+	free(bufs[0].blocks);
+	free(bufs[1].blocks);
+	bufs[0].blocks = bufs[1].blocks = NULL;
+	bufs[0].max_blocks = bufs[1].max_blocks = 0;
+}
+
+/* remember where a block starts for the index, called between out_reserve()
+ * and out_commit() */
+static void block_add_offset(size_t off)
+{
+	unsigned int* n;
+
+	if (cur->num_blocks == cur->max_blocks) {
+		n = realloc(cur->blocks, (cur->max_blocks + 256) * sizeof(*n));
+		if (n == NULL)
+			return;
+		cur->blocks = n;
+		cur->max_blocks += 256;
+	}
+	cur->blocks[cur->num_blocks++] = off;
+}
+
+/*** CSV format ***/
+
+static void write_csv(struct uwifi_packet* p, int intf_idx,
+		      const struct timespec* ts)
+{
+	char* buf;
+	int i;
+	struct tm* ltm = localtime(&ts->tv_sec);
+
+	buf = out_reserve(CSV_LINE_MAX, 1);
+	if (buf == NULL)
+		return;
+
+	//timestamp, e.g. 2015-05-16 15:05:44.338806 +0300
+	i = strftime(buf, CSV_LINE_MAX, "%Y-%m-%d %H:%M:%S", ltm);
+	i += snprintf(buf + i, CSV_LINE_MAX - i, ".%06ld", (long)(ts->tv_nsec / 1000));
+	i += strftime(buf + i, CSV_LINE_MAX - i, " %z", ltm);
+	i += snprintf(buf + i, CSV_LINE_MAX - i, ", ");
+
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%s, " MAC_FMT ", ",
+		wlan_get_packet_type_name(p->wlan_type), MAC_PAR(p->wlan_src));
+	i += snprintf(buf + i, CSV_LINE_MAX - i, MAC_FMT ", ", MAC_PAR(p->wlan_dst));
+	i += snprintf(buf + i, CSV_LINE_MAX - i, MAC_FMT ", ", MAC_PAR(p->wlan_bssid));
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%x, %d, %d, %d, %d, ",
+		p->pkt_types, p->phy_signal, p->wlan_len, p->phy_rate, p->phy_freq);
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%016llx, ", (unsigned long long)p->wlan_tsf);
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%s, %d, %d, %d, %d, %d, ",
+		p->wlan_essid, p->wlan_mode, p->wlan_channel,
+		p->wlan_wep, p->wlan_wpa, p->wlan_rsn);
+	/* ip_sprintf() uses a static buffer */
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%s, ", ip_sprintf(p->ip_src));
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%s, ", ip_sprintf(p->ip_dst));
+	i += snprintf(buf + i, CSV_LINE_MAX - i, "%d\n", intf_idx);
+
+	out_commit(MIN(i, CSV_LINE_MAX - 1), 1);
+}
+
+/*** JSON format ***/
+
+/* escaped ESSID and the rest */
+#define JSON_LINE_MAX		1024
+
+#define PUT_LIT(_b, _s)		(memcpy(_b, _s, sizeof(_s) - 1), _b + sizeof(_s) - 1)
+
+static const char hex[] = "0123456789abcdef";
+
+/* time formatting is only done once per second */
+static time_t json_sec = -1;
+static char json_time[40];
+static size_t json_time_len;
+static char json_zone[16];
+static size_t json_zone_len;
+
+static char* put_uint(char* b, unsigned long v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+
+	while (n > 0)
+		*b++ = tmp[--n];
+	return b;
+}
+
+static char* put_int(char* b, long v)
+{
+	if (v < 0) {
+		*b++ = '-';
+		return put_uint(b, -(unsigned long)v);
+	}
+	return put_uint(b, v);
+}
+
+static char* put_bool(char* b, bool v)
+{
+	return v ? PUT_LIT(b, "true") : PUT_LIT(b, "false");
+}
+
+static char* put_str(char* b, const char* s)
+{
+	size_t len = strlen(s);
+
+	memcpy(b, s, len);
+	return b + len;
+}
+
+/* valid UTF-8 is copied, control characters and bytes which are not valid
+ * UTF-8 are escaped, so the output is always valid JSON */
+static char* put_json_str(char* b, const char* s)
+{
+	unsigned char c;
+	int len;
+
+	*b++ = '"';
+	while (*s != '\0') {
+		c = *s;
+		len = utf8_char_len(s);
+		if (c == '"' || c == '\\') {
+			*b++ = '\\';
+			*b++ = c;
+		} else if (c < 0x20 || c == 0x7f || len == 0) {
+			b = PUT_LIT(b, "\\u00");
+			*b++ = hex[c >> 4];
+			*b++ = hex[c & 0xf];
+		} else {
+			memcpy(b, s, len);
+			b += len;
+			s += len;
+			continue;
+		}
+		s++;
+	}
+	*b++ = '"';
+	return b;
+}
+
+static char* put_mac(char* b, const unsigned char* mac)
+{
+	int i;
+
+	*b++ = '"';
+	for (i = 0; i < WLAN_MAC_LEN; i++) {
+		*b++ = hex[mac[i] >> 4];
+		*b++ = hex[mac[i] & 0xf];
+		*b++ = ':';
+	}
+	b[-1] = '"';
+	return b;
+}
+
+static char* put_ip(char* b, unsigned int ip)
+{
+	unsigned char* cip = (unsigned char*)&ip;
+	int i;
+
+	*b++ = '"';
+	for (i = 0; i < 4; i++) {
+		b = put_uint(b, cip[i]);
+		*b++ = '.';
+	}
+	b[-1] = '"';
+	return b;
+}
+
+static char* put_hex64(char* b, uint64_t v)
+{
+	int i;
+
+	*b++ = '"';
+	for (i = 60; i >= 0; i -= 4)
+		*b++ = hex[(v >> i) & 0xf];
+	*b++ = '"';
+	return b;
+}
+
+/* e.g. 2015-05-16T15:05:44.338806+03:00 */
+static char* put_time(char* b, const struct timespec* ts)
+{
+	struct tm* ltm;
+	long usec = ts->tv_nsec / 1000;
+	int i;
+
+	if (ts->tv_sec != json_sec) {
+		ltm = localtime(&ts->tv_sec);
+		json_time_len = strftime(json_time, sizeof(json_time),
+					 "\"%Y-%m-%dT%H:%M:%S.", ltm);
+		json_zone_len = strftime(json_zone, sizeof(json_zone), "%z", ltm);
+		/* +0300 -> +03:00" */
+		if (json_zone_len == 5) {
+			json_zone[5] = json_zone[4];
+			json_zone[4] = json_zone[3];
+			json_zone[3] = ':';
+			json_zone[6] = '"';
+			json_zone_len = 7;
+		} else
+			json_zone[json_zone_len++] = '"';
+		json_sec = ts->tv_sec;
+	}
+
+	memcpy(b, json_time, json_time_len);
+	b += json_time_len;
+	for (i = 5; i >= 0; i--) {
+		b[i] = '0' + usec % 10;
+		usec /= 10;
+	}
+	b += 6;
+	memcpy(b, json_zone, json_zone_len);
+	return b + json_zone_len;
+}
+
+static void write_json(struct uwifi_packet* p, int intf_idx,
+		       const struct timespec* ts)
+{
+	char* buf;
+	char* b;
+
+	buf = b = out_reserve(JSON_LINE_MAX, 1);
+	if (buf == NULL)
+		return;
+
+	b = PUT_LIT(b, "{\"time\":");
+	b = put_time(b, ts);
+	b = PUT_LIT(b, ",\"type\":\"");
+	b = put_str(b, wlan_get_packet_type_name(p->wlan_type));
+	b = PUT_LIT(b, "\",\"src\":");
+	b = put_mac(b, p->wlan_src);
+	b = PUT_LIT(b, ",\"dst\":");
+	b = put_mac(b, p->wlan_dst);
+	b = PUT_LIT(b, ",\"bssid\":");
+	b = put_mac(b, p->wlan_bssid);
+	b = PUT_LIT(b, ",\"pkt_types\":");
+	b = put_uint(b, p->pkt_types);
+	b = PUT_LIT(b, ",\"signal\":");
+	b = put_int(b, p->phy_signal);
+	b = PUT_LIT(b, ",\"len\":");
+	b = put_uint(b, p->wlan_len);
+	b = PUT_LIT(b, ",\"rate\":");
+	b = put_uint(b, p->phy_rate);
+	b = PUT_LIT(b, ",\"freq\":");
+	b = put_uint(b, p->phy_freq);
+	b = PUT_LIT(b, ",\"chan_width\":\"");
+	b = put_str(b, (p->wlan_chan_width == CHAN_WIDTH_UNSPEC ||
+			p->wlan_chan_width == CHAN_WIDTH_20_NOHT) ? "20" :
+		uwifi_channel_width_string_short(p->wlan_chan_width, p->wlan_ht40plus));
+	b = PUT_LIT(b, "\",\"tsf\":");
+	b = put_hex64(b, p->wlan_tsf);
+	b = PUT_LIT(b, ",\"essid\":");
+	b = put_json_str(b, p->wlan_essid);
+	b = PUT_LIT(b, ",\"mode\":");
+	b = put_uint(b, p->wlan_mode);
+	b = PUT_LIT(b, ",\"channel\":");
+	b = put_uint(b, p->wlan_channel);
+	b = PUT_LIT(b, ",\"wep\":");
+	b = put_bool(b, p->wlan_wep);
+	b = PUT_LIT(b, ",\"wpa\":");
+	b = put_bool(b, p->wlan_wpa);
+	b = PUT_LIT(b, ",\"rsn\":");
+	b = put_bool(b, p->wlan_rsn);
+	b = PUT_LIT(b, ",\"ip_src\":");
+	b = put_ip(b, p->ip_src);
+	b = PUT_LIT(b, ",\"ip_dst\":");
+	b = put_ip(b, p->ip_dst);
+	b = PUT_LIT(b, ",\"intf\":");
+	b = put_uint(b, intf_idx);
+	b = PUT_LIT(b, ",\"seqno\":");
+	b = put_uint(b, p->wlan_seqno);
+	b = PUT_LIT(b, ",\"nav\":");
+	b = put_uint(b, p->wlan_nav);
+	b = PUT_LIT(b, ",\"qos_class\":");
+	b = put_uint(b, p->wlan_qos_class);
+	b = PUT_LIT(b, ",\"duration\":");
+	b = put_uint(b, p->pkt_duration);
+	b = PUT_LIT(b, "}\n");
+
+	out_commit(b - buf, 1);
+}
+
+/*** binary format ***/
+
+static void block_write(void)
+{
+	size_t len;
+	char* buf;
+	char* b;
+	int i;
+
+	if (blk.records == 0)
+		return;
+
+	len = sizeof(blk) + blk.macs * WLAN_MAC_LEN;
+	for (i = 0; i < blk.essids; i++)
+		len += 1 + strlen(essid_tab[i]);
+	for (i = 0; i < COL_MAX; i++)
+		len += outfile_col_width[i] * blk.records;
+
+	buf = b = out_reserve(len, blk.records);
+	if (buf != NULL) {
+		block_add_offset(buf - cur->data);
+		memcpy(b, &blk, sizeof(blk));
+		b += sizeof(blk);
+		memcpy(b, mac_tab, blk.macs * WLAN_MAC_LEN);
+		b += blk.macs * WLAN_MAC_LEN;
+		for (i = 0; i < blk.essids; i++) {
+			*b = strlen(essid_tab[i]);
+			memcpy(b + 1, essid_tab[i], *(uint8_t*)b);
+			b += 1 + *(uint8_t*)b;
+		}
+		for (i = 0; i < COL_MAX; i++) {
+			memcpy(b, col[i], outfile_col_width[i] * blk.records);
+			b += outfile_col_width[i] * blk.records;
+		}
+		out_commit(len, blk.records);
+	}
+
+	blk.records = 0;
+	blk.macs = 0;
+	blk.essids = 0;
+	memset(mac_hash, 0, sizeof(mac_hash));
+	memset(essid_hash, 0, sizeof(essid_hash));
+}
+
+static uint16_t mac_index(const unsigned char* mac)
+{
+	unsigned int h = (mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5])
+			 * 2654435761u;
+	unsigned int i;
+
+	for (i = h % MAC_HASH_SIZE; mac_hash[i] != 0; i = (i + 1) % MAC_HASH_SIZE) {
+		if (memcmp(mac_tab[mac_hash[i] - 1], mac, WLAN_MAC_LEN) == 0)
+			return mac_hash[i] - 1;
+	}
+	memcpy(mac_tab[blk.macs], mac, WLAN_MAC_LEN);
+	mac_hash[i] = ++blk.macs;
+	return blk.macs - 1;
+}
+
+static uint16_t essid_index(const char* essid)
+{
+	unsigned int h = 2166136261u;
+	unsigned int i;
+	const char* c;
+	size_t len;
+
+	for (c = essid; *c != '\0'; c++)
+		h = (h ^ (unsigned char)*c) * 16777619;
+
+	for (i = h % ESSID_HASH_SIZE; essid_hash[i] != 0; i = (i + 1) % ESSID_HASH_SIZE) {
+		if (strcmp(essid_tab[essid_hash[i] - 1], essid) == 0)
+			return essid_hash[i] - 1;
+	}
+	len = strnlen(essid, WLAN_MAX_SSID_LEN - 1);
+	memcpy(essid_tab[blk.essids], essid, len);
+	essid_tab[blk.essids][len] = '\0';
+	essid_hash[i] = ++blk.essids;
+	return blk.essids - 1;
+}
+
+#define PUT(_col, _type, _val) do {					\
+		_type _v = (_val);					\
+		memcpy(col[_col] + blk.records * sizeof(_type), &_v, sizeof(_type)); \
+	} while (0)
+
+static void write_binary(struct uwifi_packet* p, int intf_idx,
+			 const struct timespec* ts)
+{
+	int64_t usec = 0;
+
+	if (blk.records > 0) {
+		usec = (ts->tv_sec - blk.ts_sec) * 1000000LL
+			+ ts->tv_nsec / 1000 - blk.ts_usec;
+		if (usec < 0 || usec >= BLOCK_MAX_USEC ||
+		    blk.records >= OUTFILE_BLOCK_RECORDS)
+			block_write();
+	}
+
+	if (blk.records == 0) {
+		blk.ts_sec = ts->tv_sec;
+		blk.ts_usec = ts->tv_nsec / 1000;
+		usec = 0;
+	}
+
+	PUT(COL_TS,		uint32_t, usec);
+	PUT(COL_WLAN_TYPE,	uint16_t, p->wlan_type);
+	PUT(COL_SRC,		uint16_t, mac_index(p->wlan_src));
+	PUT(COL_DST,		uint16_t, mac_index(p->wlan_dst));
+	PUT(COL_BSSID,		uint16_t, mac_index(p->wlan_bssid));
+	PUT(COL_PKT_TYPES,	uint32_t, p->pkt_types);
+	PUT(COL_SIGNAL,		int8_t,   MAX(p->phy_signal, -128));
+	PUT(COL_LEN,		uint16_t, MIN(p->wlan_len, 0xffff));
+	PUT(COL_RATE,		uint16_t, MIN(p->phy_rate, 0xffff));
+	PUT(COL_FREQ,		uint16_t, p->phy_freq);
+	PUT(COL_TSF,		uint64_t, p->wlan_tsf);
+	PUT(COL_ESSID,		uint16_t, essid_index(p->wlan_essid));
+	PUT(COL_MODE,		uint8_t,  p->wlan_mode);
+	PUT(COL_CHANNEL,	uint8_t,  p->wlan_channel);
+	PUT(COL_ENC,		uint8_t,  (p->wlan_wep ? OUTFILE_ENC_WEP : 0) |
+					  (p->wlan_wpa ? OUTFILE_ENC_WPA : 0) |
+					  (p->wlan_rsn ? OUTFILE_ENC_RSN : 0));
+	PUT(COL_IP_SRC,		uint32_t, p->ip_src);
+	PUT(COL_IP_DST,		uint32_t, p->ip_dst);
+	PUT(COL_INTF,		uint8_t,  intf_idx);
+	blk.records++;
+}
+
+static void write_binary_header(void)
+{
+	struct outfile_header hdr;
+	int i;
+
+	if (col[0] == NULL) {
+		for (i = 0; i < COL_MAX; i++) {
+			col[i] = malloc(outfile_col_width[i] * OUTFILE_BLOCK_RECORDS);
+			if (col[i] == NULL)
+				err(1, "Couldn't allocate outfile buffers");
+		}
+	}
+
+	memcpy(hdr.magic, OUTFILE_MAGIC, sizeof(hdr.magic));
+	hdr.bom = OUTFILE_BOM;
+	hdr.version = OUTFILE_VERSION;
+	hdr.columns = COL_MAX;
+
+	memcpy(seg_header, &hdr, sizeof(hdr));
+	memcpy(seg_header + sizeof(hdr), outfile_col_width, COL_MAX);
+	seg_header_len = sizeof(hdr) + COL_MAX;
+
+	blk.magic = OUTFILE_BLOCK_MAGIC;
+	blk.records = 0;
+}
+
+/*** API ***/
+
+/* the file is opened with the first packet, after all options are set */
+static void outfile_start(void)
+{
+	format = conf.outfile_format;
+	seg_header_len = 0;
+	if (format == OUTFILE_BINARY)
+		write_binary_header();
+	else if (format == OUTFILE_CSV) {
+		seg_header_len = sizeof(OUTFILE_CSV_HEADER) - 1;
+		memcpy(seg_header, OUTFILE_CSV_HEADER, seg_header_len);
+	}
+
+	if (!writer_start())
+		err(1, "Couldn't start outfile writer");
+	started = true;
+}
+
+void outfile_write(struct uwifi_packet* p, int intf_idx, const struct timespec* ts)
+{
+	if (!started) {
+		if (conf.dumpfile[0] == '\0')
+			return;
+		outfile_start();
+	}
+
+	if (format == OUTFILE_BINARY)
+		write_binary(p, intf_idx, ts);
+	else if (format == OUTFILE_JSON)
+		write_json(p, intf_idx, ts);
+	else
+		write_csv(p, intf_idx, ts);
+}
+
+/* log what the writer thread could not */
+static void report_errors(void)
+{
+	char name[sizeof(err_name)];
+	unsigned long dropped = 0;
+	const char* what;
+	int e;
+
+	pthread_mutex_lock(&lock);
+	what = err_what;
+	e = err_errno;
+	strcpy(name, err_name);
+	err_what = NULL;
+	if (conf.outfile_policy == OUTFILE_POLICY_COUNT) {
+		dropped = ostats.records_dropped - dropped_logged;
+		dropped_logged = ostats.records_dropped;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (what != NULL)
+		LOG_ERR("Couldn't %s %s (%s)", what, name, strerror(e));
+	if (dropped > 0)
+		LOG_ERR("Outfile: dropped %lu records, the disk can't keep up",
+			dropped);
+}
+
+/* a partial binary block would wait for the next packet, which may never
+ * come */
+void outfile_flush(void)
+{
+	if (!started)
+		return;
+
+	if (format == OUTFILE_BINARY)
+		block_write();
+	report_errors();
+}
+
+void outfile_get_stats(struct outfile_stats* s)
+{
+	pthread_mutex_lock(&lock);
+	*s = ostats;
+	pthread_mutex_unlock(&lock);
+}
+
+void outfile_close(void)
+{
+	if (!started)
+		return;
+
+	if (format == OUTFILE_BINARY)
+		block_write();
+	writer_stop_join();
+	report_errors();
+	started = false;
+
+	LOG_INF("Outfile: %lu records (%lu bytes) written, %lu records dropped",
+		ostats.records_written, ostats.bytes_written,
+		ostats.records_dropped);
+}
+
+void outfile_open(const char* name)
+{
+	outfile_close();
+
+	if (name == NULL || strlen(name) == 0) {
+		LOG_INF("- Not writing outfile");
+		conf.dumpfile[0] = '\0';
+		return;
+	}
+
+	if (name != conf.dumpfile) {
+		strncpy(conf.dumpfile, name, MAX_CONF_VALUE_STRLEN);
+		conf.dumpfile[MAX_CONF_VALUE_STRLEN] = '\0';
+	}
+	LOG_INF("- Writing to outfile %s", conf.dumpfile);
+}
@@ -0,0 +1,59 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTFILE_H_
+#define _OUTFILE_H_
+
+#include <time.h>
+
+struct uwifi_packet;
+
+#define OUTFILE_BUFFER_MIN	(256 * 1024)	/* a full binary block fits */
+
+enum outfile_format {
+	OUTFILE_CSV,
+	OUTFILE_BINARY,
+	OUTFILE_JSON,
+};
+
+/* what to do when the writer can't keep up */
+enum outfile_policy {
+	OUTFILE_POLICY_BLOCK,		/* wait for the writer */
+	OUTFILE_POLICY_DROP,		/* drop and count the records */
+	OUTFILE_POLICY_COUNT,		/* drop, count and log them */
+};
+
+struct outfile_stats {
+	unsigned long	records_written;
+	unsigned long	bytes_written;
+	unsigned long	records_dropped;
+	unsigned long	bytes_dropped;
+};
+
+/* (re)open outfile in conf.outfile_format, NULL or "" closes it */
+void outfile_open(const char* name);
+void outfile_write(struct uwifi_packet* p, int intf_idx, const struct timespec* ts);
+
+/* called every conf.outfile_flush ms by the thread which calls
+ * outfile_write(), also logs errors of the writer thread */
+void outfile_flush(void);
+void outfile_close(void);
+void outfile_get_stats(struct outfile_stats* s);
+
+#endif
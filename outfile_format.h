@@ -0,0 +1,171 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTFILE_FORMAT_H_
+#define _OUTFILE_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * Binary packet log (outfile_format=binary), shared with horst-logcat.
+ *
+ * The file starts with a header, followed by blocks of up to
+ * OUTFILE_BLOCK_RECORDS packets. All values are in the byte order of the
+ * writer, which readers detect with 'bom', except for the IP addresses which
+ * are in network order.
+ *
+ * header:	struct outfile_header, then 'columns' bytes with the width of
+ *		each column
+ * block:	struct outfile_block
+ *		MAC table: 'macs' times 6 bytes
+ *		ESSID table: 'essids' times u8 length + string
+ *		columns: for each column 'records' values of its width
+ *
+ * MACs and ESSIDs are stored as indexes into the tables of their block.
+ * New columns can only be appended, readers skip the ones they don't know.
+ *
+ * Uncompressed files end with an index when they are complete:
+ *
+ * index:	u32 OUTFILE_INDEX_MAGIC, u32 reserved
+ *		'blocks' times struct outfile_index_entry
+ *		MAC Bloom filter of 'bloom_bytes'
+ *		struct outfile_index_trailer
+ *
+ * The trailer is at the very end of the file, so readers can find the index
+ * without reading the blocks. Files which are still being written or were
+ * not closed properly have no index and must be read sequentially.
+ */
+
+#define OUTFILE_MAGIC		"HORSTLOG"
+#define OUTFILE_BOM		0x1a2b3c4d
+#define OUTFILE_VERSION		1
+#define OUTFILE_BLOCK_MAGIC	0x4b4c4248	/* "HBLK" */
+#define OUTFILE_BLOCK_RECORDS	1024
+#define OUTFILE_INDEX_MAGIC	0x58444948	/* "HIDX" */
+#define OUTFILE_TRAILER_MAGIC	0x4c525448	/* "HTRL" */
+#define OUTFILE_BLOOM_BYTES	8192
+#define OUTFILE_BLOOM_HASHES	4
+
+struct outfile_header {
+	char		magic[8];
+	uint32_t	bom;
+	uint16_t	version;
+	uint16_t	columns;
+} __attribute__((packed));
+
+struct outfile_block {
+	uint32_t	magic;
+	uint32_t	records;
+	int64_t		ts_sec;		/* time of first packet */
+	uint32_t	ts_usec;
+	uint16_t	macs;
+	uint16_t	essids;
+} __attribute__((packed));
+
+struct outfile_index_entry {
+	uint64_t	offset;		/* of the block in the file */
+	int64_t		first_usec;	/* time range, usec since epoch */
+	int64_t		last_usec;
+	uint32_t	records;
+	uint32_t	reserved;
+} __attribute__((packed));
+
+struct outfile_index_trailer {
+	int64_t		first_usec;	/* time range of the whole file */
+	int64_t		last_usec;
+	uint64_t	index_offset;
+	uint32_t	blocks;
+	uint32_t	bloom_bytes;
+	uint32_t	bloom_hashes;
+	uint32_t	magic;
+} __attribute__((packed));
+
+enum outfile_column {
+	COL_TS,			/* u32 usec since block time */
+	COL_WLAN_TYPE,		/* u16 */
+	COL_SRC,		/* u16 MAC index */
+	COL_DST,		/* u16 MAC index */
+	COL_BSSID,		/* u16 MAC index */
+	COL_PKT_TYPES,		/* u32 */
+	COL_SIGNAL,		/* s8 dBm */
+	COL_LEN,		/* u16 */
+	COL_RATE,		/* u16 */
+	COL_FREQ,		/* u16 */
+	COL_TSF,		/* u64 */
+	COL_ESSID,		/* u16 ESSID index */
+	COL_MODE,		/* u8 */
+	COL_CHANNEL,		/* u8 */
+	COL_ENC,		/* u8 OUTFILE_ENC_* */
+	COL_IP_SRC,		/* u32 network order */
+	COL_IP_DST,		/* u32 network order */
+	COL_INTF,		/* u8 */
+	COL_MAX
+};
+
+#define OUTFILE_ENC_WEP		0x01
+#define OUTFILE_ENC_WPA		0x02
+#define OUTFILE_ENC_RSN		0x04
+
+static const uint8_t outfile_col_width[COL_MAX] = {
+	[COL_TS]	= 4,
+	[COL_WLAN_TYPE]	= 2,
+	[COL_SRC]	= 2,
+	[COL_DST]	= 2,
+	[COL_BSSID]	= 2,
+	[COL_PKT_TYPES]	= 4,
+	[COL_SIGNAL]	= 1,
+	[COL_LEN]	= 2,
+	[COL_RATE]	= 2,
+	[COL_FREQ]	= 2,
+	[COL_TSF]	= 8,
+	[COL_ESSID]	= 2,
+	[COL_MODE]	= 1,
+	[COL_CHANNEL]	= 1,
+	[COL_ENC]	= 1,
+	[COL_IP_SRC]	= 4,
+	[COL_IP_DST]	= 4,
+	[COL_INTF]	= 1,
+};
+
+/* the Bloom filter of an index contains all MACs (source, destination and
+ * BSSID) of the file */
+static inline void outfile_bloom_bits(const unsigned char* mac,
+				      uint32_t bits[OUTFILE_BLOOM_HASHES])
+{
+	uint64_t h = 14695981039346656037ULL;
+	uint32_t h1, h2;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		h = (h ^ mac[i]) * 1099511628211ULL;
+
+	/* double hashing */
+	h1 = h;
+	h2 = (h >> 32) | 1;
+	for (i = 0; i < OUTFILE_BLOOM_HASHES; i++)
+		bits[i] = (h1 + i * h2) % (OUTFILE_BLOOM_BYTES * 8);
+}
+
+/* the CSV header of outfile_format=csv, also used by horst-logcat */
+#define OUTFILE_CSV_HEADER \
+	"TIME, WLAN TYPE, MAC SRC, MAC DST, BSSID, PACKET TYPES, SIGNAL, " \
+	"LENGTH, PHY RATE, FREQUENCY, TSF, ESSID, MODE, CHANNEL, " \
+	"WEP, WPA1, RSN (WPA2), IP SRC, IP DST, INTERFACE\n"
+
+#endif
@@ -0,0 +1,304 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _XOPEN_SOURCE 700	/* strptime */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <uwifi/log.h>
+#include <uwifi/wlan80211.h>
+
+#include "hutil.h"
+#include "outfile_reader.h"
+#include "outfile_query.h"
+
+/*
+ * Query mode (-Q): find the records of a MAC address and/or a time range in
+ * binary outfile segments. Complete segments are skipped by the time range
+ * and MAC Bloom filter of their index, and only the blocks whose time range
+ * overlaps and whose MAC table contains the MAC are decoded. Segments without
+ * an index (still being written) are read sequentially.
+ */
+
+static bool have_mac;
+static unsigned char mac[WLAN_MAC_LEN];
+static int64_t from = INT64_MIN;
+static int64_t to = INT64_MAX;
+
+static struct {
+	unsigned int	files;
+	unsigned int	files_skipped;
+	unsigned long	blocks;
+	unsigned long	blocks_read;
+	unsigned long	records;
+} qs;
+
+/* local time as YYYY-MM-DD HH:MM:SS or with a 'T', or seconds since epoch */
+static bool parse_time(const char* str, int64_t* usec)
+{
+	struct tm tm;
+	const char* end;
+	char* e;
+	long long sec;
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (end == NULL)
+		end = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+	if (end != NULL && *end == '\0') {
+		tm.tm_isdst = -1;
+		*usec = mktime(&tm) * 1000000LL;
+		return true;
+	}
+
+	sec = strtoll(str, &e, 10);
+	if (*str == '\0' || *e != '\0')
+		return false;
+	*usec = sec * 1000000LL;
+	return true;
+}
+
+bool outfile_query_add(const char* term)
+{
+	if (strncmp(term, "mac=", 4) == 0) {
+		convert_string_to_mac(term + 4, mac);
+		have_mac = true;
+		return true;
+	}
+	if (strncmp(term, "from=", 5) == 0 && parse_time(term + 5, &from))
+		return true;
+	if (strncmp(term, "to=", 3) == 0 && parse_time(term + 3, &to))
+		return true;
+
+	LOG_ERR("Invalid query '%s'", term);
+	return false;
+}
+
+static bool record_matches(const struct outfile_reader* r,
+			   const struct outfile_rblock* b, unsigned int i)
+{
+	int64_t t = outfile_rtime(r, b, i);
+
+	if (t < from || t > to)
+		return false;
+
+	return !have_mac ||
+	       memcmp(outfile_rmac(r, b, COL_SRC, i), mac, WLAN_MAC_LEN) == 0 ||
+	       memcmp(outfile_rmac(r, b, COL_DST, i), mac, WLAN_MAC_LEN) == 0 ||
+	       memcmp(outfile_rmac(r, b, COL_BSSID, i), mac, WLAN_MAC_LEN) == 0;
+}
+
+static void print_block(const struct outfile_reader* r,
+			const struct outfile_rblock* b)
+{
+	unsigned int i;
+
+	qs.blocks_read++;
+	if (have_mac && !outfile_rblock_has_mac(b, mac))
+		return;
+
+	for (i = 0; i < b->hdr.records; i++) {
+		if (record_matches(r, b, i)) {
+			outfile_print_csv(stdout, r, b, i);
+			qs.records++;
+		}
+	}
+}
+
+static bool bloom_match(const unsigned char* buf,
+			const struct outfile_index_trailer* t)
+{
+	const unsigned char* bloom;
+	uint32_t bits[OUTFILE_BLOOM_HASHES];
+	int i;
+
+	if (!have_mac)
+		return true;
+
+	bloom = buf + t->index_offset + 8 +
+		t->blocks * sizeof(struct outfile_index_entry);
+	outfile_bloom_bits(mac, bits);
+	for (i = 0; i < OUTFILE_BLOOM_HASHES; i++) {
+		if (!(bloom[bits[i] / 8] & (1 << (bits[i] % 8))))
+			return false;
+	}
+	return true;
+}
+
+static void query_indexed(const struct outfile_reader* r,
+			  const unsigned char* buf, size_t len,
+			  const struct outfile_index_trailer* t)
+{
+	struct outfile_index_entry e;
+	struct outfile_rblock b;
+	uint32_t i;
+
+	if (t->last_usec < from || t->first_usec > to || !bloom_match(buf, t)) {
+		qs.files_skipped++;
+		return;
+	}
+
+	for (i = 0; i < t->blocks; i++) {
+		memcpy(&e, buf + t->index_offset + 8 + i * sizeof(e), sizeof(e));
+		if (r->swapped) {
+			e.offset = __builtin_bswap64(e.offset);
+			e.first_usec = __builtin_bswap64(e.first_usec);
+			e.last_usec = __builtin_bswap64(e.last_usec);
+		}
+		qs.blocks++;
+		if (e.last_usec < from || e.first_usec > to)
+			continue;
+		if (e.offset >= t->index_offset ||
+		    outfile_read_block(r, buf + e.offset, len - e.offset, &b) <= 0) {
+			LOG_ERR("Broken index entry %u", i);
+			continue;
+		}
+		print_block(r, &b);
+	}
+}
+
+static void query_sequential(const struct outfile_reader* r,
+			     const unsigned char* buf, size_t len, size_t pos)
+{
+	struct outfile_rblock b;
+	ssize_t ret;
+
+	while ((ret = outfile_read_block(r, buf + pos, len - pos, &b)) > 0) {
+		qs.blocks++;
+		print_block(r, &b);
+		pos += ret;
+	}
+}
+
+static void query_file(const char* name)
+{
+	struct outfile_reader r;
+	struct outfile_index_trailer t;
+	unsigned char* buf;
+	struct stat st;
+	ssize_t hlen;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		LOG_ERR("Couldn't map %s", name);
+		return;
+	}
+
+	hlen = outfile_read_header(&r, buf, st.st_size);
+	if (hlen <= 0) {
+		LOG_ERR("%s is not an uncompressed binary outfile", name);
+	} else {
+		qs.files++;
+		if (outfile_read_trailer(&r, buf, st.st_size, &t))
+			query_indexed(&r, buf, st.st_size, &t);
+		else
+			query_sequential(&r, buf, st.st_size, hlen);
+	}
+	munmap(buf, st.st_size);
+}
+
+static size_t seg_base_len;
+
+/* number of the segment "BASE.N[.gz][.tmp]", -1 for BASE itself (no
+ * rotation). *tmp is set for a segment which is still being written */
+static long seg_num(const char* name, bool* tmp)
+{
+	const char* s = name + seg_base_len;
+	char* end;
+	long n;
+
+	*tmp = false;
+	if (s[0] != '.' || s[1] < '0' || s[1] > '9')
+		return -1;
+	n = strtol(s + 1, &end, 10);
+	if (strncmp(end, ".gz", 3) == 0)
+		end += 3;
+	*tmp = strcmp(end, ".tmp") == 0;
+	return n;
+}
+
+/* sort segments by number, the file without number first and NAME.N before
+ * a NAME.N.tmp of an earlier run */
+static int seg_cmp(const void* a, const void* b)
+{
+	bool ta, tb;
+	long na = seg_num(*(const char**)a, &ta);
+	long nb = seg_num(*(const char**)b, &tb);
+
+	if (na != nb)
+		return (na > nb) - (na < nb);
+	return ta - tb;
+}
+
+int outfile_query_run(const char* base)
+{
+	char pattern[PATH_MAX];
+	glob_t g;
+	size_t i;
+
+	if (base[0] == '\0') {
+		LOG_ERR("Query needs the outfile name (-o)");
+		return 1;
+	}
+
+	/* NAME (without rotation), NAME.N and NAME.N.tmp (being written) */
+	memset(&g, 0, sizeof(g));
+	glob(base, GLOB_NOSORT, NULL, &g);
+	snprintf(pattern, sizeof(pattern), "%s.[0-9]*", base);
+	glob(pattern, GLOB_NOSORT | GLOB_APPEND, NULL, &g);
+
+	seg_base_len = strlen(base);
+	for (i = 0; i < g.gl_pathc; i++) {
+		if (strstr(g.gl_pathv[i] + seg_base_len, ".gz") != NULL)
+			LOG_ERR("Skipping compressed %s", g.gl_pathv[i]);
+	}
+	/* NAME.N.tmp sorts by its number too */
+	qsort(g.gl_pathv, g.gl_pathc, sizeof(char*), seg_cmp);
+
+	printf(OUTFILE_CSV_HEADER);
+	for (i = 0; i < g.gl_pathc; i++) {
+		if (strstr(g.gl_pathv[i] + seg_base_len, ".gz") == NULL)
+			query_file(g.gl_pathv[i]);
+	}
+	globfree(&g);
+
+	LOG_INF("Query: %lu records from %lu of %lu blocks in %u files (%u skipped by index)",
+		qs.records, qs.blocks_read, qs.blocks, qs.files, qs.files_skipped);
+	return 0;
+}
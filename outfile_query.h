@@ -0,0 +1,32 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTFILE_QUERY_H_
+#define _OUTFILE_QUERY_H_
+
+#include <stdbool.h>
+
+/* add a query term: mac=MAC, from=TIME or to=TIME */
+bool outfile_query_add(const char* term);
+
+/* print matching records of the binary outfile 'base' and its segments as
+ * CSV, returns the exit code */
+int outfile_query_run(const char* base);
+
+#endif
@@ -0,0 +1,247 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <uwifi/util.h>
+#include <uwifi/wlan80211.h>
+#include <uwifi/wlan_util.h>
+
+#include "hutil.h"
+#include "outfile_reader.h"
+
+static uint64_t get(const struct outfile_reader* r, const unsigned char* p,
+		    unsigned int width)
+{
+	unsigned char b[8];
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < width && i < sizeof(b); i++)
+		b[i] = p[r->swapped ? width - 1 - i : i];
+
+	switch (width) {
+	case 1: v = b[0]; break;
+	case 2: { uint16_t x; memcpy(&x, b, 2); v = x; break; }
+	case 4: { uint32_t x; memcpy(&x, b, 4); v = x; break; }
+	case 8: memcpy(&v, b, 8); break;
+	}
+	return v;
+}
+
+ssize_t outfile_read_header(struct outfile_reader* r,
+			    const unsigned char* buf, size_t len)
+{
+	struct outfile_header hdr;
+	unsigned int i;
+
+	if (len < sizeof(hdr))
+		return 0;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (memcmp(hdr.magic, OUTFILE_MAGIC, sizeof(hdr.magic)) != 0)
+		return -1;
+
+	r->swapped = (hdr.bom != OUTFILE_BOM);
+	if (r->swapped && __builtin_bswap32(hdr.bom) != OUTFILE_BOM)
+		return -1;
+
+	r->columns = get(r, (unsigned char*)&hdr.columns, 2);
+	if (r->columns < COL_MAX || r->columns > sizeof(r->widths))
+		return -1;
+
+	if (len < sizeof(hdr) + r->columns)
+		return 0;
+
+	memcpy(r->widths, buf + sizeof(hdr), r->columns);
+
+	/* the meaning of the known columns never changes */
+	for (i = 0; i < COL_MAX; i++) {
+		if (r->widths[i] != outfile_col_width[i])
+			return -1;
+	}
+	return sizeof(hdr) + r->columns;
+}
+
+ssize_t outfile_read_block(const struct outfile_reader* r,
+			   const unsigned char* buf, size_t len,
+			   struct outfile_rblock* b)
+{
+	struct outfile_block* h = &b->hdr;
+	size_t pos;
+	unsigned int i;
+
+	if (len < sizeof(*h))
+		return 0;
+
+	memcpy(h, buf, sizeof(*h));
+	if (r->swapped) {
+		h->magic = __builtin_bswap32(h->magic);
+		h->records = __builtin_bswap32(h->records);
+		h->ts_sec = __builtin_bswap64(h->ts_sec);
+		h->ts_usec = __builtin_bswap32(h->ts_usec);
+		h->macs = __builtin_bswap16(h->macs);
+		h->essids = __builtin_bswap16(h->essids);
+	}
+
+	if (h->magic == OUTFILE_INDEX_MAGIC)
+		return OUTFILE_READ_END;
+
+	if (h->magic != OUTFILE_BLOCK_MAGIC || h->records > OUTFILE_BLOCK_RECORDS ||
+	    h->macs > 3 * OUTFILE_BLOCK_RECORDS || h->essids > OUTFILE_BLOCK_RECORDS)
+		return -1;
+
+	pos = sizeof(*h);
+	b->macs = buf + pos;
+	pos += WLAN_MAC_LEN * h->macs;
+
+	for (i = 0; i < h->essids; i++) {
+		if (pos >= len)
+			return 0;
+		b->essids[i] = buf + pos;
+		pos += 1 + buf[pos];
+	}
+
+	for (i = 0; i < r->columns; i++) {
+		b->col[i] = buf + pos;
+		pos += r->widths[i] * h->records;
+	}
+	if (pos > len)
+		return 0;
+
+	/* indexes from a broken file must not point outside the tables */
+	for (i = 0; i < h->records; i++) {
+		if (outfile_rval(r, b, COL_SRC, i) >= h->macs ||
+		    outfile_rval(r, b, COL_DST, i) >= h->macs ||
+		    outfile_rval(r, b, COL_BSSID, i) >= h->macs ||
+		    outfile_rval(r, b, COL_ESSID, i) >= h->essids)
+			return -1;
+	}
+	return pos;
+}
+
+bool outfile_read_trailer(const struct outfile_reader* r,
+			  const unsigned char* buf, size_t len,
+			  struct outfile_index_trailer* t)
+{
+	if (len < sizeof(*t))
+		return false;
+
+	memcpy(t, buf + len - sizeof(*t), sizeof(*t));
+	if (r->swapped) {
+		t->first_usec = __builtin_bswap64(t->first_usec);
+		t->last_usec = __builtin_bswap64(t->last_usec);
+		t->index_offset = __builtin_bswap64(t->index_offset);
+		t->blocks = __builtin_bswap32(t->blocks);
+		t->bloom_bytes = __builtin_bswap32(t->bloom_bytes);
+		t->bloom_hashes = __builtin_bswap32(t->bloom_hashes);
+		t->magic = __builtin_bswap32(t->magic);
+	}
+
+	return t->magic == OUTFILE_TRAILER_MAGIC &&
+	       t->bloom_bytes == OUTFILE_BLOOM_BYTES &&
+	       t->bloom_hashes == OUTFILE_BLOOM_HASHES &&
+	       t->index_offset + 8 + (uint64_t)t->blocks *
+			sizeof(struct outfile_index_entry) +
+			t->bloom_bytes + sizeof(*t) == len;
+}
+
+uint64_t outfile_rval(const struct outfile_reader* r,
+		      const struct outfile_rblock* b,
+		      enum outfile_column c, unsigned int i)
+{
+	return get(r, b->col[c] + i * r->widths[c], r->widths[c]);
+}
+
+int64_t outfile_rtime(const struct outfile_reader* r,
+		      const struct outfile_rblock* b, unsigned int i)
+{
+	return b->hdr.ts_sec * 1000000LL + b->hdr.ts_usec +
+	       outfile_rval(r, b, COL_TS, i);
+}
+
+const unsigned char* outfile_rmac(const struct outfile_reader* r,
+				  const struct outfile_rblock* b,
+				  enum outfile_column c, unsigned int i)
+{
+	return b->macs + WLAN_MAC_LEN * outfile_rval(r, b, c, i);
+}
+
+bool outfile_rblock_has_mac(const struct outfile_rblock* b,
+			    const unsigned char* mac)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->hdr.macs; i++) {
+		if (memcmp(b->macs + i * WLAN_MAC_LEN, mac, WLAN_MAC_LEN) == 0)
+			return true;
+	}
+	return false;
+}
+
+void outfile_print_csv(FILE* out, const struct outfile_reader* r,
+		       const struct outfile_rblock* b, unsigned int i)
+{
+	const unsigned char* essid;
+	char buf[40];
+	struct tm* ltm;
+	time_t sec;
+	int64_t usec;
+	unsigned int enc, ip;
+	int n;
+
+	usec = outfile_rtime(r, b, i);
+	sec = usec / 1000000;
+	ltm = localtime(&sec);
+
+	/* same layout as write_csv() in outfile.c */
+	n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", ltm);
+	n += snprintf(buf + n, sizeof(buf) - n, ".%06ld", (long)(usec % 1000000));
+	n += strftime(buf + n, sizeof(buf) - n, " %z", ltm);
+	fprintf(out, "%s, ", buf);
+
+	fprintf(out, "%s, " MAC_FMT ", ",
+		wlan_get_packet_type_name(outfile_rval(r, b, COL_WLAN_TYPE, i)),
+		MAC_PAR(outfile_rmac(r, b, COL_SRC, i)));
+	fprintf(out, MAC_FMT ", ", MAC_PAR(outfile_rmac(r, b, COL_DST, i)));
+	fprintf(out, MAC_FMT ", ", MAC_PAR(outfile_rmac(r, b, COL_BSSID, i)));
+	fprintf(out, "%x, %d, %d, %d, %d, ",
+		(unsigned int)outfile_rval(r, b, COL_PKT_TYPES, i),
+		(int8_t)outfile_rval(r, b, COL_SIGNAL, i),
+		(int)outfile_rval(r, b, COL_LEN, i),
+		(int)outfile_rval(r, b, COL_RATE, i),
+		(int)outfile_rval(r, b, COL_FREQ, i));
+	fprintf(out, "%016llx, ",
+		(unsigned long long)outfile_rval(r, b, COL_TSF, i));
+	essid = b->essids[outfile_rval(r, b, COL_ESSID, i)];
+	enc = outfile_rval(r, b, COL_ENC, i);
+	fprintf(out, "%.*s, %d, %d, %d, %d, %d, ",
+		essid[0], essid + 1, (int)outfile_rval(r, b, COL_MODE, i),
+		(int)outfile_rval(r, b, COL_CHANNEL, i),
+		!!(enc & OUTFILE_ENC_WEP), !!(enc & OUTFILE_ENC_WPA),
+		!!(enc & OUTFILE_ENC_RSN));
+	/* IP addresses are kept in network order, no swapping */
+	memcpy(&ip, b->col[COL_IP_SRC] + i * 4, 4);
+	fprintf(out, "%s, ", ip_sprintf(ip));
+	memcpy(&ip, b->col[COL_IP_DST] + i * 4, 4);
+	fprintf(out, "%s, ", ip_sprintf(ip));
+	fprintf(out, "%d\n", (int)outfile_rval(r, b, COL_INTF, i));
+}
@@ -0,0 +1,82 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTFILE_READER_H_
+#define _OUTFILE_READER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "outfile_format.h"
+
+/* reading binary outfiles, used by horst -Q and horst-logcat */
+
+#define OUTFILE_READ_END	-2	/* index reached */
+
+struct outfile_reader {
+	bool			swapped;
+	unsigned int		columns;
+	uint8_t			widths[256];
+};
+
+/* decoded block, pointing into the buffer it was read from */
+struct outfile_rblock {
+	struct outfile_block	hdr;	/* in host order */
+	const unsigned char*	macs;
+	const unsigned char*	essids[OUTFILE_BLOCK_RECORDS];	/* length, string */
+	const unsigned char*	col[256];
+};
+
+/* return the length of the file header, 0 if 'len' is too short, -1 if this
+ * is not a binary outfile */
+ssize_t outfile_read_header(struct outfile_reader* r,
+			    const unsigned char* buf, size_t len);
+
+/* return the length of the block at 'buf', 0 if 'len' is too short, -1 if
+ * the data is broken or OUTFILE_READ_END */
+ssize_t outfile_read_block(const struct outfile_reader* r,
+			   const unsigned char* buf, size_t len,
+			   struct outfile_rblock* b);
+
+/* return the index trailer of a complete file (in host order) or false */
+bool outfile_read_trailer(const struct outfile_reader* r,
+			  const unsigned char* buf, size_t len,
+			  struct outfile_index_trailer* t);
+
+uint64_t outfile_rval(const struct outfile_reader* r,
+		      const struct outfile_rblock* b,
+		      enum outfile_column c, unsigned int i);
+
+int64_t outfile_rtime(const struct outfile_reader* r,
+		      const struct outfile_rblock* b, unsigned int i);
+
+const unsigned char* outfile_rmac(const struct outfile_reader* r,
+				  const struct outfile_rblock* b,
+				  enum outfile_column c, unsigned int i);
+
+bool outfile_rblock_has_mac(const struct outfile_rblock* b,
+			    const unsigned char* mac);
+
+/* print a record in the format of outfile_format=csv */
+void outfile_print_csv(FILE* out, const struct outfile_reader* r,
+		       const struct outfile_rblock* b, unsigned int i);
+
+#endif
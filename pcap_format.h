@@ -0,0 +1,60 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _PCAP_FORMAT_H_
+#define _PCAP_FORMAT_H_
+
+#include <stdint.h>
+
+/* pcap and pcapng file format constants */
+
+#define PCAP_MAGIC_USEC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_BOM		0x1a2b3c4d
+
+#define PCAPNG_IDB		1
+#define PCAPNG_PB		2	/* obsolete packet block */
+#define PCAPNG_SPB		3
+#define PCAPNG_EPB		6
+
+#define PCAPNG_OPT_END		0
+#define PCAPNG_OPT_SHB_USERAPPL	4
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_OPT_TSRESOL	9
+#define PCAPNG_OPT_CUSTOM_BIN	2989	/* binary, copyable */
+
+/* horst has no Private Enterprise Number of its own, so custom options use
+ * the one reserved for documentation (RFC 5612) */
+#define PCAPNG_HORST_PEN	32473
+
+/* payload of horst's custom EPB option, after the PEN, in the byte order
+ * of the section */
+struct pcapng_horst_opt {
+	uint32_t		pen;
+	uint32_t		pkt_duration;	/* usec */
+	uint16_t		freq;		/* MHz */
+	int16_t			chan_idx;	/* in the spectrum, -1 unknown */
+} __attribute__ ((packed));
+
+#define LINKTYPE_IEEE802_11		105
+#define LINKTYPE_PRISM_HEADER		119
+#define LINKTYPE_IEEE802_11_RADIOTAP	127
+
+#endif
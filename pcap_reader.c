@@ -0,0 +1,371 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <net/if_arp.h>
+
+#include <uwifi/log.h>
+
+#include "pcap_format.h"
+#include "pcap_reader.h"
+
+/*
+ * Minimal reader for pcap and pcapng files with 802.11 frames (radiotap,
+ * prism or plain 802.11 link types), in either byte order. The file is read
+ * sequentially with stdio so it also works on pipes. Each open file has its
+ * own state, so several files can be read in parallel.
+ */
+
+#define MAX_BLOCK_LEN		(16 * 1024 * 1024)
+#define MAX_PCAPNG_INTF		32
+
+struct pcap_reader {
+	FILE*		in;
+	bool		swapped;
+	bool		is_ng;
+
+	/* classic pcap */
+	int		pcap_arphdr;
+	uint64_t	pcap_tsres;
+
+	/* pcapng interfaces of the current section */
+	struct {
+		int		arphdr;
+		uint64_t	tsres;		/* timestamp units per second */
+	} intfs[MAX_PCAPNG_INTF];
+	int		num_intfs;
+
+	unsigned char*	buf;
+	size_t		buf_size;
+};
+
+static uint16_t get16(const struct pcap_reader* r, const unsigned char* p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return r->swapped ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t get32(const struct pcap_reader* r, const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return r->swapped ? __builtin_bswap32(v) : v;
+}
+
+static int linktype_to_arphdr(unsigned int linktype)
+{
+	switch (linktype) {
+	case LINKTYPE_IEEE802_11:		return ARPHRD_IEEE80211;
+	case LINKTYPE_PRISM_HEADER:		return ARPHRD_IEEE80211_PRISM;
+	case LINKTYPE_IEEE802_11_RADIOTAP:	return ARPHRD_IEEE80211_RADIOTAP;
+	}
+	LOG_ERR("Unsupported pcap link type %u, frames are skipped", linktype);
+	return -1;
+}
+
+static void ts_convert(uint64_t t, uint64_t res, struct timespec* ts)
+{
+	uint64_t rem = t % res;
+
+	ts->tv_sec = t / res;
+	if (res <= 1000000000)
+		ts->tv_nsec = rem * (1000000000 / res);
+	else
+		ts->tv_nsec = rem / (res / 1000000000);
+}
+
+static bool buf_reserve(struct pcap_reader* r, size_t len)
+{
+	unsigned char* n;
+
+	if (len <= r->buf_size)
+		return true;
+
+	if (len > MAX_BLOCK_LEN) {
+		LOG_ERR("pcap record too big (%zu)", len);
+		return false;
+	}
+
+	n = realloc(r->buf, len);
+	if (n == NULL)
+		return false;
+	r->buf = n;
+	r->buf_size = len;
+	return true;
+}
+
+static bool read_full(struct pcap_reader* r, unsigned char* p, size_t len)
+{
+	return fread(p, 1, len, r->in) == len;
+}
+
+static bool pcap_open_classic(struct pcap_reader* r, uint32_t magic)
+{
+	unsigned char hdr[20];
+
+	r->swapped = (magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+		      magic == __builtin_bswap32(PCAP_MAGIC_NSEC));
+	if (r->swapped)
+		magic = __builtin_bswap32(magic);
+
+	if (!read_full(r, hdr, sizeof(hdr)))
+		return false;
+
+	r->pcap_tsres = (magic == PCAP_MAGIC_NSEC) ? 1000000000 : 1000000;
+	r->pcap_arphdr = linktype_to_arphdr(get32(r, hdr + 16));
+	return true;
+}
+
+static int pcap_next_classic(struct pcap_reader* r, struct pcap_frame* f)
+{
+	unsigned char hdr[16];
+	uint32_t caplen;
+
+	if (!read_full(r, hdr, sizeof(hdr)))
+		return 0;
+
+	caplen = get32(r, hdr + 8);
+	if (!buf_reserve(r, caplen) || !read_full(r, r->buf, caplen))
+		return -1;
+
+	ts_convert((uint64_t)get32(r, hdr) * r->pcap_tsres + get32(r, hdr + 4),
+		   r->pcap_tsres, &f->ts);
+	f->buf = r->buf;
+	f->len = caplen;
+	f->orig_len = get32(r, hdr + 12);
+	f->arphdr = r->pcap_arphdr;
+	f->intf = 0;
+	return 1;
+}
+
+/* section header block, after the block type has been read */
+static bool pcapng_read_shb(struct pcap_reader* r)
+{
+	unsigned char hdr[8];
+	uint32_t len;
+
+	if (!read_full(r, hdr, sizeof(hdr)))
+		return false;
+
+	/* byte order magic follows the length */
+	r->swapped = false;
+	if (get32(r, hdr + 4) != PCAPNG_BOM) {
+		r->swapped = true;
+		if (get32(r, hdr + 4) != PCAPNG_BOM)
+			return false;
+	}
+
+	len = get32(r, hdr);
+	if (len < 28 || !buf_reserve(r, len) || !read_full(r, r->buf, len - 12))
+		return false;
+
+	r->num_intfs = 0;
+	return true;
+}
+
+static void pcapng_read_idb(struct pcap_reader* r, unsigned char* b, uint32_t len)
+{
+	uint64_t tsres = 1000000;
+	unsigned char* opt = b + 8;
+	uint16_t code, olen;
+	unsigned char v;
+
+	/* options */
+	while (opt + 4 <= b + len) {
+		code = get16(r, opt);
+		olen = get16(r, opt + 2);
+		if (code == PCAPNG_OPT_END || opt + 4 + olen > b + len)
+			break;
+		if (code == PCAPNG_OPT_TSRESOL && olen >= 1) {
+			v = opt[4];
+			if (v & 0x80)
+				tsres = 1ULL << (v & 0x3f);
+			else
+				for (tsres = 1; v > 0 && v <= 18; v--)
+					tsres *= 10;
+		}
+		opt += 4 + ((olen + 3) & ~3);
+	}
+
+	if (r->num_intfs >= MAX_PCAPNG_INTF) {
+		LOG_ERR("Too many pcapng interfaces");
+		return;
+	}
+	r->intfs[r->num_intfs].arphdr = linktype_to_arphdr(get16(r, b));
+	r->intfs[r->num_intfs].tsres = tsres;
+	r->num_intfs++;
+}
+
+static int pcapng_next(struct pcap_reader* r, struct pcap_frame* f)
+{
+	unsigned char hdr[8];
+	uint32_t type, len, intf, caplen;
+	unsigned char* b;
+
+	for (;;) {
+		if (!read_full(r, hdr, 4))
+			return 0;
+
+		/* a new section may change the byte order */
+		if (get32(r, hdr) == PCAPNG_SHB) {
+			if (!pcapng_read_shb(r))
+				return -1;
+			continue;
+		}
+
+		if (!read_full(r, hdr + 4, 4))
+			return 0;
+		type = get32(r, hdr);
+		len = get32(r, hdr + 4);
+		if (len < 12 || len % 4 != 0 || !buf_reserve(r, len) ||
+		    !read_full(r, r->buf, len - 8))
+			return -1;
+
+		/* block body, without the trailing length */
+		b = r->buf;
+		len -= 12;
+
+		switch (type) {
+		case PCAPNG_IDB:
+			if (len >= 8)
+				pcapng_read_idb(r, b, len);
+			continue;
+		case PCAPNG_EPB:
+			if (len < 20)
+				return -1;
+			intf = get32(r, b);
+			caplen = get32(r, b + 12);
+			f->orig_len = get32(r, b + 16);
+			b += 20;
+			len -= 20;
+			break;
+		case PCAPNG_PB:
+			if (len < 20)
+				return -1;
+			intf = get16(r, b);
+			caplen = get32(r, b + 12);
+			f->orig_len = get32(r, b + 16);
+			b += 20;
+			len -= 20;
+			break;
+		case PCAPNG_SPB:
+			/* no timestamp: keep the one of the previous frame */
+			if (len < 4)
+				return -1;
+			intf = 0;
+			f->orig_len = get32(r, b);
+			caplen = f->orig_len;
+			b += 4;
+			len -= 4;
+			break;
+		default:
+			continue;
+		}
+
+		if (caplen > len)
+			return -1;
+
+		if (intf >= (uint32_t)r->num_intfs || r->intfs[intf].arphdr < 0)
+			continue;
+
+		if (type != PCAPNG_SPB)
+			ts_convert((uint64_t)get32(r, r->buf + 4) << 32 |
+				   get32(r, r->buf + 8), r->intfs[intf].tsres,
+				   &f->ts);
+		f->buf = b;
+		f->len = caplen;
+		f->arphdr = r->intfs[intf].arphdr;
+		f->intf = intf;
+		return 1;
+	}
+}
+
+struct pcap_reader* pcap_reader_open(const char* name)
+{
+	struct pcap_reader* r;
+	unsigned char m[4];
+	uint32_t magic;
+
+	r = calloc(1, sizeof(struct pcap_reader));
+	if (r == NULL)
+		return NULL;
+
+	if (strcmp(name, "-") == 0)
+		r->in = stdin;
+	else
+		r->in = fopen(name, "rb");
+
+	if (r->in == NULL) {
+		LOG_ERR("Could not open '%s'", name);
+		free(r);
+		return NULL;
+	}
+
+	if (!read_full(r, m, sizeof(m)))
+		goto fail;
+
+	memcpy(&magic, m, sizeof(magic));
+	if (magic == PCAPNG_SHB) {
+		r->is_ng = true;
+		if (!pcapng_read_shb(r))
+			goto fail;
+		return r;
+	}
+
+	if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+	    magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+	    magic == __builtin_bswap32(PCAP_MAGIC_NSEC)) {
+		r->is_ng = false;
+		if (pcap_open_classic(r, magic))
+			return r;
+	}
+
+fail:
+	LOG_ERR("'%s' is not a pcap or pcapng file", name);
+	pcap_reader_close(r);
+	return NULL;
+}
+
+int pcap_reader_next(struct pcap_reader* r, struct pcap_frame* f)
+{
+	int ret;
+
+	do {
+		ret = r->is_ng ? pcapng_next(r, f) : pcap_next_classic(r, f);
+	} while (ret == 1 && f->arphdr < 0);
+
+	if (ret < 0)
+		LOG_ERR("Broken pcap file");
+	return ret;
+}
+
+void pcap_reader_close(struct pcap_reader* r)
+{
+	if (r == NULL)
+		return;
+
+	if (r->in != stdin)
+		fclose(r->in);
+	free(r->buf);
+	free(r);
+}
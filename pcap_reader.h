@@ -0,0 +1,46 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _PCAP_READER_H_
+#define _PCAP_READER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+struct pcap_frame {
+	unsigned char*		buf;	/* valid until the next call */
+	size_t			len;
+	size_t			orig_len;
+	struct timespec		ts;
+	int			arphdr;
+	int			intf;	/* pcapng interface ID */
+};
+
+struct pcap_reader;
+
+/* open pcap or pcapng file, "-" is stdin. returns NULL on errors */
+struct pcap_reader* pcap_reader_open(const char* name);
+
+/* returns 1 for a frame, 0 at end of file and -1 on errors */
+int pcap_reader_next(struct pcap_reader* r, struct pcap_frame* f);
+
+void pcap_reader_close(struct pcap_reader* r);
+
+#endif
@@ -0,0 +1,367 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <net/if_arp.h>
+
+#include <uwifi/log.h>
+
+#include "main.h"
+#include "hutil.h"
+#include "pcap_format.h"
+#include "pcap_writer.h"
+
+/*
+ * Record the raw captured frames to pcapng, as they came from the socket.
+ * Every frame gets a custom option with the airtime and channel index horst
+ * calculated for it.
+ *
+ * With pcap_rotate_size or pcap_rotate_time the files are named FILE.0,
+ * FILE.1, ... continuing after the files of a previous run, and only the last
+ * pcap_rotate_files of them are kept. The
+ * interface description blocks are written to each file when they are first
+ * needed.
+ */
+
+#define STDIO_BUF_SIZE		(256 * 1024)
+#define MAX_IDB			(MAX_INTERFACES * 3)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* pf;
+static char pf_name[MAX_CONF_VALUE_STRLEN + 16];
+static int write_errno;
+static unsigned int seq;
+static bool seq_found;
+static size_t file_bytes;
+static time_t file_start;
+
+/* interfaces described in the current file */
+static struct {
+	int	intf_idx;
+	int	arphdr;
+} idbs[MAX_IDB];
+static int num_idb;
+
+static const uint32_t zero;
+
+/* the capture threads can not log, so the main thread reports this */
+static bool err_pending;
+static const char* err_what;
+static int err_errno;
+static char err_name[MAX_CONF_VALUE_STRLEN + 16];
+
+static bool rotating(void)
+{
+	return conf.pcap_rotate_size > 0 || conf.pcap_rotate_time > 0;
+}
+
+static void file_name(char* buf, size_t size, unsigned int n)
+{
+	if (rotating())
+		snprintf(buf, size, "%s.%u", conf.pcapfile, n);
+	else
+		snprintf(buf, size, "%s", conf.pcapfile);
+}
+
+/* called with the lock held, stops writing until the file is set again */
+static void file_error(const char* what, int e)
+{
+	if (!err_pending) {
+		err_what = what;
+		err_errno = e;
+		strcpy(err_name, pf_name);
+		__atomic_store_n(&err_pending, true, __ATOMIC_RELEASE);
+	}
+	conf.pcapfile[0] = '\0';
+}
+
+/* errors are checked once per block, see write_check() */
+static void write_data(const void* data, size_t len)
+{
+	if (fwrite(data, 1, len, pf) != len && write_errno == 0)
+		write_errno = errno != 0 ? errno : EIO;
+	file_bytes += len;
+}
+
+static void write_u16(uint16_t v)
+{
+	write_data(&v, sizeof(v));
+}
+
+static void write_u32(uint32_t v)
+{
+	write_data(&v, sizeof(v));
+}
+
+static size_t pad4(size_t len)
+{
+	return (4 - (len & 3)) & 3;
+}
+
+/* string option, padded */
+static void write_opt_str(uint16_t code, const char* str)
+{
+	size_t len = strlen(str);
+
+	write_u16(code);
+	write_u16(len);
+	write_data(str, len);
+	write_data(&zero, pad4(len));
+}
+
+static size_t opt_str_len(const char* str)
+{
+	return 4 + strlen(str) + pad4(strlen(str));
+}
+
+static void write_shb(void)
+{
+	const char* appl = "horst " VERSION;
+	uint32_t len = 28 + opt_str_len(appl) + 4;
+	int64_t section_len = -1;
+
+	write_u32(PCAPNG_SHB);
+	write_u32(len);
+	write_u32(PCAPNG_BOM);
+	write_u16(1);
+	write_u16(0);
+	write_data(&section_len, sizeof(section_len));
+	write_opt_str(PCAPNG_OPT_SHB_USERAPPL, appl);
+	write_u32(PCAPNG_OPT_END);
+	write_u32(len);
+}
+
+static int arphdr_to_linktype(int arphdr)
+{
+	switch (arphdr) {
+	case ARPHRD_IEEE80211:		return LINKTYPE_IEEE802_11;
+	case ARPHRD_IEEE80211_PRISM:	return LINKTYPE_PRISM_HEADER;
+	case ARPHRD_IEEE80211_RADIOTAP:	return LINKTYPE_IEEE802_11_RADIOTAP;
+	}
+	return -1;
+}
+
+/* returns the pcapng interface ID, writes the IDB if necessary */
+static int interface_id(int intf_idx, int arphdr)
+{
+	const char* ifname = get_intf(intf_idx)->ifname;
+	const uint8_t tsresol = 9;		/* nanoseconds */
+	int linktype = arphdr_to_linktype(arphdr);
+	uint32_t len;
+	int i;
+
+	for (i = 0; i < num_idb; i++) {
+		if (idbs[i].intf_idx == intf_idx && idbs[i].arphdr == arphdr)
+			return i;
+	}
+
+	if (linktype < 0 || num_idb >= MAX_IDB)
+		return -1;
+
+	len = 20 + opt_str_len(ifname) + 8 + 4;
+	write_u32(PCAPNG_IDB);
+	write_u32(len);
+	write_u16(linktype);
+	write_u16(0);
+	write_u32(0);			/* snaplen: unlimited */
+	write_opt_str(PCAPNG_OPT_IF_NAME, ifname);
+	write_u16(PCAPNG_OPT_TSRESOL);
+	write_u16(1);
+	write_data(&tsresol, sizeof(tsresol));
+	write_data(&zero, pad4(sizeof(tsresol)));
+	write_u32(PCAPNG_OPT_END);
+	write_u32(len);
+
+	idbs[num_idb].intf_idx = intf_idx;
+	idbs[num_idb].arphdr = arphdr;
+	return num_idb++;
+}
+
+static bool file_open(time_t now)
+{
+	char name[MAX_CONF_VALUE_STRLEN + 16];
+
+	/* a restart must not overwrite the files of the previous run */
+	if (!seq_found) {
+		seq = rotating() ? file_next_seq(conf.pcapfile) : 0;
+		seq_found = true;
+	}
+
+	file_name(pf_name, sizeof(pf_name), seq);
+	pf = fopen(pf_name, "w");
+	if (pf == NULL) {
+		file_error("open", errno);
+		return false;
+	}
+	write_errno = 0;
+	setvbuf(pf, NULL, _IOFBF, STDIO_BUF_SIZE);
+
+	/* ring buffer: remove the oldest file */
+	if (rotating() && conf.pcap_rotate_files > 0 &&
+	    seq >= conf.pcap_rotate_files) {
+		file_name(name, sizeof(name), seq - conf.pcap_rotate_files);
+		unlink(name);
+	}
+
+	file_bytes = 0;
+	file_start = now;
+	num_idb = 0;
+	write_shb();
+	return true;
+}
+
+static void file_close(void)
+{
+	if (pf == NULL)
+		return;
+
+	if (fclose(pf) != 0 && write_errno == 0)
+		file_error("write", errno);
+	pf = NULL;
+}
+
+/* a full disk must not leave a silently truncated file */
+static bool write_check(void)
+{
+	if (write_errno == 0 && !ferror(pf))
+		return true;
+
+	file_error("write", write_errno != 0 ? write_errno : EIO);
+	write_errno = -1;	/* reported, also when closing */
+	file_close();
+	return false;
+}
+
+static bool file_full(time_t now)
+{
+	return (conf.pcap_rotate_size > 0 &&
+		file_bytes >= (size_t)conf.pcap_rotate_size * 1024 * 1024) ||
+	       (conf.pcap_rotate_time > 0 &&
+		now - file_start >= conf.pcap_rotate_time);
+}
+
+void pcap_writer_frame(int intf_idx, int arphdr,
+		       const unsigned char* buf, size_t len, size_t orig_len,
+		       const struct timespec* ts, unsigned int pkt_duration,
+		       int freq, int chan_idx)
+{
+	struct pcapng_horst_opt opt;
+	struct timespec now;
+	uint64_t t;
+	uint32_t blen;
+	int id;
+
+	if (ts == NULL || ts->tv_sec == 0) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		ts = &now;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	if (conf.pcapfile[0] == '\0')
+		goto out;
+
+	if (pf != NULL && rotating() && file_full(ts->tv_sec)) {
+		file_close();
+		seq++;
+		if (conf.pcapfile[0] == '\0')
+			goto out;
+	}
+
+	if (pf == NULL && !file_open(ts->tv_sec))
+		goto out;
+
+	id = interface_id(intf_idx, arphdr);
+	if (id < 0)
+		goto out;
+
+	opt.pen = PCAPNG_HORST_PEN;
+	opt.pkt_duration = pkt_duration;
+	opt.freq = freq;
+	opt.chan_idx = chan_idx;
+
+	t = (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+	blen = 28 + len + pad4(len) + 4 + sizeof(opt) + 4 + 4;
+
+	write_u32(PCAPNG_EPB);
+	write_u32(blen);
+	write_u32(id);
+	write_u32(t >> 32);
+	write_u32(t & 0xffffffff);
+	write_u32(len);
+	write_u32(orig_len);
+	write_data(buf, len);
+	write_data(&zero, pad4(len));
+	write_u16(PCAPNG_OPT_CUSTOM_BIN);
+	write_u16(sizeof(opt));
+	write_data(&opt, sizeof(opt));
+	write_u32(PCAPNG_OPT_END);
+	write_u32(blen);
+	write_check();
+
+out:
+	pthread_mutex_unlock(&lock);
+}
+
+void pcap_writer_open(const char* name)
+{
+	pthread_mutex_lock(&lock);
+
+	file_close();
+	seq_found = false;
+
+	if (name == NULL || name[0] == '\0') {
+		LOG_INF("- Not writing pcap file");
+		conf.pcapfile[0] = '\0';
+	} else {
+		strncpy(conf.pcapfile, name, MAX_CONF_VALUE_STRLEN);
+		conf.pcapfile[MAX_CONF_VALUE_STRLEN] = '\0';
+		/* the file is created with the first frame, when the rotation
+		 * options have been read */
+		LOG_INF("- Writing frames to pcap file %s", conf.pcapfile);
+	}
+
+	pthread_mutex_unlock(&lock);
+	pcap_writer_report_errors();
+}
+
+void pcap_writer_report_errors(void)
+{
+	if (!__atomic_load_n(&err_pending, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&lock);
+	LOG_ERR("Couldn't %s pcap file '%s' (%s)", err_what, err_name,
+		strerror(err_errno));
+	err_pending = false;
+	pthread_mutex_unlock(&lock);
+}
+
+void pcap_writer_close(void)
+{
+	pthread_mutex_lock(&lock);
+	file_close();
+	pthread_mutex_unlock(&lock);
+	pcap_writer_report_errors();
+}
@@ -0,0 +1,40 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _PCAP_WRITER_H_
+#define _PCAP_WRITER_H_
+
+#include <stddef.h>
+#include <time.h>
+
+/* start writing to 'name' (rotated files get a suffix), NULL or "" stops */
+void pcap_writer_open(const char* name);
+
+/* may be called from several capture threads */
+void pcap_writer_frame(int intf_idx, int arphdr,
+		       const unsigned char* buf, size_t len, size_t orig_len,
+		       const struct timespec* ts, unsigned int pkt_duration,
+		       int freq, int chan_idx);
+
+/* log errors of the capture threads, from the main thread */
+void pcap_writer_report_errors(void);
+
+void pcap_writer_close(void);
+
+#endif
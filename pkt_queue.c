@@ -0,0 +1,129 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "pkt_queue.h"
+
+bool pkt_queue_init(struct pkt_queue* q, unsigned int size)
+{
+	unsigned int sz = 2;
+
+	/* round up to power of two so we can use a mask */
+	while (sz < size)
+		sz <<= 1;
+
+	memset(q, 0, sizeof(struct pkt_queue));
+	q->slots = calloc(sz, sizeof(struct pkt_queue_entry));
+	if (q->slots == NULL)
+		return false;
+
+	q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (q->efd < 0) {
+		free(q->slots);
+		q->slots = NULL;
+		return false;
+	}
+
+	q->mask = sz - 1;
+	return true;
+}
+
+void pkt_queue_free(struct pkt_queue* q)
+{
+	if (q->slots == NULL)
+		return;
+
+	close(q->efd);
+	free(q->slots);
+	q->slots = NULL;
+}
+
+/* returns a slot to fill in or NULL when the queue is full */
+struct pkt_queue_entry* pkt_queue_reserve(struct pkt_queue* q)
+{
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	if (q->head - tail > q->mask) {
+		__atomic_add_fetch(&q->overflows, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &q->slots[q->head & q->mask];
+}
+
+/* make the slot returned by pkt_queue_reserve() visible to the consumer */
+void pkt_queue_commit(struct pkt_queue* q)
+{
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+/* wake up consumer, once per batch is enough */
+void pkt_queue_signal(struct pkt_queue* q)
+{
+	uint64_t one = 1;
+
+	if (write(q->efd, &one, sizeof(one)) < 0) {
+		/* counter overflow, consumer is woken up anyway */
+	}
+}
+
+/* reset eventfd before draining the queue */
+void pkt_queue_wait_clear(struct pkt_queue* q)
+{
+	uint64_t val;
+
+	if (read(q->efd, &val, sizeof(val)) < 0) {
+		/* EAGAIN: nothing signalled */
+	}
+}
+
+/* returns the oldest packet or NULL when the queue is empty */
+struct pkt_queue_entry* pkt_queue_peek(struct pkt_queue* q)
+{
+	unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	unsigned int depth = head - q->tail;
+
+	if (depth == 0)
+		return NULL;
+
+	if (depth > q->depth_max)
+		q->depth_max = depth;
+
+	return &q->slots[q->tail & q->mask];
+}
+
+/* give slot returned by pkt_queue_peek() back to the producer */
+void pkt_queue_release(struct pkt_queue* q)
+{
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int pkt_queue_depth(struct pkt_queue* q)
+{
+	return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - q->tail;
+}
+
+unsigned long pkt_queue_overflows(struct pkt_queue* q)
+{
+	return __atomic_load_n(&q->overflows, __ATOMIC_RELAXED);
+}
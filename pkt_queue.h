@@ -0,0 +1,74 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _PKT_QUEUE_H_
+#define _PKT_QUEUE_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <uwifi/wlan_parser.h>
+
+/*
+ * Bounded lock-free single-producer/single-consumer queue of parsed packets.
+ *
+ * The producer (capture thread) reserves a slot, fills it in place and
+ * commits it. The consumer (main thread) peeks at the oldest slot and releases
+ * it when done. Head and tail are only ever written by one side each, so
+ * acquire/release ordering on them is enough. The producer signals an eventfd
+ * once per batch so the consumer can wait for it with epoll.
+ */
+
+#define CACHELINE	64
+
+struct pkt_queue_entry {
+	struct uwifi_packet	pkt;
+	struct timespec		ts;	/* receive time, CLOCK_REALTIME */
+};
+
+struct pkt_queue {
+	struct pkt_queue_entry*	slots;
+	unsigned int		mask;
+	int			efd;
+
+	/* written by producer */
+	unsigned int		head __attribute__((aligned(CACHELINE)));
+	unsigned long		overflows;
+
+	/* written by consumer */
+	unsigned int		tail __attribute__((aligned(CACHELINE)));
+	unsigned int		depth_max;
+};
+
+bool pkt_queue_init(struct pkt_queue* q, unsigned int size);
+void pkt_queue_free(struct pkt_queue* q);
+
+/* producer */
+struct pkt_queue_entry* pkt_queue_reserve(struct pkt_queue* q);
+void pkt_queue_commit(struct pkt_queue* q);
+void pkt_queue_signal(struct pkt_queue* q);
+
+/* consumer */
+void pkt_queue_wait_clear(struct pkt_queue* q);
+struct pkt_queue_entry* pkt_queue_peek(struct pkt_queue* q);
+void pkt_queue_release(struct pkt_queue* q);
+unsigned int pkt_queue_depth(struct pkt_queue* q);
+unsigned long pkt_queue_overflows(struct pkt_queue* q);
+
+#endif
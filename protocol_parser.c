@@ -18,7 +18,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <net/if_arp.h>
 #include <netinet/ip.h>
@@ -32,111 +34,450 @@
 #include "olsr_header.h"
 #include "batman_header.h"
 #include "batman_adv_header-14.h"
+#include "batman_adv_header-15.h"
 #include "main.h"
 #include "hutil.h"
+#include "protocol_parser.h"
+#include "olsr.h"
+#include "batadv.h"
 
-static int parse_llc(unsigned char* buf, size_t len, struct uwifi_packet* p);
+static int parse_llc(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts);
 static int parse_ip_header(unsigned char* buf, size_t len, struct uwifi_packet* p);
-static int parse_udp_header(unsigned char* buf, size_t len, struct uwifi_packet* p);
-static int parse_olsr_packet(unsigned char* buf, size_t len, struct uwifi_packet* p);
-static int parse_batman_packet(unsigned char* buf, size_t len, struct uwifi_packet* p);
-static int parse_batman_adv_packet(unsigned char* buf, size_t len, struct uwifi_packet* p);
-static int parse_meshcruzer_packet(unsigned char* buf, size_t len, struct uwifi_packet* p, int port);
+static int parse_udp_header(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts);
+static int parse_olsr_packet(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts);
+static int parse_batman_adv_packet(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts);
+
+/*
+ * Dissectors for UDP ports and ethertypes. The maps are indexed directly by
+ * port or ethertype and contain the index into dissectors[] or 0, so finding
+ * the dissector is one lookup and a disabled dissector is simply not in the
+ * map any more. Dissectors without a function only classify the packet.
+ */
+
+struct dissector {
+	const char*	name;
+	dissector_fn	parse;
+	unsigned int	pkt_type;
+	uint16_t	key;
+	bool		udp;
+	bool		enabled;
+};
+
+static struct dissector dissectors[MAX_DISSECTORS + 1];	/* 0 is unused */
+static int num_dissectors;
+static uint8_t udp_map[65536];
+static uint8_t ether_map[65536];
+static unsigned int custom_types;	/* PKT_TYPE_CUSTOM bits used */
+
+static bool dissector_add(const char* name, bool udp, uint16_t key,
+			  dissector_fn fn, unsigned int pkt_type)
+{
+	uint8_t* map = udp ? udp_map : ether_map;
+	struct dissector* d;
+
+	if (num_dissectors >= MAX_DISSECTORS) {
+		LOG_ERR("Too many dissectors");
+		return false;
+	}
+
+	if (map[key] != 0) {
+		LOG_ERR("%s %d is already handled by dissector '%s'",
+			udp ? "UDP port" : "Ethertype", key,
+			dissectors[map[key]].name);
+		return false;
+	}
+
+	d = &dissectors[++num_dissectors];
+	d->name = name;
+	d->parse = fn;
+	d->pkt_type = pkt_type;
+	d->key = key;
+	d->udp = udp;
+	d->enabled = true;
+	map[key] = num_dissectors;
+	return true;
+}
+
+bool dissector_register_udp(const char* name, uint16_t port,
+			    dissector_fn fn, unsigned int pkt_type)
+{
+	return dissector_add(name, true, port, fn, pkt_type);
+}
+
+bool dissector_register_ether(const char* name, uint16_t ethertype,
+			      dissector_fn fn, unsigned int pkt_type)
+{
+	return dissector_add(name, false, ethertype, fn, pkt_type);
+}
+
+/* a dissector from the config: "NAME:PORT" or "NAME:ETHERTYPE". with the
+ * name of a built-in dissector this adds a port for it, otherwise the packets
+ * are only classified, with a PKT_TYPE_CUSTOM bit for each name */
+bool dissector_register_custom(const char* value, bool udp)
+{
+	const char* colon = strchr(value, ':');
+	dissector_fn fn = NULL;
+	unsigned int type = 0;
+	char* end;
+	char* name;
+	long key;
+	int i;
+
+	key = colon ? strtol(colon + 1, &end, 0) : -1;
+	if (colon == NULL || colon == value || *end != '\0' ||
+	    key <= 0 || key > 0xffff) {
+		LOG_ERR("Invalid dissector '%s', use NAME:%s", value,
+			udp ? "PORT" : "ETHERTYPE");
+		return false;
+	}
+
+	name = strndup(value, colon - value);
+	if (name == NULL)
+		return false;
+
+	/* another port for a known protocol, or a new custom protocol */
+	for (i = 1; i <= num_dissectors; i++) {
+		if (strcasecmp(dissectors[i].name, name) == 0) {
+			fn = dissectors[i].parse;
+			type = dissectors[i].pkt_type;
+			break;
+		}
+	}
+	if (type == 0) {
+		if (custom_types == PKT_TYPE_CUSTOM) {
+			LOG_ERR("Too many custom dissectors");
+			free(name);
+			return false;
+		}
+		/* lowest free bit */
+		type = (custom_types + PKT_TYPE_CUSTOM_FIRST) & ~custom_types;
+	}
+
+	if (!dissector_add(name, udp, key, fn, type)) {
+		free(name);
+		return false;
+	}
+	custom_types |= type & PKT_TYPE_CUSTOM;
+	return true;
+}
+
+bool dissector_enable(const char* name, bool on)
+{
+	bool found = false;
+	struct dissector* d;
+	int i;
+
+	for (i = 1; i <= num_dissectors; i++) {
+		d = &dissectors[i];
+		if (strcasecmp(d->name, name) != 0)
+			continue;
+		d->enabled = on;
+		(d->udp ? udp_map : ether_map)[d->key] = on ? i : 0;
+		found = true;
+	}
+
+	if (!found)
+		LOG_ERR("Unknown dissector '%s'", name);
+	return found;
+}
+
+/* PKT_TYPE of dissector 'name' or 0 */
+unsigned int dissector_pkt_type(const char* name)
+{
+	int i;
+
+	for (i = 1; i <= num_dissectors; i++) {
+		if (strcasecmp(dissectors[i].name, name) == 0)
+			return dissectors[i].pkt_type;
+	}
+	return 0;
+}
+
+/* name of the first custom dissector which classified the packet */
+const char* dissector_custom_name(unsigned int pkt_types)
+{
+	int i;
+
+	for (i = 1; i <= num_dissectors; i++) {
+		if (dissectors[i].pkt_type & pkt_types & PKT_TYPE_CUSTOM)
+			return dissectors[i].name;
+	}
+	return "";
+}
+
+static int dissect(uint8_t idx, unsigned char* buf, size_t len,
+		   struct uwifi_packet* p, const struct timespec* ts)
+{
+	struct dissector* d = &dissectors[idx];
+	int ret = 0;
+
+	if (d->parse != NULL)
+		ret = d->parse(buf, len, p, ts);
+	if (ret >= 0)
+		p->pkt_types |= d->pkt_type;
+	return ret;
+}
+
+/* written by the main thread, read by the capture threads */
+static enum parse_depth parse_depth = PARSE_ALL;
+
+void parse_set_depth(enum parse_depth depth)
+{
+	if (depth != __atomic_load_n(&parse_depth, __ATOMIC_RELAXED))
+		LOG_DBG("parse depth %d", depth);
+	__atomic_store_n(&parse_depth, depth, __ATOMIC_RELAXED);
+}
+
+/* the layer which has to be parsed to know if a packet is one of these types */
+enum parse_depth parse_depth_for_pkt_types(unsigned int types)
+{
+	if (types & (PKT_TYPE_OLSR | PKT_TYPE_BATMAN | PKT_TYPE_MESHZ | PKT_TYPE_CUSTOM))
+		return PARSE_ALL;
+	if (types & (PKT_TYPE_IP | PKT_TYPE_ICMP | PKT_TYPE_UDP | PKT_TYPE_TCP))
+		return PARSE_IP;
+	if (types & PKT_TYPE_ARP)
+		return PARSE_LLC;
+	return PARSE_WLAN;
+}
+
+/* built-in dissectors */
+void protocol_parser_init(void)
+{
+	olsr_orig_init();
+	batadv_orig_init();
+
+	dissector_register_ether("ARP", 0x0806, NULL, PKT_TYPE_ARP);
+	dissector_register_ether("BATMAN-ADV", ETH_P_BATMAN,
+				 parse_batman_adv_packet, PKT_TYPE_BATMAN);
+	dissector_register_udp("OLSR", 698, parse_olsr_packet, PKT_TYPE_OLSR);
+	dissector_register_udp("BATMAN", BAT_PORT, NULL, PKT_TYPE_BATMAN);
+	dissector_register_udp("MESHZ", 9256, NULL, PKT_TYPE_MESHZ);
+	dissector_register_udp("MESHZ", 9257, NULL, PKT_TYPE_MESHZ);
+}
 
 /* return true if we parsed enough = min ieee header */
-bool parse_packet(unsigned char* buf, size_t len, struct uwifi_packet* p)
+bool parse_packet(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		  int arphdr, const struct timespec* ts)
 {
-	int ret = uwifi_parse_raw(buf, len, p, conf.intf.arphdr);
+	enum parse_depth depth = __atomic_load_n(&parse_depth, __ATOMIC_RELAXED);
+	int ret = uwifi_parse_raw(buf, len, p, arphdr);
 	if (ret == 0)
 		return true;
 	else if (ret < 0)
 		return false;
 
+	if (depth == PARSE_WLAN)
+		return true;
+
 	len -= ret; buf += ret;
-	ret = parse_llc(buf, len, p);
-	if (ret <= 0)
+	ret = parse_llc(buf, len, p, ts);
+	if (ret <= 0 || depth == PARSE_LLC)
 		return true;
 
 	len -= ret; buf += ret;
 	ret = parse_ip_header(buf, len, p);
-	if (ret <= 0)
+	if (ret <= 0 || depth == PARSE_IP)
 		return true;
 
 	len -= ret; buf += ret;
-	parse_udp_header(buf, len, p);
+	parse_udp_header(buf, len, p, ts);
 	return true;
 }
 
-static int parse_llc(unsigned char* buf, size_t len, struct uwifi_packet* p)
+static int parse_llc(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts)
 {
+	uint16_t ethertype;
+	int ret;
+
 	LOG_DBG("* parse LLC");
 
-	if (len < 6)
+	if (len < 8)
 		return -1;
 
 	/* check type in LLC header */
-	buf = buf + 6;
-
-	if (ntohs(*((uint16_t*)buf)) == 0x4305) {
-		LOG_DBG("BATMAN-ADV");
-		buf++; buf++;
-		return parse_batman_adv_packet(buf, len - 8, p);
-	}
-	else {
-		if (*buf != 0x08)
-			return -1;
-		buf++;
-		if (*buf == 0x06) { /* ARP */
-			p->pkt_types |= PKT_TYPE_ARP;
-			return 0;
-		}
-		if (*buf != 0x00)  /* not IP */
-			return -1;
-		buf++;
+	ethertype = ntohs(*((uint16_t*)(buf + 6)));
 
+	/* IP is the common case and continues below */
+	if (ethertype == 0x0800) {
 		LOG_DBG("* parse LLC left %zd", len - 8);
 		return 8;
 	}
+
+	if (ether_map[ethertype] == 0)
+		return -1;
+
+	/* only a dissector which found IP again lets parsing go on */
+	ret = dissect(ether_map[ethertype], buf + 8, len - 8, p, ts);
+	return ret > 0 ? ret + 8 : ret;
 }
 
-static int parse_batman_adv_packet(unsigned char* buf,
-				   __attribute__((unused)) size_t len,
-				   struct uwifi_packet* p)
+static int parse_batman_adv_14(unsigned char* buf, size_t len,
+			       struct uwifi_packet* p)
 {
 	struct batman_ogm_packet *bp;
 	//batadv_ogm_packet
 	bp = (struct batman_ogm_packet*)buf;
 
-	p->pkt_types |= PKT_TYPE_BATMAN;
-	p->bat_version = bp->version;
-	p->bat_packet_type = bp->packet_type;
-
 	LOG_DBG("parse bat len %zd type %d vers %d", len, bp->packet_type, bp->version);
 
-	/* version 14 */
-	if (bp->version == 14) {
-		switch (bp->packet_type) {
-		case BAT_OGM:
-			/* set GW flags only for "original" (not re-sent) OGMs */
-			if (bp->gw_flags != 0 && memcmp(bp->orig, p->wlan_src, WLAN_MAC_LEN) == 0)
+	switch (bp->packet_type) {
+	case BAT_OGM:
+		if (len < BATMAN_OGM_LEN)
+			return -1;
+		/* set GW flags only for "original" (not re-sent) OGMs */
+		if (bp->gw_flags != 0 && memcmp(bp->orig, p->wlan_src, WLAN_MAC_LEN) == 0)
+			p->bat_gw = 1;
+		LOG_DBG("OGM %d %d", bp->gw_flags, p->bat_gw);
+		return 0;
+	case BAT_ICMP:
+		LOG_DBG("ICMP");
+		break;
+	case BAT_UNICAST:
+		LOG_DBG("UNI %zu", sizeof(struct unicast_packet));
+		if (len < sizeof(struct unicast_packet) + 14)
+			return -1;
+		return sizeof(struct unicast_packet) + 14;
+	case BAT_BCAST:
+		LOG_DBG("BCAST");
+		break;
+	case BAT_VIS:
+	case BAT_UNICAST_FRAG:
+	case BAT_TT_QUERY:
+	case BAT_ROAM_ADV:
+		break;
+	}
+	return 0;
+}
+
+/* TVLV containers of an OGM or unicast TVLV packet from 'orig' */
+static void parse_batman_adv_tvlv(unsigned char* buf, size_t len,
+				  const unsigned char* orig,
+				  struct uwifi_packet* p, const struct timespec* ts)
+{
+	struct batadv_tvlv_hdr* th;
+	struct batadv_tvlv_gateway_data* gw;
+	uint16_t tlen;
+
+	while (len >= sizeof(struct batadv_tvlv_hdr)) {
+		th = (struct batadv_tvlv_hdr*)buf;
+		tlen = ntohs(th->len);
+		buf += sizeof(struct batadv_tvlv_hdr);
+		len -= sizeof(struct batadv_tvlv_hdr);
+		if (tlen > len)
+			return;
+
+		LOG_DBG("TVLV type %d vers %d len %d", th->type, th->version, tlen);
+
+		if (th->type == BATADV_TVLV_GW && th->version == 1 &&
+		    tlen >= sizeof(struct batadv_tvlv_gateway_data)) {
+			/* in units of 100 kbit/s, zero means no gateway */
+			gw = (struct batadv_tvlv_gateway_data*)buf;
+			batadv_orig_gw(orig, ntohl(gw->bandwidth_down) * 100,
+				       ntohl(gw->bandwidth_up) * 100, ts);
+			if (gw->bandwidth_down != 0 &&
+			    memcmp(orig, p->wlan_src, WLAN_MAC_LEN) == 0)
 				p->bat_gw = 1;
-			LOG_DBG("OGM %d %d", bp->gw_flags, p->bat_gw);
-			return 0;
-		case BAT_ICMP:
-			LOG_DBG("ICMP");
-			break;
-		case BAT_UNICAST:
-			LOG_DBG("UNI %zu", sizeof(struct unicast_packet));
-			return sizeof(struct unicast_packet) + 14;
-		case BAT_BCAST:
-			LOG_DBG("BCAST");
-			break;
-		case BAT_VIS:
-		case BAT_UNICAST_FRAG:
-		case BAT_TT_QUERY:
-		case BAT_ROAM_ADV:
-			break;
 		}
+
+		buf += tlen;
+		len -= tlen;
+	}
+}
+
+/* offset of the IP header in an encapsulated ethernet frame after 'hlen' */
+static int batman_adv_inner_ip(unsigned char* buf, size_t len, size_t hlen)
+{
+	if (len < hlen + 14)
+		return -1;
+	if (ntohs(*((uint16_t*)(buf + hlen + 12))) != 0x0800)
+		return 0;
+	return hlen + 14;
+}
+
+static int parse_batman_adv_15(unsigned char* buf, size_t len,
+			       struct uwifi_packet* p, const struct timespec* ts)
+{
+	struct batadv_ogm_packet* op;
+	struct batadv_ogm2_packet* o2;
+	struct batadv_unicast_tvlv_packet* ut;
+	size_t plen;
+
+	LOG_DBG("parse bat15 len %zd type %d", len, buf[0]);
+
+	switch (buf[0]) {
+	case BATADV_IV_OGM:
+		/* several OGMs can be aggregated in one frame */
+		while (len >= BATADV_OGM_HLEN && buf[0] == BATADV_IV_OGM) {
+			op = (struct batadv_ogm_packet*)buf;
+			plen = BATADV_OGM_HLEN + ntohs(op->tvlv_len);
+			if (plen > len)
+				return -1;
+			LOG_DBG("OGM " MAC_FMT " seq %u tq %d", MAC_PAR(op->orig),
+				ntohl(op->seqno), op->tq);
+			batadv_orig_ogm(op->orig, ntohl(op->seqno), op->tq, 0, ts);
+			parse_batman_adv_tvlv(buf + BATADV_OGM_HLEN,
+					      plen - BATADV_OGM_HLEN, op->orig, p, ts);
+			buf += plen;
+			len -= plen;
+		}
+		return 0;
+	case BATADV_OGM2:
+		while (len >= BATADV_OGM2_HLEN && buf[0] == BATADV_OGM2) {
+			o2 = (struct batadv_ogm2_packet*)buf;
+			plen = BATADV_OGM2_HLEN + ntohs(o2->tvlv_len);
+			if (plen > len)
+				return -1;
+			LOG_DBG("OGM2 " MAC_FMT " seq %u thr %u", MAC_PAR(o2->orig),
+				ntohl(o2->seqno), ntohl(o2->throughput));
+			batadv_orig_ogm(o2->orig, ntohl(o2->seqno), -1,
+					ntohl(o2->throughput) * 100, ts);
+			parse_batman_adv_tvlv(buf + BATADV_OGM2_HLEN,
+					      plen - BATADV_OGM2_HLEN, o2->orig, p, ts);
+			buf += plen;
+			len -= plen;
+		}
+		return 0;
+	case BATADV_UNICAST:
+		return batman_adv_inner_ip(buf, len, sizeof(struct batadv_unicast_packet));
+	case BATADV_UNICAST_4ADDR:
+		return batman_adv_inner_ip(buf, len, sizeof(struct batadv_unicast_4addr_packet));
+	case BATADV_BCAST:
+		return batman_adv_inner_ip(buf, len, sizeof(struct batadv_bcast_packet));
+	case BATADV_UNICAST_TVLV:
+		if (len < sizeof(struct batadv_unicast_tvlv_packet))
+			return -1;
+		ut = (struct batadv_unicast_tvlv_packet*)buf;
+		plen = sizeof(struct batadv_unicast_tvlv_packet) + ntohs(ut->tvlv_len);
+		if (plen > len)
+			return -1;
+		parse_batman_adv_tvlv(buf + sizeof(struct batadv_unicast_tvlv_packet),
+				      plen - sizeof(struct batadv_unicast_tvlv_packet),
+				      ut->src, p, ts);
+		return 0;
+	}
+	return 0;
+}
+
+/* version and packet type are the first two bytes in all versions */
+static int parse_batman_adv_packet(unsigned char* buf, size_t len,
+				   struct uwifi_packet* p, const struct timespec* ts)
+{
+	if (len < 2)
+		return -1;
+
+	p->bat_packet_type = buf[0];
+	p->bat_version = buf[1];
+
+	switch (p->bat_version) {
+	case 14:
+		return parse_batman_adv_14(buf, len, p);
+	case BATADV_COMPAT_VERSION:
+		return parse_batman_adv_15(buf, len, p, ts);
 	}
 	return 0;
 }
@@ -169,7 +510,8 @@ static int parse_ip_header(unsigned char* buf, size_t len, struct uwifi_packet*
 	return ih->ip_hl * 4;
 }
 
-static int parse_udp_header(unsigned char* buf, size_t len, struct uwifi_packet* p)
+static int parse_udp_header(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts)
 {
 	struct udphdr* uh;
 
@@ -181,102 +523,126 @@ static int parse_udp_header(unsigned char* buf, size_t len, struct uwifi_packet*
 	LOG_DBG("UPD dest port: %d", ntohs(uh->uh_dport));
 	p->tcpudp_port = ntohs(uh->uh_dport);
 
-	buf = buf + 8;
-	len = len - 8;
+	if (udp_map[p->tcpudp_port] == 0)
+		return 0;
+
+	return dissect(udp_map[p->tcpudp_port], buf + 8, len - 8, p, ts);
+}
 
-	if (p->tcpudp_port == 698) /* OLSR */
-		return parse_olsr_packet(buf, len, p);
+/* iterator over the messages in an OLSR packet, pointing into the packet */
+struct olsr_iter {
+	unsigned char*	buf;
+	size_t		len;
+};
 
-	if (p->tcpudp_port == BAT_PORT) /* batman */
-		return parse_batman_packet(buf, len, p);
+#define OLSR_MSG_HDR_LEN	12	/* struct olsrmsg without the message */
 
-	if (p->tcpudp_port == 9256 || p->tcpudp_port == 9257 ) /* MeshCruzer */
-		return parse_meshcruzer_packet(buf, len, p, p->tcpudp_port);
+static struct olsrmsg* olsr_msg_next(struct olsr_iter* it, size_t* size)
+{
+	struct olsrmsg* m;
 
-	return 0;
+	if (it->len < OLSR_MSG_HDR_LEN)
+		return NULL;
+
+	m = (struct olsrmsg*)it->buf;
+	*size = ntohs(m->olsr_msgsize);
+	if (*size < OLSR_MSG_HDR_LEN || *size > it->len)
+		return NULL;
+
+	it->buf += *size;
+	it->len -= *size;
+	return m;
+}
+
+/* number of neighbours in the link blocks of a (LQ_)HELLO message */
+static unsigned int olsr_hello_neigh(struct olsrmsg* m, size_t size,
+				     size_t entry_len)
+{
+	unsigned char* b = (unsigned char*)m->message.hello.hell_info;
+	unsigned char* end = (unsigned char*)m + size;
+	struct hellinfo* hi;
+	unsigned int number = 0;
+	size_t blen;
+
+	while (b + 4 <= end) {
+		hi = (struct hellinfo*)b;
+		blen = ntohs(hi->size);
+		if (blen < 4 || b + blen > end)
+			break;
+		number += (blen - 4) / entry_len;
+		b += blen;
+	}
+	return number;
 }
 
-static int parse_olsr_packet(unsigned char* buf, size_t len, struct uwifi_packet* p)
+/* is there a default route (0.0.0.0/0) in the HNA message */
+static bool olsr_hna_gw(struct olsrmsg* m, size_t size)
+{
+	struct hnapair* hna = m->message.hna.hna_net;
+	unsigned int i, number = (size - OLSR_MSG_HDR_LEN) / sizeof(struct hnapair);
+
+	for (i = 0; i < number; i++) {
+		LOG_DBG("HNA %s", ip_sprintf(hna[i].addr));
+		if (hna[i].addr == 0 && hna[i].netmask == 0)
+			return true;
+	}
+	return false;
+}
+
+static int parse_olsr_packet(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		const struct timespec* ts)
 {
 	struct olsr* oh;
-	int number, msgtype;
+	struct olsr_iter it;
+	struct olsrmsg* m;
+	unsigned int number;
+	size_t size;
 
 	if (len < sizeof(struct olsr))
 		return -1;
 
 	oh = (struct olsr*)buf;
 
-	// TODO: more than one olsr messages can be in one packet
-	msgtype = oh->olsr_msg[0].olsr_msgtype;
-
-	LOG_DBG("OLSR msgtype: %d*** ", msgtype);
-
-	p->pkt_types |= PKT_TYPE_OLSR;
-	p->olsr_type = msgtype;
-
-	//if (msgtype == LQ_HELLO_MESSAGE || msgtype == LQ_TC_MESSAGE )
-	//	p->pkt_types |= PKT_TYPE_OLSR_LQ;
+	/* the packet length includes its header */
+	it.buf = buf + 4;
+	it.len = MIN(len, ntohs(oh->olsr_packlen));
+	it.len = it.len > 4 ? it.len - 4 : 0;
 
-	if (msgtype == HELLO_MESSAGE) {
-		number = (ntohs(oh->olsr_msg[0].olsr_msgsize) - 12) / sizeof(struct hellomsg);
-		LOG_DBG("HELLO %d", number);
-		p->olsr_neigh = number;
-	}
+	/* the type of the first message is shown */
+	p->olsr_type = oh->olsr_msg[0].olsr_msgtype;
 
-	if (msgtype == LQ_HELLO_MESSAGE) {
-		number = (ntohs(oh->olsr_msg[0].olsr_msgsize) - 16) / 12;
-		LOG_DBG("LQ_HELLO %d (%d)", number, (ntohs(oh->olsr_msg[0].olsr_msgsize) - 16));
-		p->olsr_neigh = number;
-	}
-#if 0
-/*	XXX: tc messages are relayed. so we would have to find the originating node (IP)
-	and store the information there. skip for now */
-
-	if (msgtype == TC_MESSAGE) {
-		number = (ntohs(oh->olsr_msg[0].olsr_msgsize)-12) / sizeof(struct tcmsg);
-		LOG_DBG("TC %d", number);
-		p->olsr_tc = number;
-	}
-
-	if (msgtype == LQ_TC_MESSAGE) {
-		number = (ntohs(oh->olsr_msg[0].olsr_msgsize)-16) / 8;
-		LOG_DBG("LQ_TC %d (%d)", number, (ntohs(oh->olsr_msg[0].olsr_msgsize)-16));
-		p->olsr_tc = number;
-	}
+	while ((m = olsr_msg_next(&it, &size)) != NULL) {
+		LOG_DBG("OLSR msgtype: %d*** ", m->olsr_msgtype);
 
-	if (msgtype == HNA_MESSAGE) {
-		/* same here, but we assume that nodes which relay a HNA with a default gateway
-		know how to contact the gw, so have a indirect connection to a GW themselves */
-		struct hnapair* hna;
-		number = (ntohs(oh->olsr_msg[0].olsr_msgsize) - 12) / sizeof(struct hnapair);
-		LOG_DBG("HNA NUM: %d (%d) [%d]", number, ntohs(oh->olsr_msg[0].olsr_msgsize),
-			(int)sizeof(struct hnapair) );
-		for (i = 0; i < number; i++) {
-			hna = &(oh->olsr_msg[0].message.hna.hna_net[i]);
-			LOG_DBG("HNA %s", ip_sprintf(hna->addr));
-			LOG_DBG("/%s", ip_sprintf(hna->netmask));
-			if (hna->addr == 0 && hna->netmask == 0)
-				p->pkt_types |= PKT_TYPE_OLSR_GW;
+		switch (m->olsr_msgtype) {
+		/* HELLOs are not relayed, they are about the sender */
+		case HELLO_MESSAGE:
+			p->olsr_neigh = olsr_hello_neigh(m, size, 4);
+			LOG_DBG("HELLO %d", p->olsr_neigh);
+			break;
+		case LQ_HELLO_MESSAGE:
+			/* address and 4 bytes of link quality */
+			p->olsr_neigh = olsr_hello_neigh(m, size, 8);
+			LOG_DBG("LQ_HELLO %d", p->olsr_neigh);
+			break;
+		case TC_MESSAGE:
+		case LQ_TC_MESSAGE:
+			/* ANSN and reserved, then the addresses (with LQ) */
+			if (size < OLSR_MSG_HDR_LEN + 4)
+				break;
+			number = (size - OLSR_MSG_HDR_LEN - 4) /
+				 (m->olsr_msgtype == TC_MESSAGE ? 4 : 8);
+			LOG_DBG("TC %d from %s", number, ip_sprintf(m->originator));
+			olsr_orig_tc(m->originator, number, ts);
+			if (m->originator == p->ip_src)
+				p->olsr_tc = number;
+			break;
+		case HNA_MESSAGE:
+			olsr_orig_hna(m->originator, olsr_hna_gw(m, size), ts);
+			break;
 		}
 	}
-#endif
-	/* done for good */
-	return 0;
-}
 
-static int parse_batman_packet(__attribute__((unused)) unsigned char* buf,
-			       __attribute__((unused)) size_t len,
-			       __attribute__((unused)) struct uwifi_packet* p)
-{
-	p->pkt_types |= PKT_TYPE_BATMAN;
-	return 0;
-}
-
-static int parse_meshcruzer_packet(__attribute__((unused)) unsigned char* buf,
-				   __attribute__((unused)) size_t len,
-				   __attribute__((unused)) struct uwifi_packet* p,
-				   __attribute__((unused)) int port)
-{
-	p->pkt_types |= PKT_TYPE_MESHZ;
+	/* done for good */
 	return 0;
 }
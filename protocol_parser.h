@@ -22,9 +22,42 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <uwifi/wlan_parser.h>
 
-bool parse_packet(unsigned char* buf, size_t len, struct uwifi_packet* p);
+#define MAX_DISSECTORS		32
+
+/* parse the payload after the UDP header or after the LLC header with the
+ * ethertype. returns -1 on errors, 0 when done or, for ethertypes, the
+ * offset of an IP header to continue with. 'ts' is the receive time of the
+ * packet (CLOCK_REALTIME) */
+typedef int (*dissector_fn)(unsigned char* buf, size_t len, struct uwifi_packet* p,
+			    const struct timespec* ts);
+
+/* how far parse_packet() goes beyond the 802.11 header */
+enum parse_depth {
+	PARSE_WLAN,		/* only 802.11 */
+	PARSE_LLC,		/* ethertype, e.g. ARP and BATMAN-ADV */
+	PARSE_IP,		/* IP addresses, ICMP/TCP/UDP */
+	PARSE_ALL,		/* UDP ports and mesh protocols */
+};
+
+void protocol_parser_init(void);
+void parse_set_depth(enum parse_depth depth);
+enum parse_depth parse_depth_for_pkt_types(unsigned int types);
+
+bool parse_packet(unsigned char* buf, size_t len, struct uwifi_packet* p,
+		  int arphdr, const struct timespec* ts);
+
+bool dissector_register_udp(const char* name, uint16_t port,
+			    dissector_fn fn, unsigned int pkt_type);
+bool dissector_register_ether(const char* name, uint16_t ethertype,
+			      dissector_fn fn, unsigned int pkt_type);
+bool dissector_register_custom(const char* value, bool udp);
+bool dissector_enable(const char* name, bool on);
+unsigned int dissector_pkt_type(const char* name);
+const char* dissector_custom_name(unsigned int pkt_types);
 
 #endif
@@ -0,0 +1,397 @@
+/* horst - Highly Optimized Radio Scanning Tool
+ *
+ * Copyright (C) 2005-2017 Bruno Randolf (br1@einfach.org)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <net/if_arp.h>
+
+#include <uwifi/log.h>
+#include <uwifi/wlan80211.h>
+
+#include "main.h"
+#include "socket_filter.h"
+#include "macfilter.h"
+
+/*
+ * Compile the filter configuration into a classic BPF socket filter, so that
+ * unwanted frames are dropped in the kernel before they are copied to us.
+ *
+ * Only the checks which can be done at fixed offsets are compiled: BADFCS
+ * (radiotap flags), frame type/subtype, BSSID and source MAC. The program is
+ * conservative: whenever it can not be sure (e.g. address checks of control
+ * frames or unknown radiotap layouts) it accepts the frame and leaves the
+ * decision to filter_packet() in userspace, which still runs for every frame.
+ *
+ * The same program implements 'snaplen': accepted frames are truncated after
+ * the radiotap header plus the configured number of bytes.
+ */
+
+#define MAX_INSNS	255	/* conditional jumps have 8 bit offsets */
+#define MAX_FIXUPS	32
+
+#define ACCEPT_LEN	0xffffffff
+
+/* radiotap */
+#define RT_PRESENT_TSFT		0x01
+#define RT_PRESENT_FLAGS	0x02
+#define RT_PRESENT_EXT		0x80	/* in last byte of present word */
+#define RT_FLAG_BADFCS		0x40
+
+enum label {
+	L_ACCEPT,
+	L_DROP,
+	L_PRESENT,
+	L_FLAGS_LOAD,
+	L_FLAGS_DONE,
+	L_NEXT_TYPE,
+	L_NEXT_DS,
+	L_BSSID_OK,
+	NUM_LABELS
+};
+
+struct bpf_fixup {
+	unsigned int		idx;
+	bool			jt;
+};
+
+struct bpf_builder {
+	struct sock_filter	insn[MAX_INSNS];
+	unsigned int		len;
+	bool			error;
+	struct bpf_fixup	fix[NUM_LABELS][MAX_FIXUPS];
+	unsigned int		num_fix[NUM_LABELS];
+};
+
+/* all capture sockets, there may be several per interface */
+static struct filter_sock {
+	int	fd;
+	int	arphdr;
+} socks[MAX_INTERFACES * MAX_WORKERS];
+static int num_socks;
+
+static unsigned int emit(struct bpf_builder* b, unsigned short code,
+			 unsigned int k)
+{
+	if (b->len >= MAX_INSNS) {
+		b->error = true;
+		return 0;
+	}
+	b->insn[b->len].code = code;
+	b->insn[b->len].jt = 0;
+	b->insn[b->len].jf = 0;
+	b->insn[b->len].k = k;
+	return b->len++;
+}
+
+static void jump_to(struct bpf_builder* b, unsigned int idx, bool jt,
+		    enum label l)
+{
+	if (b->num_fix[l] >= MAX_FIXUPS) {
+		b->error = true;
+		return;
+	}
+	b->fix[l][b->num_fix[l]].idx = idx;
+	b->fix[l][b->num_fix[l]].jt = jt;
+	b->num_fix[l]++;
+}
+
+/* conditional jump: to label if condition is 'cond', else fall thru */
+static void emit_jmp(struct bpf_builder* b, unsigned short op, unsigned int k,
+		     bool cond, enum label l)
+{
+	unsigned int idx = emit(b, BPF_JMP | op | BPF_K, k);
+	jump_to(b, idx, cond, l);
+}
+
+static void emit_goto(struct bpf_builder* b, enum label l)
+{
+	unsigned int idx = emit(b, BPF_JMP | BPF_JA, 0);
+	jump_to(b, idx, true, l);
+}
+
+/* resolve all pending jumps to label 'l' to the next instruction */
+static void label_here(struct bpf_builder* b, enum label l)
+{
+	unsigned int i, idx, off;
+
+	for (i = 0; i < b->num_fix[l]; i++) {
+		idx = b->fix[l][i].idx;
+		off = b->len - idx - 1;
+		if (BPF_OP(b->insn[idx].code) == BPF_JA)
+			b->insn[idx].k = off;
+		else if (off > 255)
+			b->error = true;
+		else if (b->fix[l][i].jt)
+			b->insn[idx].jt = off;
+		else
+			b->insn[idx].jf = off;
+	}
+	b->num_fix[l] = 0;
+}
+
+/* compare 6 bytes at [X + off] with 'mac', jump to label if equal or not */
+static void emit_mac_cmp(struct bpf_builder* b, unsigned int off,
+			 const unsigned char* mac, bool equal, enum label l)
+{
+	unsigned int hi = (mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3];
+	unsigned int lo = (mac[4] << 8) | mac[5];
+	unsigned int idx;
+
+	emit(b, BPF_LD | BPF_W | BPF_IND, off);
+	if (equal) {
+		/* skip the second half if the first does not match */
+		idx = emit(b, BPF_JMP | BPF_JEQ | BPF_K, hi);
+		b->insn[idx].jf = 2;
+	} else
+		emit_jmp(b, BPF_JEQ, hi, false, l);
+	emit(b, BPF_LD | BPF_H | BPF_IND, off + 4);
+	emit_jmp(b, BPF_JEQ, lo, equal, l);
+}
+
+/* M[0] = X = length of the radiotap header */
+static void compile_radiotap_len(struct bpf_builder* b)
+{
+	/* header length is little endian */
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 3);
+	emit(b, BPF_ALU | BPF_LSH | BPF_K, 8);
+	emit(b, BPF_MISC | BPF_TAX, 0);
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 2);
+	emit(b, BPF_ALU | BPF_OR | BPF_X, 0);
+	emit(b, BPF_ST, 0);
+	emit(b, BPF_MISC | BPF_TAX, 0);
+}
+
+static void compile_radiotap(struct bpf_builder* b)
+{
+	/* find the flags field: it follows the present words (up to three
+	 * are handled, otherwise we accept) and the 8 byte aligned TSFT */
+	emit(b, BPF_LDX | BPF_IMM, 8);
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 7);
+	emit_jmp(b, BPF_JSET, RT_PRESENT_EXT, false, L_PRESENT);
+	emit(b, BPF_LDX | BPF_IMM, 12);
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 11);
+	emit_jmp(b, BPF_JSET, RT_PRESENT_EXT, false, L_PRESENT);
+	emit(b, BPF_LDX | BPF_IMM, 16);
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 15);
+	emit_jmp(b, BPF_JSET, RT_PRESENT_EXT, true, L_ACCEPT);
+
+	label_here(b, L_PRESENT);
+	emit(b, BPF_LD | BPF_B | BPF_ABS, 4);
+	emit_jmp(b, BPF_JSET, RT_PRESENT_FLAGS, false, L_FLAGS_DONE);
+	emit_jmp(b, BPF_JSET, RT_PRESENT_TSFT, false, L_FLAGS_LOAD);
+	emit(b, BPF_MISC | BPF_TXA, 0);
+	emit(b, BPF_ALU | BPF_ADD | BPF_K, 7);
+	emit(b, BPF_ALU | BPF_AND | BPF_K, ~7U);
+	emit(b, BPF_ALU | BPF_ADD | BPF_K, 8);
+	emit(b, BPF_MISC | BPF_TAX, 0);
+
+	label_here(b, L_FLAGS_LOAD);
+	emit(b, BPF_LD | BPF_B | BPF_IND, 0);
+	/* headers of frames with bad FCS can not be trusted, so they are
+	 * either all shown or all filtered, like in filter_packet() */
+	emit_jmp(b, BPF_JSET, RT_FLAG_BADFCS, true,
+		 conf.filter_badfcs ? L_ACCEPT : L_DROP);
+
+	label_here(b, L_FLAGS_DONE);
+	emit(b, BPF_LDX | BPF_MEM, 0);
+}
+
+static void compile_bssid(struct bpf_builder* b, int type)
+{
+	/* offset of BSSID for FromDS/ToDS 0, 1 (ToDS), 2 (FromDS) */
+	static const unsigned int ds_off[] = { 16, 4, 10 };
+	unsigned int ds;
+
+	if (type == WLAN_FRAME_TYPE_MGMT) {
+		emit_mac_cmp(b, 16, conf.filterbssid, false, L_DROP);
+		return;
+	}
+
+	for (ds = 0; ds < 3; ds++) {
+		emit(b, BPF_LD | BPF_B | BPF_IND, 1);
+		emit(b, BPF_ALU | BPF_AND | BPF_K, 0x03);
+		emit_jmp(b, BPF_JEQ, ds, false, L_NEXT_DS);
+		emit_mac_cmp(b, ds_off[ds], conf.filterbssid, false, L_DROP);
+		emit_goto(b, L_BSSID_OK);
+		label_here(b, L_NEXT_DS);
+	}
+	/* WDS frames have no BSSID */
+	emit_goto(b, L_ACCEPT);
+	label_here(b, L_BSSID_OK);
+}
+
+static void compile_type(struct bpf_builder* b, int type)
+{
+	uint16_t stypes = conf.filter_stype[type];
+	int i;
+
+	emit(b, BPF_LD | BPF_B | BPF_IND, 0);
+	emit(b, BPF_ALU | BPF_AND | BPF_K, 0x0c);
+	emit_jmp(b, BPF_JEQ, type << 2, false, L_NEXT_TYPE);
+
+	if (stypes == 0) {
+		emit_goto(b, L_DROP);
+		label_here(b, L_NEXT_TYPE);
+		return;
+	}
+
+	if (stypes != 0xffff) {
+		/* A = BIT(subtype) */
+		emit(b, BPF_LD | BPF_B | BPF_IND, 0);
+		emit(b, BPF_ALU | BPF_RSH | BPF_K, 4);
+		emit(b, BPF_MISC | BPF_TAX, 0);
+		emit(b, BPF_LD | BPF_IMM, 1);
+		emit(b, BPF_ALU | BPF_LSH | BPF_X, 0);
+		emit_jmp(b, BPF_JSET, stypes, false, L_DROP);
+		emit(b, BPF_LDX | BPF_MEM, 0);
+	}
+
+	/* addresses of control frames vary, leave them to userspace */
+	if (type == WLAN_FRAME_TYPE_CTRL) {
+		emit_goto(b, L_ACCEPT);
+		label_here(b, L_NEXT_TYPE);
+		return;
+	}
+
+	if (MAC_NOT_EMPTY(conf.filterbssid))
+		compile_bssid(b, type);
+
+	/* source (transmitter) address */
+	if (conf.do_macfilter && macfilter_simple()) {
+		for (i = 0; i < MAX_FILTERMAC; i++) {
+			if (!conf.filtermac_enabled[i])
+				continue;
+			emit_mac_cmp(b, 10, conf.filtermac[i], true, L_ACCEPT);
+		}
+		emit_goto(b, L_DROP);
+	}
+
+	emit_goto(b, L_ACCEPT);
+	label_here(b, L_NEXT_TYPE);
+}
+
+static bool socket_filter_compile(struct bpf_builder* b, int arphdr,
+				  bool filter)
+{
+	memset(b, 0, sizeof(struct bpf_builder));
+
+	if (arphdr == ARPHRD_IEEE80211_RADIOTAP) {
+		compile_radiotap_len(b);
+		if (filter)
+			compile_radiotap(b);
+	} else if (arphdr == ARPHRD_IEEE80211) {
+		emit(b, BPF_LD | BPF_IMM, 0);
+		emit(b, BPF_ST, 0);
+		emit(b, BPF_LDX | BPF_IMM, 0);
+	} else
+		return false;
+
+	if (filter) {
+		compile_type(b, WLAN_FRAME_TYPE_MGMT);
+		compile_type(b, WLAN_FRAME_TYPE_CTRL);
+		compile_type(b, WLAN_FRAME_TYPE_DATA);
+
+		/* frame type 3 is not defined */
+		label_here(b, L_DROP);
+		emit(b, BPF_RET | BPF_K, 0);
+	}
+
+	label_here(b, L_ACCEPT);
+	if (conf.snaplen) {
+		/* truncate after 'snaplen' bytes of the 802.11 frame, the
+		 * original length is still reported to us by the kernel */
+		emit(b, BPF_LD | BPF_MEM, 0);
+		emit(b, BPF_ALU | BPF_ADD | BPF_K, conf.snaplen);
+		emit(b, BPF_RET | BPF_A, 0);
+	} else
+		emit(b, BPF_RET | BPF_K, ACCEPT_LEN);
+
+	return !b->error;
+}
+
+/* true if filter_packet() would not drop anything we can check here */
+static bool socket_filter_needed(void)
+{
+	if (conf.filter_off)
+		return false;
+
+	return !conf.filter_badfcs ||
+		conf.filter_stype[WLAN_FRAME_TYPE_MGMT] != 0xffff ||
+		conf.filter_stype[WLAN_FRAME_TYPE_CTRL] != 0xffff ||
+		conf.filter_stype[WLAN_FRAME_TYPE_DATA] != 0xffff ||
+		MAC_NOT_EMPTY(conf.filterbssid) ||
+		conf.do_macfilter;
+}
+
+static void socket_filter_detach(int fd)
+{
+	int dummy = 0;
+
+	/* fails with ENOENT if no filter was attached */
+	setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+}
+
+static void socket_filter_attach(int fd, int arphdr)
+{
+	static struct bpf_builder b;
+	struct sock_fprog prog;
+	bool filter = socket_filter_needed();
+
+	if (!filter && !conf.snaplen) {
+		socket_filter_detach(fd);
+		return;
+	}
+
+	if (!socket_filter_compile(&b, arphdr, filter)) {
+		LOG_DBG("No socket filter for ARPHDR %d", arphdr);
+		socket_filter_detach(fd);
+		return;
+	}
+
+	prog.len = b.len;
+	prog.filter = b.insn;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+		       sizeof(prog)) < 0) {
+		LOG_ERR("Could not attach socket filter (%s)", strerror(errno));
+		return;
+	}
+	LOG_DBG("Socket filter for fd %d: %u instructions", fd, b.len);
+}
+
+/* no sockets are registered while reading config or when not capturing
+ * locally, so this is a no-op then */
+void socket_filter_update(void)
+{
+	for (int i = 0; i < num_socks; i++)
+		socket_filter_attach(socks[i].fd, socks[i].arphdr);
+}
+
+void socket_filter_add(int fd, int arphdr)
+{
+	if (num_socks >= MAX_INTERFACES * MAX_WORKERS)
+		return;
+
+	socks[num_socks].fd = fd;
+	socks[num_socks].arphdr = arphdr;
+	num_socks++;
+	socket_filter_attach(fd, arphdr);
+}